@@ -4,13 +4,14 @@
 
 void powmod_normal(mpz_t, const mpz_t, const mpz_t, const mpz_t);
 void powmod_montgomery(mpz_t, const mpz_t, const mpz_t, const mpz_t);
+void powmod_montgomery_lazy(mpz_t, const mpz_t, const mpz_t, const mpz_t);
 
 int main(int argc, char *argv[]) {
   mpz_t a, b, m;
-  mpz_t c1, c2;
+  mpz_t c1, c2, c3;
   gmp_randstate_t state;
 
-  mpz_inits(a, b, m, c1, c2, NULL);
+  mpz_inits(a, b, m, c1, c2, c3, NULL);
   gmp_randinit_default(state);
 
   mpz_set_str(m,
@@ -28,18 +29,21 @@ int main(int argc, char *argv[]) {
   // When (a, m) = 1 && a < m && b > 0
   powmod_normal    (c1, a, b, m);
   powmod_montgomery(c2, a, b, m);
+  powmod_montgomery_lazy(c3, a, b, m);
 
   // Assert
   // TODO: 시간 비교
   assert(mpz_cmp(c1, c2) == 0);
+  assert(mpz_cmp(c1, c3) == 0);
   gmp_printf(
     "a  = %Zx\n"
     "b  = %Zx\n"
     "m  = %Zx\n"
     "c1 = %Zx\n"
-    "c2 = %Zx\n", a, b, m, c1, c2);
+    "c2 = %Zx\n"
+    "c3 = %Zx\n", a, b, m, c1, c2, c3);
 
-  mpz_clears(a, b, m, c1, c2, NULL);
+  mpz_clears(a, b, m, c1, c2, c3, NULL);
   gmp_randclear(state);
   return 0;
 }
@@ -109,3 +113,57 @@ void powmod_montgomery(mpz_t result, const mpz_t a, const mpz_t b, const mpz_t m
   // Clear all
   mpz_clears(r, r_inv, m_, a_, T, Um, NULL);
 }
+
+// Same as powmod_montgomery, but R = 2 ^ (M_SIZE + 2) > 4m
+// T stays in [0, 2m) without the compare and subtraction: for x, y < 2m,
+// (x * y + U * m) / R < (4m * m + R * m) / R < 2m. Only the result is
+// reduced, once, when it leaves Montgomery form.
+void powmod_montgomery_lazy(mpz_t result, const mpz_t a, const mpz_t b, const mpz_t m) {
+  mpz_t r, r_inv, m_;
+  mpz_t a_;
+  mpz_t T, Um;
+  const int R_SIZE = mpz_sizeinbase(m, 2) + 2;
+  const int B_SIZE = mpz_sizeinbase(b, 2);
+
+  mpz_inits(r, r_inv, m_, a_, T, Um, NULL);
+
+  // 1. Create R > 4m
+  mpz_setbit(r, R_SIZE);
+
+  // 2. Pre-calculate inverses
+  mpz_invert(r_inv, r, m);
+  mpz_invert(m_, m, r);
+  mpz_sub(m_, r, m_);
+
+  mpz_mul_2exp(a_, a, R_SIZE); // a' = a * R = a * 2 ^ R_SIZE
+  mpz_fdiv_r(a_, a_, m);
+
+  // 3. Calculate power, T in [0, 2m)
+  mpz_set(T, a_);
+  for (int i = B_SIZE - 2; i >= 0; --i) {
+    // T <- T * T
+    mpz_mul(T, T, T);
+    mpz_mul(Um, T, m_);
+    mpz_fdiv_r_2exp(Um, Um, R_SIZE);
+    mpz_mul(Um, Um, m);
+    mpz_add(T, T, Um);
+    mpz_fdiv_q_2exp(T, T, R_SIZE);
+
+    // T <- T * a'
+    if (mpz_tstbit(b, i)) {
+      mpz_mul(T, T, a_);
+      mpz_mul(Um, T, m_);
+      mpz_fdiv_r_2exp(Um, Um, R_SIZE);
+      mpz_mul(Um, Um, m);
+      mpz_add(T, T, Um);
+      mpz_fdiv_q_2exp(T, T, R_SIZE);
+    }
+  }
+
+  // 4. Revert montgomery reduction, the only reduction to [0, m)
+  mpz_mul(result, T, r_inv);
+  mpz_fdiv_r(result, result, m);
+
+  // Clear all
+  mpz_clears(r, r_inv, m_, a_, T, Um, NULL);
+}
@@ -0,0 +1,92 @@
+#include <chrono>
+#include <cstdio>
+
+#include "rsa_async.hpp"
+
+// Submit-to-resume overhead of the coroutine API
+
+#define REPEAT_SIZE 200000
+#define RSA_REPEAT  200
+#define KEY_SIZE    2048
+
+static RSA_PUBKEY pub;
+static RSA_PRIKEY pri;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static rsa::detached noop_loop(rsa::crypto_executor& ex, rsa::completion_queue& cq,
+                               int n, int& done) {
+  for (int i = 0; i < n; ++i) co_await rsa::async_call(ex, cq, [] {});
+  ++done;
+}
+
+static rsa::detached sign_loop(rsa::crypto_executor& ex, rsa::completion_queue& cq,
+                               int n, int& done) {
+  mpz_t x, y;
+  mpz_inits(x, y, NULL);
+  mpz_set_ui(x, 0x12345678);
+  for (int i = 0; i < n; ++i) co_await rsa::async_pri_exp(ex, cq, y, x, &pri);
+  mpz_clears(x, y, NULL);
+  ++done;
+}
+
+// Drive the completion queue like an I/O thread would
+static void drive(rsa::completion_queue& cq, int& done, int target) {
+  while (done < target) cq.run_one();
+}
+
+int main(int argc, char *argv[]) {
+  rsa::crypto_executor ex;
+  rsa::completion_queue cq;
+  gmp_randstate_t rnd;
+
+  gmp_randinit_default(rnd);
+  rsa_key_init(&pub, &pri);
+  rsa_key_gen(&pub, &pri, KEY_SIZE, rnd);
+  printf("crypto workers: %u\n", ex.size());
+
+  // (1) Empty operation, one coroutine: pure round trip
+  {
+    int done = 0;
+    auto start = std::chrono::steady_clock::now();
+    noop_loop(ex, cq, REPEAT_SIZE, done);
+    drive(cq, done, 1);
+    double res = seconds_since(start);
+    printf("[noop x1  ]: %f s, %.0f ns per submit-to-resume\n", res, res * 1e9 / REPEAT_SIZE);
+  }
+
+  // (2) Empty operation, 64 coroutines in flight
+  {
+    int done = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 64; ++i) noop_loop(ex, cq, REPEAT_SIZE / 64, done);
+    drive(cq, done, 64);
+    double res = seconds_since(start);
+    printf("[noop x64 ]: %f s, %.0f ns per operation\n", res, res * 1e9 / (REPEAT_SIZE / 64 * 64));
+  }
+
+  // (3) rsa_pri_exp, direct call vs co_await
+  {
+    mpz_t x, y;
+    mpz_inits(x, y, NULL);
+    mpz_set_ui(x, 0x12345678);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < RSA_REPEAT; ++i) rsa_pri_exp(y, x, &pri);
+    double direct = seconds_since(start);
+    mpz_clears(x, y, NULL);
+
+    int done = 0;
+    start = std::chrono::steady_clock::now();
+    sign_loop(ex, cq, RSA_REPEAT, done);
+    drive(cq, done, 1);
+    double async = seconds_since(start);
+    printf("[pri_exp  ]: direct %f s, co_await %f s, %+.0f ns per call\n",
+      direct, async, (async - direct) * 1e9 / RSA_REPEAT);
+  }
+
+  rsa_key_clear(&pub, &pri);
+  gmp_randclear(rnd);
+  return 0;
+}
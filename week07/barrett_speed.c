@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// Modular multiply / add: mpz_mod vs Barrett vs Montgomery
+
+#define RANDOM_SEED 0x1234567890abcdefUL
+#define REPEAT_SIZE 100000
+
+int main(int argc, char *argv[]) {
+  static const int SIZES[] = {1024, 2048, 3072, 4096};
+  mp_limb_t am[RSA_MAX_LIMBS], bm[RSA_MAX_LIMBS];
+  mpz_t n, a, b, c;
+  gmp_randstate_t state;
+
+  mpz_inits(n, a, b, c, NULL);
+  gmp_randinit_default(state);
+  gmp_randseed_ui(state, RANDOM_SEED);
+
+  for (size_t k = 0; k < sizeof(SIZES) / sizeof(SIZES[0]); ++k) {
+    const int bits = SIZES[k];
+    RSA_BARRETT br;
+    RSA_MONT mont;
+    clock_t start;
+
+    mpz_urandomb(n, state, bits);
+    mpz_setbit(n, bits - 1);
+    mpz_setbit(n, 0);
+    mpz_urandomm(a, state, n);
+    mpz_urandomm(b, state, n);
+    rsa_barrett_init(&br, n);
+    rsa_mont_init(&mont, n);
+    rsa_mont_to(am, a, &mont);
+    rsa_mont_to(bm, b, &mont);
+    printf("== %d bits ==\n", bits);
+
+    // (1) mpz_mul + mpz_mod
+    start = clock();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_mul_mod(c, a, b, n);
+    printf("[mul mpz_mod   ]: %f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+
+    // (2) Barrett
+    start = clock();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_barrett_mul_mod(c, a, b, &br);
+    printf("[mul Barrett   ]: %f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+
+    // (3) Montgomery, operands already converted
+    start = clock();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_mont_mul(am, am, bm, &mont);
+    printf("[mul Montgomery]: %f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+
+    // (4) Addition
+    start = clock();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_add_mod(c, a, b, n);
+    printf("[add mpz_mod   ]: %f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+
+    start = clock();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_barrett_add_mod(c, a, b, &br);
+    printf("[add Barrett   ]: %f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+
+    rsa_barrett_clear(&br);
+    rsa_mont_clear(&mont);
+  }
+
+  mpz_clears(n, a, b, c, NULL);
+  gmp_randclear(state);
+  return 0;
+}
@@ -0,0 +1,203 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// RSA_CACHE under a tenant mix: TENANTS key ids drawn with a Zipf(1)
+// distribution, so a few thousand ids take most of the traffic. Every
+// id maps to a pair out of PRIME_COUNT primes, the loader builds the
+// RSA_PRIKEY from that, as a key store would. Each request looks the key
+// up (the hit row only asks for the HOT_SET most popular ids, which stay
+// resident), and in the second pair of rows also signs with rsa_pri_exp_hot;
+// the baseline loads the RSA_PRIKEY and builds the hot key on every
+// request instead.
+//
+//   cache_speed [threads] [budget KiB] [shards]
+
+#define KEY_SIZE 2048
+#define PRIME_COUNT 640
+#define TENANTS 200000
+#define LOOKUP_SIZE 65536
+#define HIT_SIZE 4194304
+#define HOT_SET 512
+#define REBUILD_SIZE 4096
+#define SIGN_SIZE 2048
+
+static mpz_t prime[PRIME_COUNT];
+static double zipf_cdf[TENANTS];
+
+static int load_key(RSA_PRIKEY *k, uint64_t id, void *arg) {
+  const int i = (int)(id % PRIME_COUNT), j = (int)((id / PRIME_COUNT + 1 + i) % PRIME_COUNT);
+  mpz_t x, y;
+  (void)arg;
+  if (id >= TENANTS || i == j) return -1;
+  mpz_inits(x, y, NULL);
+  mpz_set(k->p, prime[i > j ? i : j]);
+  mpz_set(k->q, prime[i > j ? j : i]);
+  mpz_set_ui(k->e, 0x10001);
+  mpz_mul(k->n, k->p, k->q);
+  mpz_sub_ui(x, k->p, 1);
+  mpz_sub_ui(y, k->q, 1);
+  mpz_lcm(x, x, y);
+  mpz_invert(k->d, k->e, x);
+  k->RSA_SIZE = KEY_SIZE;
+  mpz_clears(x, y, NULL);
+  return 0;
+}
+
+// Tenant id for a uniform draw
+static uint64_t zipf(gmp_randstate_t rnd, mpz_t t) {
+  double u;
+  int lo = 0, hi = TENANTS - 1;
+  mpz_urandomb(t, rnd, 53);
+  u = mpz_get_d(t) / 9007199254740992.0;
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (zipf_cdf[mid] > u) hi = mid;
+    else lo = mid + 1;
+  }
+  // Spread the hot ids over the id space
+  return (uint64_t)lo * 7919 % TENANTS;
+}
+
+typedef struct __WORKER {
+  pthread_t th;
+  RSA_CACHE *cache;
+  unsigned seed;
+  int ops, sign, hot;
+} WORKER;
+
+static void *run_cached(void *arg) {
+  WORKER *w = (WORKER*)arg;
+  gmp_randstate_t rnd;
+  mpz_t x, y;
+  gmp_randinit_default(rnd);
+  gmp_randseed_ui(rnd, w->seed);
+  mpz_inits(x, y, NULL);
+  mpz_urandomb(x, rnd, KEY_SIZE - 2);
+  for (int i = 0; i < w->ops; ++i) {
+    const uint64_t id = w->hot ? (uint64_t)(rand_r(&w->seed) % HOT_SET) * 7919 % TENANTS
+                               : zipf(rnd, y);
+    const RSA_HOTKEY *hk = rsa_cache_get(w->cache, id);
+    if (!hk) continue;
+    if (w->sign) rsa_pri_exp_hot(y, x, hk);
+    rsa_cache_put(w->cache);
+  }
+  mpz_clears(x, y, NULL);
+  gmp_randclear(rnd);
+  return NULL;
+}
+
+static void *run_rebuilt(void *arg) {
+  WORKER *w = (WORKER*)arg;
+  gmp_randstate_t rnd;
+  RSA_PRIKEY pri;
+  RSA_HOTKEY hk;
+  mpz_t x, y;
+  gmp_randinit_default(rnd);
+  gmp_randseed_ui(rnd, w->seed);
+  mpz_inits(x, y, NULL);
+  rsa_key_init(NULL, &pri);
+  mpz_urandomb(x, rnd, KEY_SIZE - 2);
+  for (int i = 0; i < w->ops; ++i) {
+    if (load_key(&pri, zipf(rnd, y), NULL) != 0
+        || rsa_hotkey_init(&hk, &pri) != 0) continue;
+    if (w->sign) rsa_pri_exp_hot(y, x, &hk);
+    rsa_hotkey_clear(&hk);
+  }
+  rsa_key_clear(NULL, &pri);
+  mpz_clears(x, y, NULL);
+  gmp_randclear(rnd);
+  return NULL;
+}
+
+static double wall(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Every run draws its own ids, so warm up does not replay the measurement
+static double run(void *(*fn)(void*), RSA_CACHE *cache, int threads, int ops, int sign,
+                  int hot) {
+  static unsigned seed = 1;
+  WORKER w[RSA_CACHE_MAX_THREADS];
+  const double start = wall();
+  for (int i = 0; i < threads; ++i) {
+    w[i].cache = cache;
+    w[i].seed = seed++;
+    w[i].ops = ops / threads;
+    w[i].sign = sign;
+    w[i].hot = hot;
+    pthread_create(&w[i].th, NULL, fn, &w[i]);
+  }
+  for (int i = 0; i < threads; ++i) pthread_join(w[i].th, NULL);
+  return wall() - start;
+}
+
+int main(int argc, char *argv[]) {
+  const int threads = argc > 1 ? atoi(argv[1]) : 4;
+  const size_t budget = (argc > 2 ? (size_t)atol(argv[2]) : 4096) << 10;
+  const int shards = argc > 3 ? atoi(argv[3]) : 16;
+  gmp_randstate_t rnd;
+  RSA_CACHE *cache;
+  RSA_CACHE_STATS st, st0;
+  double sum = 0, t;
+
+  if (threads <= 0 || threads > RSA_CACHE_MAX_THREADS - 1 || shards <= 0 || budget == 0) {
+    printf("Usage: cache_speed [threads < %d] [budget KiB] [shards]\n", RSA_CACHE_MAX_THREADS);
+    return 0;
+  }
+  gmp_randinit_default(rnd);
+  for (int i = 0; i < PRIME_COUNT; ++i) {
+    mpz_init(prime[i]);
+    do {
+      mpz_urandomb(prime[i], rnd, KEY_SIZE / 2);
+      mpz_setbit(prime[i], KEY_SIZE / 2 - 1);
+      mpz_setbit(prime[i], KEY_SIZE / 2 - 2);
+      mpz_nextprime(prime[i], prime[i]);
+    } while (mpz_fdiv_ui(prime[i], 0x10001) == 1);
+  }
+  for (int i = 0; i < TENANTS; ++i) zipf_cdf[i] = sum += 1.0 / (i + 1);
+  for (int i = 0; i < TENANTS; ++i) zipf_cdf[i] /= sum;
+
+  cache = rsa_cache_new(budget, shards, load_key, NULL);
+  if (!cache) {
+    puts("rsa_cache_new failed");
+    return 1;
+  }
+  // Warm up until the budget is full, then measure
+  run(run_cached, cache, threads, LOOKUP_SIZE, 0, 0);
+  rsa_cache_stats(cache, &st0);
+  printf("%d tenants, %d threads, %zu KiB in %d shards, %llu keys resident after warm up\n",
+         TENANTS, threads, budget >> 10, shards, (unsigned long long)st0.entries);
+
+  t = run(run_cached, cache, threads, LOOKUP_SIZE, 0, 0);
+  printf("[%-20s]: %f s, %8.0f op/s\n", "rsa_cache lookup", t, LOOKUP_SIZE / t);
+  // Counters of the Zipf lookups only
+  rsa_cache_stats(cache, &st);
+  st.hits -= st0.hits;
+  st.misses -= st0.misses;
+  st.evictions -= st0.evictions;
+  printf("hits %llu, misses %llu (%.1f%% hit), evictions %llu, entries %llu, %llu KiB,"
+         " retired not yet freed %llu\n",
+         (unsigned long long)st.hits, (unsigned long long)st.misses,
+         100.0 * st.hits / (st.hits + st.misses ? st.hits + st.misses : 1),
+         (unsigned long long)st.evictions, (unsigned long long)st.entries,
+         (unsigned long long)(st.bytes >> 10), (unsigned long long)st.retired);
+
+  t = run(run_cached, cache, threads, HIT_SIZE, 0, 1);
+  printf("[%-20s]: %f s, %8.0f op/s\n", "rsa_cache hit", t, HIT_SIZE / t);
+  t = run(run_rebuilt, NULL, threads, REBUILD_SIZE, 0, 0);
+  printf("[%-20s]: %f s, %8.0f op/s\n", "rebuilt", t, REBUILD_SIZE / t);
+  t = run(run_cached, cache, threads, SIGN_SIZE, 1, 0);
+  printf("[%-20s]: %f s, %8.0f op/s\n", "rsa_cache + sign", t, SIGN_SIZE / t);
+  t = run(run_rebuilt, NULL, threads, SIGN_SIZE, 1, 0);
+  printf("[%-20s]: %f s, %8.0f op/s\n", "rebuilt + sign", t, SIGN_SIZE / t);
+
+  rsa_cache_free(cache);
+  for (int i = 0; i < PRIME_COUNT; ++i) mpz_clear(prime[i]);
+  gmp_randclear(rnd);
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// ChaCha20 DRBG vs GMP default generator
+
+#define BIT_SIZE 2048
+#define REPEAT_SIZE 1000000
+#define KEY_SIZE 2048
+#define KEY_REPEAT 20
+
+RSA_PUBKEY pub;
+RSA_PRIKEY pri;
+
+int main(int argc, char *argv[]) {
+  gmp_randstate_t state;
+  RSA_DRBG drbg;
+  mpz_t a;
+
+  mpz_init2(a, BIT_SIZE);
+  gmp_randinit_default(state);
+  gmp_randseed_ui(state, (unsigned long)time(NULL));
+  if (rsa_drbg_init_os(&drbg) != 0) {
+    puts("No OS entropy source");
+    return 1;
+  }
+  rsa_key_init(&pub, &pri);
+
+  // 1. Random bytes per second
+  {
+    clock_t start = clock();
+    for (int i = 0; i < REPEAT_SIZE; ++i) mpz_urandomb(a, state, BIT_SIZE);
+    double res = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("[mpz_urandomb     ]: %f s, %.1f MB/s\n", res, REPEAT_SIZE * (BIT_SIZE / 8) / res / 1e6);
+  }
+  {
+    clock_t start = clock();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_drbg_urandomb(a, &drbg, BIT_SIZE);
+    double res = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("[rsa_drbg_urandomb]: %f s, %.1f MB/s\n", res, REPEAT_SIZE * (BIT_SIZE / 8) / res / 1e6);
+  }
+
+  // 2. Fork cost
+  {
+    RSA_DRBG child;
+    clock_t start = clock();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_drbg_fork(&child, &drbg, i);
+    double res = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("[rsa_drbg_fork    ]: %f s, %.0f ns per fork\n", res, res * 1e9 / REPEAT_SIZE);
+  }
+
+  // 3. Key generation latency
+  {
+    clock_t start = clock();
+    for (int i = 0; i < KEY_REPEAT; ++i) rsa_key_gen(&pub, &pri, KEY_SIZE, state);
+    double res = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("[rsa_key_gen      ]: %f s per key\n", res / KEY_REPEAT);
+  }
+  {
+    clock_t start = clock();
+    for (int i = 0; i < KEY_REPEAT; ++i) rsa_key_gen_drbg(&pub, &pri, KEY_SIZE, &drbg);
+    double res = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("[rsa_key_gen_drbg ]: %f s per key\n", res / KEY_REPEAT);
+  }
+
+  rsa_key_clear(&pub, &pri);
+  rsa_drbg_clear(&drbg);
+  gmp_randclear(state);
+  mpz_clear(a);
+  return 0;
+}
@@ -0,0 +1,549 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rsa.h"
+
+// Differential fuzzer and soak test
+// Every custom kernel is run against plain GMP on the same operands, with
+// random, edge-case and adversarial limb patterns for both the modulus and
+// the operands, at every size up to MAX_RSA_SIZE. Runs until the time is
+// up, prints throughput and mismatches every few seconds, and exits with 1
+// if anything ever disagreed. Reproducible with -s (one DRBG stream per
+// thread).
+//
+//   fuzz -t 8 -d 36000         # 8 threads for 10 hours
+
+enum {
+  OP_ADD_MOD, OP_MUL_MOD,                                      // rsa_helper
+  OP_BAR_ADD, OP_BAR_SUB, OP_BAR_MUL, OP_BAR_REDUCE,           // rsa_barrett
+  OP_MONT_MUL, OP_MONT_SQR, OP_MONT_POWM, OP_PLAN_POWM,        // rsa_mont, rsa_plan
+  OP_MULTI_POWM, OP_INVERT, OP_INV_BATCH, OP_PUB_EXP, OP_BATCH, // ...
+  OP_CRT, OP_HOT, OP_PAR, OP_NTT_POWM, OP_MAX
+};
+
+static const char *OP_NAME[OP_MAX] = {
+  "add_mod", "mul_mod", "barrett_add", "barrett_sub", "barrett_mul", "barrett_reduce",
+  "mont_mul", "mont_sqr", "mont_powm", "plan_powm", "multi_powm", "invert",
+  "inv_batch", "pub_exp", "pub_exp_batch", "pri_exp (CRT)",
+  "pri_exp_hot", "pri_exp_par", "ntt_powm"
+};
+
+// Expensive operations are drawn less often
+static const int OP_WEIGHT[OP_MAX] = {6, 6, 6, 6, 8, 6, 8, 6, 2, 2, 2, 3, 2, 2, 1, 1, 1, 1, 1};
+
+#define BATCH 6
+#define KEY_MAX_BITS 4096 // CRT keys, nextprime is slow beyond
+#define NTT_EXP_BITS 512  // NTT products cost several mpz_mul each
+#define MAX_REPORTS 20
+
+typedef struct __OP_STAT {
+  atomic_uint_fast64_t ops, bad;
+  atomic_uint_fast64_t ns; // in the custom kernel
+  atomic_uint_fast64_t ref_ns; // in GMP
+} OP_STAT;
+
+static OP_STAT op_stat[OP_MAX];
+static atomic_int stop, reports;
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+static int max_bits = MAX_RSA_SIZE;
+static uint8_t seed[32];
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t draw(RSA_DRBG *g, uint64_t bound) {
+  uint64_t x;
+  rsa_drbg_bytes(g, &x, sizeof(x));
+  return bound ? x % bound : x;
+}
+
+// Limb patterns that hit carries, borrows and the final subtractions
+static void limb_pattern(mpz_t x, int bits, RSA_DRBG *g) {
+  const mp_size_t n = (bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+  mp_limb_t *p = mpz_limbs_write(x, n);
+  for (mp_size_t i = 0; i < n; ++i) {
+    switch (draw(g, 6)) {
+    case 0: p[i] = 0; break;
+    case 1: p[i] = ~(mp_limb_t)0; break;
+    case 2: p[i] = 1; break;
+    case 3: p[i] = (mp_limb_t)1 << (GMP_NUMB_BITS - 1); break;
+    default: p[i] = draw(g, 0);
+    }
+  }
+  mpz_limbs_finish(x, n);
+  mpz_fdiv_r_2exp(x, x, bits);
+}
+
+// Odd modulus of exactly `bits` bits, bits >= 2
+static void gen_modulus(mpz_t n, int bits, RSA_DRBG *g) {
+  switch (draw(g, 5)) {
+  case 0: // 2 ^ bits - 1
+    mpz_set_ui(n, 0);
+    mpz_setbit(n, bits);
+    mpz_sub_ui(n, n, 1);
+    break;
+  case 1: // 2 ^ (bits - 1) + 1, the smallest
+    mpz_set_ui(n, 1);
+    mpz_setbit(n, bits - 1);
+    break;
+  case 2:
+    limb_pattern(n, bits, g);
+    break;
+  default:
+    rsa_drbg_urandomb(n, g, bits);
+  }
+  mpz_setbit(n, bits - 1);
+  mpz_setbit(n, 0);
+}
+
+// Operand in [0, n)
+static void gen_operand(mpz_t x, const mpz_t n, RSA_DRBG *g) {
+  const int bits = (int)mpz_sizeinbase(n, 2);
+  switch (draw(g, 8)) {
+  case 0: // 0, 1, 2
+    mpz_set_ui(x, draw(g, 3));
+    break;
+  case 1: // n - 1, n - 2, ...
+    mpz_sub_ui(x, n, 1 + draw(g, 3));
+    break;
+  case 2: // 2 ^ k, 2 ^ k - 1
+    mpz_set_ui(x, 0);
+    mpz_setbit(x, draw(g, bits));
+    if (draw(g, 2)) mpz_sub_ui(x, x, 1);
+    break;
+  case 3: // R mod n - small, next to the Montgomery one
+    mpz_set_ui(x, 0);
+    mpz_setbit(x, mpz_size(n) * GMP_NUMB_BITS);
+    mpz_sub_ui(x, x, draw(g, 3));
+    break;
+  case 4:
+  case 5:
+    limb_pattern(x, bits, g);
+    break;
+  default:
+    rsa_drbg_urandomb(x, g, bits);
+  }
+  mpz_mod(x, x, n);
+}
+
+// Exponents are short most of the time, the full size now and then
+static void gen_exponent(mpz_t e, int bits, RSA_DRBG *g) {
+  switch (draw(g, 8)) {
+  case 0: mpz_set_ui(e, draw(g, 4)); break;
+  case 1: mpz_set_ui(e, 0x10001); break;
+  case 2: limb_pattern(e, 1 + (int)draw(g, bits), g); break;
+  case 3: rsa_drbg_urandomb(e, g, bits); break;
+  default: rsa_drbg_urandomb(e, g, 1 + draw(g, 256));
+  }
+}
+
+// Sizes cluster at limb boundaries, where the carries live
+static int gen_bits(RSA_DRBG *g) {
+  int bits;
+  if (draw(g, 2)) {
+    bits = GMP_NUMB_BITS * (1 + (int)draw(g, max_bits / GMP_NUMB_BITS)) + (int)draw(g, 3) - 1;
+  } else {
+    bits = 2 + (int)draw(g, max_bits - 1);
+  }
+  return bits < 2 ? 2 : bits > max_bits ? max_bits : bits;
+}
+
+static void report(int op, long tid, const char *what, const mpz_t n, const mpz_t a,
+                   const mpz_t b, const mpz_t got, const mpz_t want) {
+  if (atomic_fetch_add(&reports, 1) >= MAX_REPORTS) return;
+  pthread_mutex_lock(&print_lock);
+  gmp_fprintf(stderr, "MISMATCH %s (thread %ld) %s\n  n    = %Zx\n  a    = %Zx\n"
+              "  b    = %Zx\n  got  = %Zx\n  want = %Zx\n", OP_NAME[op], tid, what,
+              n, a, b, got, want);
+  pthread_mutex_unlock(&print_lock);
+}
+
+// Throwaway CRT key with n of about `bits` bits
+static void gen_crt_key(RSA_PRIKEY *pri, int bits, RSA_DRBG *g) {
+  mpz_t t;
+  mpz_init(t);
+  do {
+    rsa_drbg_urandomb(pri->p, g, bits / 2);
+    mpz_setbit(pri->p, bits / 2 - 1);
+    mpz_nextprime(pri->p, pri->p);
+    rsa_drbg_urandomb(pri->q, g, bits - bits / 2);
+    mpz_setbit(pri->q, bits - bits / 2 - 1);
+    mpz_nextprime(pri->q, pri->q);
+    mpz_set_ui(pri->e, draw(g, 2) ? 0x10001 : 3);
+    mpz_sub_ui(pri->p, pri->p, 1);
+    mpz_sub_ui(pri->q, pri->q, 1);
+    mpz_mul(t, pri->p, pri->q);
+    mpz_add_ui(pri->p, pri->p, 1);
+    mpz_add_ui(pri->q, pri->q, 1);
+  } while (mpz_cmp(pri->p, pri->q) == 0 || !mpz_invert(pri->d, pri->e, t));
+  mpz_mul(pri->n, pri->p, pri->q);
+  pri->RSA_SIZE = (int)mpz_sizeinbase(pri->n, 2);
+#ifndef NO_RSA_CRT
+  mpz_sub_ui(t, pri->p, 1);
+  mpz_mod(pri->dp, pri->d, t);
+  mpz_sub_ui(t, pri->q, 1);
+  mpz_mod(pri->dq, pri->d, t);
+  mpz_invert(pri->qi, pri->q, pri->p);
+#endif
+  mpz_clear(t);
+}
+
+typedef struct __WORKER {
+  long id;
+  pthread_t th;
+} WORKER;
+
+#define TIMED(acc, call) do { const uint64_t t_ = now_ns(); call; acc += now_ns() - t_; } while (0)
+
+static void *worker(void *arg) {
+  const long tid = ((WORKER*)arg)->id;
+  int op_of[256], k = 0;
+  RSA_DRBG g;
+  RSA_ARENA ar;
+  RSA_PUBKEY keys[BATCH];
+  RSA_PRIKEY pri;
+  RSA_CRT_POOL *pool = rsa_crt_pool_new(0); // this thread's, parked between ops
+  mpz_t n, a, b, got, want, x[BATCH], y[BATCH];
+  mpz_ptr yp[BATCH];
+  mpz_srcptr xp[BATCH];
+  const RSA_PUBKEY *kp[BATCH];
+
+  for (int op = 0; op < OP_MAX; ++op) {
+    for (int i = 0; i < OP_WEIGHT[op]; ++i) op_of[k++] = op;
+  }
+  rsa_drbg_init(&g, seed, (uint64_t)tid);
+  rsa_arena_init(&ar);
+  rsa_key_init(NULL, &pri);
+  mpz_inits(n, a, b, got, want, NULL);
+  for (int i = 0; i < BATCH; ++i) {
+    rsa_key_init(&keys[i], NULL);
+    mpz_inits(x[i], y[i], NULL);
+    xp[i] = x[i];
+    yp[i] = y[i];
+    kp[i] = &keys[i];
+  }
+
+  for (uint64_t it = 0; !atomic_load_explicit(&stop, memory_order_relaxed); ++it) {
+    const int op = op_of[draw(&g, k)];
+    const int bits = gen_bits(&g);
+    uint64_t ns = 0, ref_ns = 0;
+    int bad = 0;
+
+    gen_modulus(n, bits, &g);
+    gen_operand(a, n, &g);
+    gen_operand(b, n, &g);
+
+    switch (op) {
+    case OP_ADD_MOD:
+    case OP_MUL_MOD:
+      if (op == OP_ADD_MOD) {
+        TIMED(ns, rsa_add_mod(got, a, b, n));
+        TIMED(ref_ns, (mpz_add(want, a, b), mpz_mod(want, want, n)));
+      } else {
+        TIMED(ns, rsa_mul_mod(got, a, b, n));
+        TIMED(ref_ns, (mpz_mul(want, a, b), mpz_mod(want, want, n)));
+      }
+      bad = mpz_cmp(got, want) != 0;
+      break;
+
+    case OP_BAR_ADD:
+    case OP_BAR_SUB:
+    case OP_BAR_MUL:
+    case OP_BAR_REDUCE: {
+      RSA_BARRETT br;
+      if (draw(&g, 4) == 0) mpz_clrbit(n, 0); // Barrett takes even moduli too
+      mpz_mod(a, a, n);
+      mpz_mod(b, b, n);
+      rsa_barrett_init(&br, n);
+      if (op == OP_BAR_ADD) {
+        TIMED(ns, rsa_barrett_add_mod(got, a, b, &br));
+        TIMED(ref_ns, (mpz_add(want, a, b), mpz_mod(want, want, n)));
+      } else if (op == OP_BAR_SUB) {
+        TIMED(ns, rsa_barrett_sub_mod(got, a, b, &br));
+        TIMED(ref_ns, (mpz_sub(want, a, b), mpz_mod(want, want, n)));
+      } else if (op == OP_BAR_MUL) {
+        TIMED(ns, rsa_barrett_mul_mod(got, a, b, &br));
+        TIMED(ref_ns, (mpz_mul(want, a, b), mpz_mod(want, want, n)));
+      } else {
+        mpz_mul(b, a, b); // 0 <= x < n ^ 2
+        TIMED(ns, rsa_barrett_reduce(got, b, &br));
+        TIMED(ref_ns, mpz_mod(want, b, n));
+      }
+      bad = mpz_cmp(got, want) != 0;
+      rsa_barrett_clear(&br);
+      break;
+    }
+
+    case OP_MONT_MUL:
+    case OP_MONT_SQR:
+    case OP_MONT_POWM:
+    case OP_PLAN_POWM:
+    case OP_MULTI_POWM: {
+      mp_limb_t am[RSA_MAX_LIMBS], bm[RSA_MAX_LIMBS];
+      RSA_MONT m;
+      if (draw(&g, 2)) rsa_mont_init_lazy(&m, n); // redundant form, R > 4n
+      else rsa_mont_init(&m, n);
+      if (op == OP_MONT_MUL || op == OP_MONT_SQR) {
+        rsa_mont_to(am, a, &m);
+        rsa_mont_to(bm, b, &m);
+        if (op == OP_MONT_MUL) TIMED(ns, rsa_mont_mul(am, am, bm, &m));
+        else TIMED(ns, rsa_mont_sqr(am, am, &m));
+        rsa_mont_from(got, am, &m);
+        TIMED(ref_ns, (mpz_mul(want, a, op == OP_MONT_MUL ? b : a), mpz_mod(want, want, n)));
+      } else if (op == OP_MONT_POWM) {
+        gen_exponent(b, bits, &g);
+        TIMED(ns, rsa_mont_powm(got, a, b, &m));
+        TIMED(ref_ns, mpz_powm(want, a, b, n));
+      } else if (op == OP_PLAN_POWM) {
+        RSA_EXP_PLAN pl;
+        gen_exponent(b, bits, &g);
+        if (mpz_sgn(b) == 0) mpz_set_ui(b, 1); // a plan needs e > 0
+        rsa_plan_init(&pl, b);
+        TIMED(ns, rsa_mont_powm_plan(got, a, &pl, &m));
+        TIMED(ref_ns, mpz_powm(want, a, b, n));
+        rsa_plan_clear(&pl);
+      } else {
+        const int cnt = 1 + (int)draw(&g, BATCH);
+        mpz_srcptr ep[BATCH];
+        for (int i = 0; i < cnt; ++i) {
+          gen_operand(x[i], n, &g);
+          gen_exponent(y[i], bits, &g);
+          ep[i] = y[i];
+        }
+        TIMED(ns, rsa_mont_multi_powm(got, xp, ep, cnt, &m));
+        {
+          const uint64_t t0 = now_ns();
+          mpz_set_ui(want, 1);
+          for (int i = 0; i < cnt; ++i) {
+            mpz_powm(b, x[i], y[i], n);
+            mpz_mul(want, want, b);
+            mpz_mod(want, want, n);
+          }
+          ref_ns += now_ns() - t0;
+        }
+        mpz_set_ui(a, cnt);
+        mpz_set_ui(b, 0);
+      }
+      bad = mpz_cmp(got, want) != 0;
+      rsa_mont_clear(&m);
+      break;
+    }
+
+    case OP_INVERT: {
+      int r1, r2;
+      if (draw(&g, 8) == 0) mpz_clrbit(n, 0); // falls back to mpz_invert
+      TIMED(ns, r1 = rsa_invert(got, a, n));
+      TIMED(ref_ns, r2 = mpz_invert(want, a, n));
+      bad = (r1 == 0) != (r2 != 0) || (r1 == 0 && mpz_cmp(got, want) != 0);
+      break;
+    }
+
+    case OP_INV_BATCH: {
+      const int cnt = 1 + (int)draw(&g, BATCH);
+      int r, all = 1;
+      RSA_MONT m;
+      if (draw(&g, 2)) rsa_mont_init_lazy(&m, n);
+      else rsa_mont_init(&m, n);
+      for (int i = 0; i < cnt; ++i) gen_operand(x[i], n, &g);
+      TIMED(ns, r = rsa_inv_batch(yp, xp, cnt, &m, &ar));
+      {
+        const uint64_t t0 = now_ns();
+        for (int i = 0; i < cnt; ++i) {
+          const int ok = mpz_invert(want, x[i], n);
+          all = all && ok;
+          if (ok && r == 0 && mpz_cmp(want, y[i]) != 0) bad = 1;
+        }
+        ref_ns += now_ns() - t0;
+      }
+      bad = bad || (r == 0) != all;
+      mpz_set(got, r == 0 ? y[0] : a);
+      mpz_set(want, x[0]);
+      rsa_mont_clear(&m);
+      break;
+    }
+
+    case OP_PUB_EXP:
+      mpz_set(keys[0].n, n);
+      gen_exponent(keys[0].e, bits, &g);
+      keys[0].RSA_SIZE = bits;
+      if (draw(&g, 2)) rsa_key_plan(&keys[0]);
+      TIMED(ns, rsa_pub_exp(got, a, &keys[0]));
+      TIMED(ref_ns, mpz_powm(want, a, keys[0].e, n));
+      bad = mpz_cmp(got, want) != 0;
+      rsa_key_clear(&keys[0], NULL); // drops the plan
+      rsa_key_init(&keys[0], NULL);
+      break;
+
+    case OP_BATCH: {
+      const int cnt = 1 + (int)draw(&g, BATCH);
+      for (int i = 0; i < cnt; ++i) {
+        const int kb = gen_bits(&g);
+        gen_modulus(keys[i].n, kb, &g);
+        gen_exponent(keys[i].e, kb, &g);
+        keys[i].RSA_SIZE = kb;
+        gen_operand(x[i], keys[i].n, &g);
+      }
+      TIMED(ns, rsa_pub_exp_batch(yp, xp, kp, cnt));
+      for (int i = 0; i < cnt && !bad; ++i) {
+        TIMED(ref_ns, mpz_powm(want, x[i], keys[i].e, keys[i].n));
+        if (mpz_cmp(want, y[i]) != 0) {
+          bad = 1;
+          mpz_set(n, keys[i].n);
+          mpz_set(a, x[i]);
+          mpz_set(b, keys[i].e);
+          mpz_set(got, y[i]);
+        }
+      }
+      if (!bad) mpz_set(got, want);
+      break;
+    }
+
+    case OP_NTT_POWM: {
+      RSA_NTT c;
+      gen_exponent(b, bits < NTT_EXP_BITS ? bits : NTT_EXP_BITS, &g);
+      rsa_ntt_init(&c, n);
+      TIMED(ns, rsa_ntt_powm(got, a, b, &c));
+      TIMED(ref_ns, mpz_powm(want, a, b, n));
+      rsa_ntt_clear(&c);
+      bad = mpz_cmp(got, want) != 0;
+      break;
+    }
+
+    case OP_CRT:
+    case OP_HOT:
+    case OP_PAR:
+      // A fresh key now and then, primes are the slow part
+      if (mpz_sgn(pri.n) == 0 || draw(&g, 16) == 0) {
+        const int kb = max_bits < KEY_MAX_BITS ? max_bits : KEY_MAX_BITS;
+        gen_crt_key(&pri, 64 + (int)draw(&g, kb - 63), &g);
+      }
+      mpz_set(n, pri.n);
+      gen_operand(a, n, &g);
+      if (op == OP_CRT) {
+        TIMED(ns, rsa_pri_exp(got, a, &pri));
+      } else if (op == OP_PAR) {
+        TIMED(ns, rsa_pri_exp_par(got, a, &pri, pool));
+      } else {
+        RSA_HOTKEY hk;
+        rsa_hotkey_init(&hk, &pri);
+        TIMED(ns, rsa_pri_exp_hot(got, a, &hk));
+        rsa_hotkey_clear(&hk);
+      }
+      TIMED(ref_ns, mpz_powm(want, a, pri.d, n));
+      mpz_set(b, pri.d);
+      bad = mpz_cmp(got, want) != 0;
+      break;
+    }
+
+    if (bad) {
+      char what[32];
+      snprintf(what, sizeof(what), "iteration %llu", (unsigned long long)it);
+      report(op, tid, what, n, a, b, got, want);
+    }
+    atomic_fetch_add_explicit(&op_stat[op].ops, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&op_stat[op].bad, bad, memory_order_relaxed);
+    atomic_fetch_add_explicit(&op_stat[op].ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&op_stat[op].ref_ns, ref_ns, memory_order_relaxed);
+  }
+
+  for (int i = 0; i < BATCH; ++i) {
+    rsa_key_clear(&keys[i], NULL);
+    mpz_clears(x[i], y[i], NULL);
+  }
+  mpz_clears(n, a, b, got, want, NULL);
+  rsa_key_clear(NULL, &pri);
+  if (pool) rsa_crt_pool_free(pool);
+  rsa_arena_clear(&ar);
+  rsa_drbg_clear(&g);
+  return NULL;
+}
+
+static void print_table(FILE *fp, double elapsed) {
+  uint64_t total = 0, bad = 0;
+  fprintf(fp, "%-16s %12s %10s %8s %12s %12s\n", "", "ops", "ops/s", "bad",
+          "custom us", "gmp us");
+  for (int op = 0; op < OP_MAX; ++op) {
+    const uint64_t o = atomic_load(&op_stat[op].ops), b = atomic_load(&op_stat[op].bad);
+    const double ns = (double)atomic_load(&op_stat[op].ns);
+    const double ref = (double)atomic_load(&op_stat[op].ref_ns);
+    fprintf(fp, "%-16s %12llu %10.0f %8llu %12.2f %12.2f\n", OP_NAME[op],
+            (unsigned long long)o, o / elapsed, (unsigned long long)b,
+            o ? ns / o / 1e3 : 0.0, o ? ref / o / 1e3 : 0.0);
+    total += o;
+    bad += b;
+  }
+  fprintf(fp, "%-16s %12llu %10.0f %8llu  (%.0f s, kernel %s)\n", "total",
+          (unsigned long long)total, total / elapsed, (unsigned long long)bad,
+          elapsed, rsa_simd_name(rsa_simd_level()));
+}
+
+static void usage(void) {
+  puts("Usage: fuzz [-t threads] [-d seconds] [-b max bits] [-r report every seconds]"
+       " [-s seed (hex)]");
+  exit(0);
+}
+
+int main(int argc, char *argv[]) {
+  int threads = (int)sysconf(_SC_NPROCESSORS_ONLN), every = 10, opt;
+  double duration = 10, start, last;
+  unsigned long long s = 0;
+  WORKER *w;
+  uint64_t bad = 0;
+
+  while ((opt = getopt(argc, argv, "t:d:b:r:s:h")) != -1) {
+    switch (opt) {
+    case 't': threads  = atoi(optarg); break;
+    case 'd': duration = atof(optarg); break;
+    case 'b': max_bits = atoi(optarg); break;
+    case 'r': every    = atoi(optarg); break;
+    case 's': s        = strtoull(optarg, NULL, 16); break;
+    default: usage();
+    }
+  }
+  if (threads <= 0 || duration <= 0 || every <= 0 || max_bits < 64 || max_bits > MAX_RSA_SIZE) {
+    usage();
+  }
+  if (s == 0) {
+    RSA_DRBG g;
+    if (rsa_drbg_init_os(&g) != 0) {
+      fputs("No OS entropy source\n", stderr);
+      return 1;
+    }
+    rsa_drbg_bytes(&g, &s, sizeof(s));
+    rsa_drbg_clear(&g);
+  }
+  for (int i = 0; i < 8; ++i) seed[i] = (uint8_t)(s >> (8 * i));
+  printf("fuzz: %d thread(s), %.0f s, up to %d bits, seed %llx\n", threads, duration,
+         max_bits, s);
+
+  w = calloc(threads, sizeof(WORKER));
+  start = last = now_ns() / 1e9;
+  for (int i = 0; i < threads; ++i) {
+    w[i].id = i;
+    pthread_create(&w[i].th, NULL, worker, &w[i]);
+  }
+  for (;;) {
+    const double t = now_ns() / 1e9;
+    if (t - start >= duration) break;
+    if (t - last >= every) {
+      print_table(stdout, t - start);
+      fflush(stdout);
+      last = t;
+    }
+    usleep(100000);
+  }
+  atomic_store(&stop, 1);
+  for (int i = 0; i < threads; ++i) pthread_join(w[i].th, NULL);
+  free(w);
+
+  print_table(stdout, now_ns() / 1e9 - start);
+  for (int op = 0; op < OP_MAX; ++op) bad += atomic_load(&op_stat[op].bad);
+  return bad != 0;
+}
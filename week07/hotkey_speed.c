@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// rsa_pri_exp on RSA_PRIKEY vs rsa_pri_exp_hot on RSA_HOTKEY, with one
+// key (everything stays in cache) and with KEY_COUNT keys used round robin
+// (every operation starts on a key that was evicted long ago). The keys
+// are all pairs out of PRIME_COUNT primes, so building thousands of them
+// takes a second. L1D / LLC misses come from the rsa_perf counters when the
+// kernel and the machine provide them.
+//
+//   hotkey_speed [keys]
+
+#define KEY_SIZE 2048
+#define PRIME_COUNT 80
+#define KEY_COUNT 2048
+#define REPEAT_SIZE 4096
+
+enum { EV_L1D, EV_LLC, EV_COUNT };
+
+static RSA_PERF before, after;
+
+// Timed loops run as one rsa_perf phase, so the counters are the ones
+// rsa_perf.c opens for the thread
+static void counters_start(void) {
+  rsa_perf_snapshot(&before);
+  rsa_perf_begin(RSA_PHASE_EXP, KEY_SIZE);
+}
+
+// Misses per operation, -1 if the counter is not there. Library phases
+// nested inside (WITH_RSA_PERF) take their share, so add up all of them.
+static void counters_stop(double *per_op, int ops) {
+  static const int ev[EV_COUNT] = { RSA_EV_L1D_MISSES, RSA_EV_LLC_MISSES };
+  rsa_perf_end();
+  rsa_perf_snapshot(&after);
+  for (int i = 0; i < EV_COUNT; ++i) {
+    int64_t v = 0;
+    per_op[i] = -1;
+    if (after.ev[0][0][ev[i]] < 0) continue;
+    for (int p = 0; p < RSA_PHASE_MAX; ++p) {
+      for (int s = 0; s < RSA_STAT_SIZES; ++s) v += after.ev[p][s][ev[i]] - before.ev[p][s][ev[i]];
+    }
+    per_op[i] = (double)v / ops;
+  }
+}
+
+static void print_row(const char *name, int keys, double t, const double *miss) {
+  char l1[16] = "n/a", llc[16] = "n/a";
+  if (miss[EV_L1D] >= 0) snprintf(l1, sizeof(l1), "%.0f", miss[EV_L1D]);
+  if (miss[EV_LLC] >= 0) snprintf(llc, sizeof(llc), "%.0f", miss[EV_LLC]);
+  printf("[%-15s %4d key(s)]: %f s, %6.0f op/s, L1D miss/op %8s, LLC miss/op %8s\n",
+         name, keys, t, REPEAT_SIZE / t, l1, llc);
+}
+
+// Heap bytes behind an RSA_PRIKEY, limbs only
+static size_t prikey_bytes(const RSA_PRIKEY *k) {
+  size_t b = (k->p->_mp_alloc + k->q->_mp_alloc + k->d->_mp_alloc + k->n->_mp_alloc
+              + k->e->_mp_alloc) * sizeof(mp_limb_t);
+#ifndef NO_RSA_CRT
+  b += (k->dp->_mp_alloc + k->dq->_mp_alloc + k->qi->_mp_alloc) * sizeof(mp_limb_t);
+#endif
+  return b;
+}
+
+int main(int argc, char *argv[]) {
+  const int keys = argc > 1 ? atoi(argv[1]) : KEY_COUNT;
+  gmp_randstate_t rnd;
+  mpz_t prime[PRIME_COUNT], x, y, t;
+  RSA_PRIKEY *pri;
+  RSA_HOTKEY *hot;
+  double miss[EV_COUNT];
+  clock_t start;
+  int k = 0;
+
+  if (keys <= 0 || keys > PRIME_COUNT * (PRIME_COUNT - 1) / 2) {
+    printf("Usage: hotkey_speed [keys <= %d]\n", PRIME_COUNT * (PRIME_COUNT - 1) / 2);
+    return 0;
+  }
+  gmp_randinit_default(rnd);
+  mpz_inits(x, y, t, NULL);
+  pri = calloc(keys, sizeof(RSA_PRIKEY));
+  hot = calloc(keys, sizeof(RSA_HOTKEY));
+
+  // Primes with gcd(p - 1, e) = 1, the top two bits set so pq has KEY_SIZE bits
+  for (int i = 0; i < PRIME_COUNT; ++i) {
+    mpz_init(prime[i]);
+    do {
+      mpz_urandomb(prime[i], rnd, KEY_SIZE / 2);
+      mpz_setbit(prime[i], KEY_SIZE / 2 - 1);
+      mpz_setbit(prime[i], KEY_SIZE / 2 - 2);
+      mpz_nextprime(prime[i], prime[i]);
+    } while (mpz_fdiv_ui(prime[i], 0x10001) == 1);
+  }
+  for (int i = 0; i < PRIME_COUNT && k < keys; ++i) {
+    for (int j = i + 1; j < PRIME_COUNT && k < keys; ++j, ++k) {
+      RSA_PRIKEY *p = &pri[k];
+      rsa_key_init(NULL, p);
+      mpz_set(p->p, prime[i]);
+      mpz_set(p->q, prime[j]);
+      mpz_set_ui(p->e, 0x10001);
+      mpz_mul(p->n, p->p, p->q);
+      mpz_sub_ui(x, p->p, 1);
+      mpz_sub_ui(y, p->q, 1);
+      mpz_mul(t, x, y);
+      mpz_invert(p->d, p->e, t);
+#ifndef NO_RSA_CRT
+      mpz_mod(p->dp, p->d, x);
+      mpz_mod(p->dq, p->d, y);
+      mpz_invert(p->qi, p->q, p->p);
+#endif
+      p->RSA_SIZE = KEY_SIZE;
+      rsa_hotkey_init(&hot[k], p);
+    }
+  }
+  printf("%d keys of %d bits, RSA_PRIKEY limbs %zu bytes in %d blocks, RSA_HOTKEY %zu bytes"
+         " in 1 block\n", keys, KEY_SIZE, prikey_bytes(&pri[0]),
+#ifndef NO_RSA_CRT
+         8,
+#else
+         5,
+#endif
+         hot[0].bytes);
+
+  mpz_urandomb(x, rnd, KEY_SIZE - 2);
+
+  // (1) One key, (2) every key in turn, 7 apart so neighbours are not reused
+  for (int rot = 0; rot < 2; ++rot) {
+    const int n = rot ? keys : 1;
+    start = clock();
+    counters_start();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_pri_exp(y, x, &pri[(i * 7) % n]);
+    counters_stop(miss, REPEAT_SIZE);
+    print_row("rsa_pri_exp", n, (double)(clock() - start) / CLOCKS_PER_SEC, miss);
+    start = clock();
+    counters_start();
+    for (int i = 0; i < REPEAT_SIZE; ++i) rsa_pri_exp_hot(t, x, &hot[(i * 7) % n]);
+    counters_stop(miss, REPEAT_SIZE);
+    print_row("rsa_pri_exp_hot", n, (double)(clock() - start) / CLOCKS_PER_SEC, miss);
+    if (mpz_cmp(y, t) != 0) puts("MISMATCH");
+  }
+
+  for (int i = 0; i < keys; ++i) {
+    rsa_key_clear(NULL, &pri[i]);
+    rsa_hotkey_clear(&hot[i]);
+  }
+  for (int i = 0; i < PRIME_COUNT; ++i) mpz_clear(prime[i]);
+  free(pri);
+  free(hot);
+  mpz_clears(x, y, t, NULL);
+  gmp_randclear(rnd);
+  return 0;
+}
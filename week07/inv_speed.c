@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// Single inversions (mpz_invert vs the binary GCD on limbs) and batches
+// under one modulus (count x mpz_invert vs rsa_inv_batch)
+
+#define REPEAT_SIZE 20000
+#define BATCH 256
+#define BATCH_REPEAT 50
+
+static double seconds(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+  const int sizes[] = {512, 1024, 2048, 4096};
+  gmp_randstate_t rnd;
+  mpz_t n, x[BATCH], y[BATCH];
+  mpz_ptr yp[BATCH];
+  mpz_srcptr xp[BATCH];
+  RSA_ARENA ar;
+  RSA_MONT m;
+  clock_t start;
+
+  gmp_randinit_default(rnd);
+  rsa_arena_init(&ar);
+  mpz_init(n);
+  for (int i = 0; i < BATCH; ++i) {
+    mpz_inits(x[i], y[i], NULL);
+    xp[i] = x[i];
+    yp[i] = y[i];
+  }
+
+  for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+    double t0, t1;
+    int bad = 0;
+    // Odd modulus with no small factors, like p or n
+    mpz_urandomb(n, rnd, sizes[k]);
+    mpz_setbit(n, sizes[k] - 1);
+    mpz_nextprime(n, n);
+    rsa_mont_init(&m, n);
+    for (int i = 0; i < BATCH; ++i) mpz_urandomm(x[i], rnd, n);
+
+    // (1) One at a time
+    start = clock();
+    for (int r = 0; r < REPEAT_SIZE; ++r) mpz_invert(y[r % BATCH], x[r % BATCH], n);
+    t0 = seconds(start);
+    start = clock();
+    for (int r = 0; r < REPEAT_SIZE; ++r) rsa_invert(y[r % BATCH], x[r % BATCH], n);
+    t1 = seconds(start);
+    printf("[%4d bits single]: mpz_invert %f s | rsa_invert %f s, x%.2f\n",
+           sizes[k], t0, t1, t0 / t1);
+
+    // (2) BATCH at once
+    start = clock();
+    for (int r = 0; r < BATCH_REPEAT; ++r) {
+      for (int i = 0; i < BATCH; ++i) mpz_invert(y[i], x[i], n);
+    }
+    t0 = seconds(start);
+    start = clock();
+    for (int r = 0; r < BATCH_REPEAT; ++r) rsa_inv_batch(yp, xp, BATCH, &m, &ar);
+    t1 = seconds(start);
+    for (int i = 0; i < BATCH; ++i) {
+      mpz_mul(y[i], y[i], x[i]);
+      mpz_mod(y[i], y[i], n);
+      bad += mpz_cmp_ui(y[i], 1) != 0;
+    }
+    printf("[%4d bits batch ]: mpz_invert x%d %f s | rsa_inv_batch %f s, x%.2f%s\n",
+           sizes[k], BATCH, t0, t1, t0 / t1, bad ? " MISMATCH" : "");
+    rsa_mont_clear(&m);
+  }
+
+  for (int i = 0; i < BATCH; ++i) mpz_clears(x[i], y[i], NULL);
+  mpz_clear(n);
+  rsa_arena_clear(&ar);
+  gmp_randclear(rnd);
+  return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// Strict vs lazy (redundant form) Montgomery contexts
+// Two moduli per size: one with a full top limb, where the lazy context
+// needs one more limb for R > 4n, and one two bits shorter, where both
+// contexts have the same size and lazy only drops the final compare and
+// subtraction of every REDC.
+//
+// The two contexts take turns, ROUNDS times, and the best round counts.
+//
+//   lazy_speed [bits ...]
+
+#define ROUNDS 7
+#define SQR_REPEAT 20000
+#define POWM_REPEAT 40
+
+static double seconds(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void measure(const mpz_t n, gmp_randstate_t rnd) {
+  mp_limb_t am[RSA_MAX_LIMBS];
+  RSA_MONT m[2];
+  mpz_t x, e, y[2];
+  double sqr_us[2], powm_us[2];
+  clock_t start;
+
+  mpz_inits(x, e, y[0], y[1], NULL);
+  mpz_urandomm(x, rnd, n);
+  mpz_urandomb(e, rnd, mpz_sizeinbase(n, 2));
+  if (rsa_mont_init(&m[0], n) != 0 || rsa_mont_init_lazy(&m[1], n) != 0) {
+    puts("rsa_mont_init failed");
+    return;
+  }
+  for (int k = 0; k < 2; ++k) sqr_us[k] = powm_us[k] = 1e30;
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (int k = 0; k < 2; ++k) {
+      double t;
+      rsa_mont_to(am, x, &m[k]);
+      start = clock();
+      for (int i = 0; i < SQR_REPEAT; ++i) rsa_mont_sqr(am, am, &m[k]);
+      t = seconds(start) / SQR_REPEAT * 1e6;
+      if (t < sqr_us[k]) sqr_us[k] = t;
+      start = clock();
+      for (int i = 0; i < POWM_REPEAT; ++i) rsa_mont_powm(y[k], x, e, &m[k]);
+      t = seconds(start) / POWM_REPEAT * 1e6;
+      if (t < powm_us[k]) powm_us[k] = t;
+    }
+  }
+  printf("[%4d bits, %2d / %2d limbs]: sqr %6.3f / %6.3f us, powm %9.1f / %9.1f us (%+.1f%%)%s\n",
+         m[0].bits, (int)m[0].size, (int)m[1].size, sqr_us[0], sqr_us[1],
+         powm_us[0], powm_us[1], (powm_us[0] / powm_us[1] - 1) * 100,
+         mpz_cmp(y[0], y[1]) ? " MISMATCH" : "");
+  rsa_mont_clear(&m[0]);
+  rsa_mont_clear(&m[1]);
+  mpz_clears(x, e, y[0], y[1], NULL);
+}
+
+int main(int argc, char *argv[]) {
+  static const int sizes[] = {1024, 2048, 3072, 4096};
+  const int nsizes = argc > 1 ? argc - 1 : 4;
+  gmp_randstate_t rnd;
+  mpz_t n;
+
+  gmp_randinit_default(rnd);
+  mpz_init(n);
+  puts("strict / lazy, +x% = lazy is faster");
+  for (int i = 0; i < nsizes; ++i) {
+    const int bits = argc > 1 ? atoi(argv[i + 1]) : sizes[i];
+    if (bits < 64 || bits % GMP_NUMB_BITS || bits > MAX_RSA_SIZE) {
+      printf("skip %d bits\n", bits);
+      continue;
+    }
+    for (int spare = 0; spare <= 2; spare += 2) {
+      mpz_urandomb(n, rnd, bits - spare);
+      mpz_setbit(n, bits - spare - 1);
+      mpz_setbit(n, 0);
+      measure(n, rnd);
+    }
+  }
+  mpz_clear(n);
+  gmp_randclear(rnd);
+  return 0;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// Inversion part of key generation, from fixed primes
+//   old       : p and q shifted in place, d mod phi, dp, dq and qi each with
+//               mpz_invert (rsa_key_from_primes before rsa_key_gen_lean)
+//   full      : rsa_key_from_primes less its rsa_key_plan, word-sized
+//               inverses for dp, dq and d (d mod phi)
+//   lean      : rsa_key_from_primes_lean less its rsa_key_plan, dp, dq and
+//               qi (what rsa_key_gen_lean computes)
+//   derive d  : rsa_key_derive(RSA_KEY_D), what a lean key pays on first use
+// and the limb bytes a full and a lean key hold.
+//
+//   lean_speed [bits ...]
+
+#define REPEAT_SIZE 2000
+
+static double usec(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC / REPEAT_SIZE * 1e6;
+}
+
+static void old_finish(RSA_PRIKEY *pri) {
+  mpz_t tmp;
+  mpz_init(tmp);
+  mpz_sub_ui(pri->p, pri->p, 1);
+  mpz_sub_ui(pri->q, pri->q, 1);
+  mpz_mul(tmp, pri->p, pri->q);
+  mpz_invert(pri->d, pri->e, tmp);
+#ifndef NO_RSA_CRT
+  mpz_invert(pri->dp, pri->e, pri->p);
+  mpz_invert(pri->dq, pri->e, pri->q);
+#endif
+  mpz_add_ui(pri->p, pri->p, 1);
+  mpz_add_ui(pri->q, pri->q, 1);
+#ifndef NO_RSA_CRT
+  mpz_invert(pri->qi, pri->q, pri->p);
+#endif
+  mpz_clear(tmp);
+}
+
+static size_t prikey_bytes(const RSA_PRIKEY *k) {
+  size_t b = mpz_size(k->p) + mpz_size(k->q) + mpz_size(k->d) + mpz_size(k->n) + mpz_size(k->e);
+#ifndef NO_RSA_CRT
+  b += mpz_size(k->dp) + mpz_size(k->dq) + mpz_size(k->qi);
+#endif
+  return b * sizeof(mp_limb_t);
+}
+
+static void make_prime(mpz_t p, int bits, gmp_randstate_t rnd) {
+  do {
+    mpz_urandomb(p, rnd, bits);
+    mpz_setbit(p, bits - 1);
+    mpz_setbit(p, bits - 2);
+    mpz_nextprime(p, p);
+  } while (mpz_fdiv_ui(p, 0x10001) == 1);
+}
+
+int main(int argc, char *argv[]) {
+  static const int sizes[] = {2048, 3072, 4096};
+  const int nsizes = argc > 1 ? argc - 1 : 3;
+  gmp_randstate_t rnd;
+  mpz_t p, q;
+
+#ifdef NO_RSA_CRT
+  puts("lean_speed: nothing to leave out without CRT");
+  return 0;
+#endif
+  gmp_randinit_default(rnd);
+  mpz_inits(p, q, NULL);
+  for (int i = 0; i < nsizes; ++i) {
+    const int bits = argc > 1 ? atoi(argv[i + 1]) : sizes[i];
+    RSA_PUBKEY pub;
+    RSA_PRIKEY pri;
+    double t_old, t_full, t_plan, t_lean, t_d;
+    size_t full_bytes, lean_bytes;
+    clock_t start;
+
+    if (bits < 256 || bits % 2 || bits > MAX_RSA_SIZE) {
+      printf("skip %d bits\n", bits);
+      continue;
+    }
+    make_prime(p, bits / 2, rnd);
+    do make_prime(q, bits / 2, rnd); while (mpz_cmp(p, q) == 0);
+    rsa_key_init(&pub, &pri);
+    if (rsa_key_from_primes(&pub, &pri, p, q) != 0) {
+      printf("skip %d bits\n", bits);
+      rsa_key_clear(&pub, &pri);
+      continue;
+    }
+    full_bytes = prikey_bytes(&pri);
+
+    start = clock();
+    for (int k = 0; k < REPEAT_SIZE; ++k) old_finish(&pri);
+    t_old = usec(start);
+    start = clock();
+    for (int k = 0; k < REPEAT_SIZE; ++k) rsa_key_from_primes(&pub, &pri, p, q);
+    t_full = usec(start);
+    start = clock();
+    for (int k = 0; k < REPEAT_SIZE; ++k) rsa_key_plan(&pub);
+    t_plan = usec(start);
+    start = clock();
+    for (int k = 0; k < REPEAT_SIZE; ++k) rsa_key_from_primes_lean(&pub, &pri, p, q);
+    t_lean = usec(start);
+    start = clock();
+    for (int k = 0; k < REPEAT_SIZE; ++k) {
+      pri.missing = RSA_KEY_D;
+      rsa_key_derive(&pri, RSA_KEY_D);
+    }
+    t_d = usec(start);
+    rsa_key_clear(&pub, &pri);
+
+    rsa_key_init(&pub, &pri);
+    rsa_key_from_primes_lean(&pub, &pri, p, q);
+    lean_bytes = prikey_bytes(&pri);
+    rsa_key_clear(&pub, &pri);
+
+    printf("[%5d bits]: old %7.1f us, full %7.1f us, lean %7.1f us, derive d %7.1f us\n",
+           bits, t_old, t_full - t_plan, t_lean - t_plan, t_d);
+    printf("             key %zu bytes full, %zu bytes lean\n", full_bytes, lean_bytes);
+  }
+  mpz_clears(p, q, NULL);
+  gmp_randclear(rnd);
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// b_0 ^ e_0 * ... * b_{k-1} ^ e_{k-1} mod n: k separate exponentiations and
+// k - 1 multiplications vs one rsa_mont_multi_powm
+
+#define KEY_SIZE 2048
+#define MAX_K 4
+#define REPEAT_SIZE 200
+
+RSA_PUBKEY pub;
+RSA_PRIKEY pri;
+
+static double seconds(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+  const int ebits[] = {KEY_SIZE, 256};
+  gmp_randstate_t rnd;
+  mpz_t b[MAX_K], e[MAX_K], y, want, t;
+  mpz_srcptr bp[MAX_K], ep[MAX_K];
+  clock_t start;
+
+  gmp_randinit_default(rnd);
+  rsa_key_init(&pub, &pri);
+  rsa_key_gen(&pub, &pri, KEY_SIZE, rnd);
+  mpz_inits(y, want, t, NULL);
+  for (int i = 0; i < MAX_K; ++i) {
+    mpz_inits(b[i], e[i], NULL);
+    mpz_urandomm(b[i], rnd, pub.n);
+    bp[i] = b[i];
+    ep[i] = e[i];
+  }
+
+  for (int l = 0; l < 2; ++l) {
+    for (int i = 0; i < MAX_K; ++i) mpz_urandomb(e[i], rnd, ebits[l]);
+    for (int k = 1; k <= MAX_K; ++k) {
+      double base, sep, multi;
+
+      start = clock();
+      for (int r = 0; r < REPEAT_SIZE; ++r) {
+        mpz_powm(want, b[0], e[0], pub.n);
+        for (int i = 1; i < k; ++i) {
+          mpz_powm(t, b[i], e[i], pub.n);
+          mpz_mul(want, want, t);
+          mpz_mod(want, want, pub.n);
+        }
+      }
+      base = seconds(start);
+
+      start = clock();
+      for (int r = 0; r < REPEAT_SIZE; ++r) {
+        rsa_mont_powm(y, b[0], e[0], &pub.mont);
+        for (int i = 1; i < k; ++i) {
+          rsa_mont_powm(t, b[i], e[i], &pub.mont);
+          mpz_mul(y, y, t);
+          mpz_mod(y, y, pub.n);
+        }
+      }
+      sep = seconds(start);
+
+      start = clock();
+      for (int r = 0; r < REPEAT_SIZE; ++r) rsa_mont_multi_powm(y, bp, ep, k, &pub.mont);
+      multi = seconds(start);
+
+      printf("[k=%d e %4d bits]: mpz_powm x%d %f s | rsa_mont_powm x%d %f s"
+             " | multi %f s, x%.2f%s\n", k, ebits[l], k, base, k, sep, multi,
+             base / multi, mpz_cmp(y, want) ? " MISMATCH" : "");
+    }
+  }
+
+  for (int i = 0; i < MAX_K; ++i) mpz_clears(b[i], e[i], NULL);
+  mpz_clears(y, want, t, NULL);
+  rsa_key_clear(&pub, &pri);
+  gmp_randclear(rnd);
+  return 0;
+}
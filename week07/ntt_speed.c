@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// mpz_powm against rsa_ntt_powm from 2048 bits up, with an EXP_BITS-bit
+// exponent so both sides do the same few hundred products. The first
+// size where the NTT wins is the value for RSA_NTT_THRESHOLD (in limbs).
+//
+//   ntt_speed [max bits]
+
+#define EXP_BITS 256
+
+int main(int argc, char *argv[]) {
+  const int max_bits = argc > 1 ? atoi(argv[1]) : 65536;
+  gmp_randstate_t rnd;
+  mpz_t n, b, e, x, y;
+  long threshold = 0;
+  clock_t start;
+
+  gmp_randinit_default(rnd);
+  mpz_inits(n, b, e, x, y, NULL);
+  mpz_urandomb(e, rnd, EXP_BITS);
+  mpz_setbit(e, EXP_BITS - 1);
+  for (int bits = 2048; bits <= max_bits; bits *= 2) {
+    const int repeat = (1 << 21) / bits + 1;
+    RSA_NTT c;
+    double t1, t2;
+    mpz_urandomb(n, rnd, bits);
+    mpz_setbit(n, bits - 1);
+    mpz_setbit(n, 0);
+    mpz_urandomm(b, rnd, n);
+    if (rsa_ntt_init(&c, n) != 0) break;
+
+    start = clock();
+    for (int i = 0; i < repeat; ++i) mpz_powm(x, b, e, n);
+    t1 = (double)(clock() - start) / CLOCKS_PER_SEC / repeat;
+    start = clock();
+    for (int i = 0; i < repeat; ++i) rsa_ntt_powm(y, b, e, &c);
+    t2 = (double)(clock() - start) / CLOCKS_PER_SEC / repeat;
+    if (mpz_cmp(x, y) != 0) puts("MISMATCH");
+
+    printf("[%6d bits, %4ld limbs, N = 2^%2d]: mpz_powm %9.3f ms, rsa_ntt_powm %9.3f ms (x%.2f)\n",
+           bits, (long)c.size, c.log, t1 * 1e3, t2 * 1e3, t2 / t1);
+    if (!threshold && t2 < t1) threshold = (long)c.size;
+    rsa_ntt_clear(&c);
+  }
+  if (threshold) printf("RSA_NTT_THRESHOLD %ld\n", threshold);
+  else printf("RSA_NTT_THRESHOLD 0 (no crossover up to %d bits)\n", max_bits);
+
+  mpz_clears(n, b, e, x, y, NULL);
+  gmp_randclear(rnd);
+  return 0;
+}
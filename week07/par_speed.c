@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rsa.h"
+
+// Single-request latency of rsa_pri_exp against rsa_pri_exp_par, one call
+// at a time with an idle gap between calls, as an otherwise quiet signer
+// sees them. The pool runs twice: helpers that park at once (futex wake
+// on every call) and helpers that spin for a while first. Keys are built
+// from nextprime, so sizes above MAX_RSA_SIZE work too.
+//
+//   par_speed [gap us] [bits ...]
+
+#define REPEAT_SIZE 200
+#define SPIN_ROUNDS (1 << 16)
+
+static double wall(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  const double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static void make_key(RSA_PRIKEY *k, int bits, gmp_randstate_t rnd) {
+  mpz_t x, y;
+  mpz_inits(x, y, NULL);
+  for (int i = 0; i < 2; ++i) {
+    mpz_ptr p = i ? k->q : k->p;
+    do {
+      mpz_urandomb(p, rnd, bits / 2);
+      mpz_setbit(p, bits / 2 - 1);
+      mpz_setbit(p, bits / 2 - 2);
+      mpz_nextprime(p, p);
+    } while (mpz_fdiv_ui(p, 0x10001) == 1);
+  }
+  mpz_set_ui(k->e, 0x10001);
+  mpz_mul(k->n, k->p, k->q);
+  mpz_sub_ui(x, k->p, 1);
+  mpz_sub_ui(y, k->q, 1);
+  mpz_mul(k->d, x, y);
+  mpz_invert(k->d, k->e, k->d);
+#ifndef NO_RSA_CRT
+  mpz_mod(k->dp, k->d, x);
+  mpz_mod(k->dq, k->d, y);
+  mpz_invert(k->qi, k->q, k->p);
+#endif
+  k->RSA_SIZE = bits;
+  mpz_clears(x, y, NULL);
+}
+
+// pool == NULL: serial path
+static void measure(const char *name, const RSA_PRIKEY *k, RSA_CRT_POOL *pool, int gap,
+                    gmp_randstate_t rnd) {
+  static double lat[REPEAT_SIZE];
+  double sum = 0;
+  mpz_t x, y, want;
+  mpz_inits(x, y, want, NULL);
+  mpz_urandomm(x, rnd, k->n);
+  rsa_pri_exp(want, x, k);
+  for (int i = 0; i < REPEAT_SIZE; ++i) {
+    const double start = wall();
+    if (pool) rsa_pri_exp_par(y, x, k, pool);
+    else rsa_pri_exp(y, x, k);
+    lat[i] = wall() - start;
+    sum += lat[i];
+    if (gap) usleep(gap);
+  }
+  if (mpz_cmp(y, want) != 0) puts("MISMATCH");
+  qsort(lat, REPEAT_SIZE, sizeof(double), cmp_double);
+  printf("[%-18s %5d]: mean %8.3f ms, p50 %8.3f ms, p99 %8.3f ms\n", name, k->RSA_SIZE,
+         sum / REPEAT_SIZE * 1e3, lat[REPEAT_SIZE / 2] * 1e3, lat[REPEAT_SIZE * 99 / 100] * 1e3);
+  mpz_clears(x, y, want, NULL);
+}
+
+int main(int argc, char *argv[]) {
+  static const int sizes[] = {2048, 4096, 8192};
+  const int gap = argc > 1 ? atoi(argv[1]) : 1000;
+  const int nsizes = argc > 2 ? argc - 2 : 3;
+  gmp_randstate_t rnd;
+  RSA_CRT_POOL *parked, *spinning;
+
+  if (gap < 0) {
+    puts("Usage: par_speed [gap us] [bits ...]");
+    return 0;
+  }
+  gmp_randinit_default(rnd);
+  parked = rsa_crt_pool_new(0);
+  spinning = rsa_crt_pool_new(SPIN_ROUNDS);
+  if (!parked || !spinning) {
+    puts("rsa_crt_pool_new failed");
+    return 1;
+  }
+  printf("%ld online cpu(s), %d us between calls\n", sysconf(_SC_NPROCESSORS_ONLN), gap);
+  for (int i = 0; i < nsizes; ++i) {
+    const int bits = argc > 2 ? atoi(argv[i + 2]) : sizes[i];
+    RSA_PRIKEY k;
+    if (bits < 512 || bits % 128) {
+      printf("skip %d bits\n", bits);
+      continue;
+    }
+    rsa_key_init(NULL, &k);
+    make_key(&k, bits, rnd);
+    measure("rsa_pri_exp", &k, NULL, gap, rnd);
+    measure("par, parked", &k, parked, gap, rnd);
+    measure("par, spinning", &k, spinning, gap, rnd);
+    rsa_key_clear(NULL, &k);
+  }
+  rsa_crt_pool_free(parked);
+  rsa_crt_pool_free(spinning);
+  gmp_randclear(rnd);
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "rsa.h"
+
+// Per-phase IPC and miss table (rsa_perf), build with -DWITH_RSA_PERF
+// Per key size: KEYS calls of rsa_key_gen (sieve, Miller-Rabin,
+// inversion), then OPS private operations on each path, rsa_pri_exp,
+// rsa_pri_exp_hot and rsa_pri_exp_par (the exponentiations of the last
+// run on the pool's helper threads, which count on their own groups).
+// Each block is the difference of two snapshots.
+//
+//   perf_speed [keys] [ops] [bits ...]
+
+static RSA_PERF before, after;
+
+static void perf_sub(RSA_PERF *d, const RSA_PERF *a, const RSA_PERF *b) {
+  for (int p = 0; p < RSA_PHASE_MAX; ++p) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+      d->calls[p][s] = a->calls[p][s] - b->calls[p][s];
+      d->ns[p][s] = a->ns[p][s] - b->ns[p][s];
+      for (int i = 0; i < RSA_EV_MAX; ++i) {
+        d->ev[p][s][i] = a->ev[p][s][i] < 0 ? -1 : a->ev[p][s][i] - b->ev[p][s][i];
+      }
+    }
+  }
+}
+
+static void report(const char *name) {
+  static RSA_PERF d;
+  rsa_perf_snapshot(&after);
+  perf_sub(&d, &after, &before);
+  printf("-- %s\n", name);
+  rsa_perf_print(stdout, &d);
+  before = after;
+}
+
+int main(int argc, char *argv[]) {
+  static const int sizes[] = {2048, 4096};
+  const int keys = argc > 1 ? atoi(argv[1]) : 4;
+  const int ops = argc > 2 ? atoi(argv[2]) : 200;
+  const int nsizes = argc > 3 ? argc - 3 : 2;
+  gmp_randstate_t rnd;
+  RSA_CRT_POOL *pool;
+  mpz_t x, y;
+
+#ifndef WITH_RSA_PERF
+  puts("perf_speed: build with -DWITH_RSA_PERF");
+  return 0;
+#endif
+  if (keys <= 0 || ops <= 0) {
+    puts("Usage: perf_speed [keys] [ops] [bits ...]");
+    return 0;
+  }
+  gmp_randinit_default(rnd);
+  mpz_inits(x, y, NULL);
+  pool = rsa_crt_pool_new(0);
+  rsa_perf_snapshot(&before);
+  for (int i = 0; i < nsizes; ++i) {
+    const int bits = argc > 3 ? atoi(argv[i + 3]) : sizes[i];
+    RSA_PUBKEY pub;
+    RSA_PRIKEY pri;
+    RSA_HOTKEY hk;
+    int ok = 1;
+
+    printf("== %d bits, %d key(s), %d op(s)\n", bits, keys, ops);
+    rsa_key_init(&pub, &pri);
+    for (int k = 0; k < keys && ok; ++k) ok = rsa_key_gen(&pub, &pri, bits, rnd) == 0;
+    if (!ok || rsa_hotkey_init(&hk, &pri) != 0) {
+      printf("skip %d bits\n", bits);
+      rsa_key_clear(&pub, &pri);
+      continue;
+    }
+    report("rsa_key_gen");
+    mpz_urandomm(x, rnd, pri.n);
+    for (int k = 0; k < ops; ++k) rsa_pri_exp(y, x, &pri);
+    report("rsa_pri_exp");
+    for (int k = 0; k < ops; ++k) rsa_pri_exp_hot(y, x, &hk);
+    report("rsa_pri_exp_hot");
+    for (int k = 0; k < ops; ++k) rsa_pri_exp_par(y, x, &pri, pool);
+    report("rsa_pri_exp_par");
+    rsa_hotkey_clear(&hk);
+    rsa_key_clear(&pub, &pri);
+  }
+  rsa_crt_pool_free(pool);
+  mpz_clears(x, y, NULL);
+  gmp_randclear(rnd);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// Dedicated squaring and per-exponent plans vs the generic paths
+
+#define KEY_SIZE 2048
+#define SQR_REPEAT 200000
+#define PUB_REPEAT 20000
+#define PRI_REPEAT 2000
+
+RSA_PUBKEY pub;
+RSA_PRIKEY pri;
+
+#ifndef NO_RSA_CRT
+#define PLAN_EXP pri.dp
+#else
+#define PLAN_EXP pri.d
+#endif
+
+// Square and multiply (week05) and the fixed 4-bit window of rsa_mont_powm
+static void print_counts(const char *name, const mpz_t e, const RSA_EXP_PLAN *pl) {
+  const int bits = (int)mpz_sizeinbase(e, 2);
+  int win = 0;
+  for (int pos = (bits - 1) / 4 * 4 - 4; pos >= 0; pos -= 4) {
+    int d = 0;
+    for (int i = 3; i >= 0; --i) d = d << 1 | mpz_tstbit(e, pos + i);
+    win += d != 0;
+  }
+  printf("[%-3s %4d bits]: binary %4d sqr %4d mul | window 4 %4d sqr %4d mul"
+         " | plan w=%d %4d sqr %4d mul\n", name, bits,
+         bits - 1, (int)mpz_popcount(e) - 1,
+         (bits - 1) / 4 * 4, win + 14, pl->w, pl->sqr, pl->mul);
+}
+
+static double seconds(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+  mp_limb_t am[RSA_MAX_LIMBS], bm[RSA_MAX_LIMBS];
+  gmp_randstate_t rnd;
+  RSA_PUBKEY bare_pub;
+  RSA_MONT mont_p;
+  RSA_EXP_PLAN plan_d[2];
+  mpz_t x, y;
+  clock_t start;
+
+  gmp_randinit_default(rnd);
+  rsa_key_init(&pub, &pri);
+  rsa_key_gen(&pub, &pri, KEY_SIZE, rnd);
+  mpz_inits(x, y, NULL);
+
+  // Same key without its plan, for the old path
+  bare_pub = pub;
+  bare_pub.mont.n = NULL;
+
+  // (1) Multiplication count
+  print_counts("e", pub.e, &pub.plan);
+#ifndef NO_RSA_CRT
+  rsa_plan_init(&plan_d[0], pri.dp);
+  rsa_plan_init(&plan_d[1], pri.dq);
+  print_counts("dp", pri.dp, &plan_d[0]);
+  print_counts("dq", pri.dq, &plan_d[1]);
+#else
+  rsa_plan_init(&plan_d[0], pri.d);
+  rsa_plan_init(&plan_d[1], pri.d);
+  print_counts("d", pri.d, &plan_d[0]);
+#endif
+  rsa_mont_init(&mont_p, pri.p);
+
+  // (2) Montgomery multiply vs square, mod p and mod n
+  for (int k = 0; k < 2; ++k) {
+    const RSA_MONT *m = k == 0 ? &mont_p : &pub.mont;
+    mpz_urandomb(x, rnd, m->bits - 1);
+    rsa_mont_to(am, x, m);
+    rsa_mont_to(bm, x, m);
+    start = clock();
+    for (int i = 0; i < SQR_REPEAT; ++i) rsa_mont_mul(am, am, bm, m);
+    printf("[%4d bits mont_mul]: %f s\n", m->bits, seconds(start));
+    start = clock();
+    for (int i = 0; i < SQR_REPEAT; ++i) rsa_mont_sqr(am, am, m);
+    printf("[%4d bits mont_sqr]: %f s\n", m->bits, seconds(start));
+  }
+
+  // (3) Public exponentiation
+  mpz_urandomm(x, rnd, pub.n);
+  start = clock();
+  for (int i = 0; i < PUB_REPEAT; ++i) rsa_pub_exp(y, x, &bare_pub);
+  printf("[rsa_pub_exp no plan]: %f s\n", seconds(start));
+  start = clock();
+  for (int i = 0; i < PUB_REPEAT; ++i) mpz_powm(y, x, pub.e, pub.n);
+  printf("[mpz_powm           ]: %f s\n", seconds(start));
+  start = clock();
+  for (int i = 0; i < PUB_REPEAT; ++i) rsa_pub_exp(y, x, &pub);
+  printf("[rsa_pub_exp plan   ]: %f s\n", seconds(start));
+
+  // (4) One CRT half, x ^ dp mod p
+  start = clock();
+  for (int i = 0; i < PRI_REPEAT; ++i) mpz_powm(y, x, PLAN_EXP, pri.p);
+  printf("[mpz_powm           ]: %f s\n", seconds(start));
+  start = clock();
+  for (int i = 0; i < PRI_REPEAT; ++i) rsa_mont_powm(y, x, PLAN_EXP, &mont_p);
+  printf("[rsa_mont_powm      ]: %f s\n", seconds(start));
+  start = clock();
+  for (int i = 0; i < PRI_REPEAT; ++i) rsa_mont_powm_plan(y, x, &plan_d[0], &mont_p);
+  printf("[rsa_mont_powm_plan ]: %f s\n", seconds(start));
+
+  rsa_mont_clear(&mont_p);
+  rsa_plan_clear(&plan_d[0]);
+  rsa_plan_clear(&plan_d[1]);
+  mpz_clears(x, y, NULL);
+  rsa_key_clear(&pub, &pri);
+  gmp_randclear(rnd);
+  return 0;
+}
@@ -0,0 +1,471 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "rsa.h"
+#include "primed.h"
+
+// Distributed prime search for key generation
+//
+// The coordinator hands out intervals of odd candidates with a random
+// start, like prime_gen in rsa_key.c draws single candidates. The top two
+// bits of every start are set, so any two primes give an n of exactly the
+// key size and no pair is ever redrawn. A worker sieves its interval by
+// the odd primes below SIEVE_BOUND (and drops p = 1 mod e), tests the
+// survivors in order with Miller-Rabin and replies with the first prime,
+// or with NONE. As soon as p and q are in, every interval still out is
+// cancelled; a worker looks for the CANCEL before each survivor it tests.
+// Whoever finishes gets the next interval at once, so the search for the
+// second prime runs on every worker too.
+//
+// Workers are processes: on other nodes over TCP, or forked on this host
+// with -L and connected over a Unix socket.
+//
+//   primed -l :7000 -w 4 -n 8 -b 2048    # coordinator, waits for 4 workers
+//   primed -c node0:7000                 # worker
+//   primed -L 4 -n 8 -b 2048             # coordinator + 4 local workers
+
+#define DEFAULT_KEYS     4
+#define DEFAULT_KEY_SIZE 2048
+#define DEFAULT_INTERVAL 2048 // odd candidates per job
+#define SIEVE_BOUND      65536
+#define MAX_NODES        256
+
+typedef struct __NODE {
+  int fd;
+  uint32_t job;  // job in progress, 0 = idle
+  int cancelled; // CANCEL sent for it
+  mpz_t start;   // of the job, to check a FOUND against
+} NODE;
+
+static uint32_t small_primes[SIEVE_BOUND / 2];
+static int small_count;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *msg) {
+  perror(msg);
+  exit(1);
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+  uint8_t *p = buf;
+  while (len) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+  const uint8_t *p = buf;
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// One message, x (if not NULL) as the big-endian payload
+static int msg_send(int fd, uint32_t job, int op, int bits, uint32_t count, const mpz_t x) {
+  uint8_t buf[sizeof(PRIMED_HDR) + PRIMED_MAX_BYTES];
+  PRIMED_HDR hdr;
+  size_t len = 0;
+  if (x) mpz_export(buf + sizeof(hdr), &len, 1, 1, 1, 0, x);
+  hdr.job = htonl(job);
+  hdr.op = htons((uint16_t)op);
+  hdr.bits = htons((uint16_t)bits);
+  hdr.count = htonl(count);
+  hdr.len = htonl((uint32_t)len);
+  memcpy(buf, &hdr, sizeof(hdr));
+  return write_full(fd, buf, sizeof(hdr) + len);
+}
+
+// -1 on EOF or a malformed message, x gets the payload (0 if empty)
+static int msg_recv(int fd, PRIMED_HDR *hdr, mpz_t x) {
+  uint8_t buf[PRIMED_MAX_BYTES];
+  if (read_full(fd, hdr, sizeof(*hdr)) != 0) return -1;
+  hdr->job = ntohl(hdr->job);
+  hdr->op = ntohs(hdr->op);
+  hdr->bits = ntohs(hdr->bits);
+  hdr->count = ntohl(hdr->count);
+  hdr->len = ntohl(hdr->len);
+  if (hdr->len > PRIMED_MAX_BYTES || read_full(fd, buf, hdr->len) != 0) return -1;
+  mpz_import(x, hdr->len, 1, 1, 1, 0, buf);
+  return 0;
+}
+
+// "unix:/path", "host:port", ":port" (listen on every address)
+static int sock_open(const char *addr, int listening) {
+  struct addrinfo hints, *res, *ai;
+  char host[256];
+  const char *port;
+  int fd = -1, one = 1;
+
+  if (strncmp(addr, "unix:", 5) == 0) {
+    struct sockaddr_un un;
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, addr + 5, sizeof(un.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (listening) unlink(un.sun_path);
+    if (listening ? bind(fd, (struct sockaddr*)&un, sizeof(un)) < 0 || listen(fd, SOMAXCONN) < 0
+                  : connect(fd, (struct sockaddr*)&un, sizeof(un)) < 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+  port = strrchr(addr, ':');
+  if (!port || (size_t)(port - addr) >= sizeof(host)) return -1;
+  memcpy(host, addr, port - addr);
+  host[port - addr] = '\0';
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+  if (getaddrinfo(host[0] ? host : NULL, port + 1, &hints, &res) != 0) return -1;
+  for (ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) continue;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (listening ? bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0
+                  : connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  // Messages are tiny and each one waits for an answer
+  if (fd >= 0 && !listening) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+// Worker
+
+static void small_init(void) {
+  static uint8_t composite[SIEVE_BOUND];
+  for (uint32_t i = 3; i < SIEVE_BOUND; i += 2) {
+    if (composite[i]) continue;
+    small_primes[small_count++] = i;
+    for (uint32_t j = i * i; j < SIEVE_BOUND; j += 2 * i) composite[j] = 1;
+  }
+}
+
+// Marks every i < count with start + 2i = r mod m, start = s0 mod m, m odd
+static void sieve_mark(uint8_t *dead, uint32_t count, uint32_t m, uint32_t s0, uint32_t r) {
+  // 2i = r - s0 (mod m), 2 ^ -1 = (m + 1) / 2
+  uint64_t i = (uint64_t)((r + m - s0) % m) * ((m + 1) / 2) % m;
+  for (; i < count; i += m) dead[i] = 1;
+}
+
+// 1 if a CANCEL for job is waiting, other messages are stale and dropped
+static int cancel_pending(int fd, uint32_t job, mpz_t tmp) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (poll(&pfd, 1, 0) > 0) {
+    PRIMED_HDR hdr;
+    if (msg_recv(fd, &hdr, tmp) != 0) exit(0); // coordinator gone
+    if (hdr.op == PRIMED_OP_CANCEL && hdr.job == job) return 1;
+  }
+  return 0;
+}
+
+// Reply op, p = the prime for FOUND
+static int run_job(int fd, const PRIMED_HDR *job, const mpz_t start, mpz_t p, uint32_t *tested) {
+  static uint8_t dead[PRIMED_MAX_COUNT];
+  const uint32_t count = job->count;
+
+  *tested = 0;
+  if (count == 0 || count > PRIMED_MAX_COUNT || mpz_even_p(start)) return PRIMED_OP_NONE;
+  memset(dead, 0, count);
+  for (int k = 0; k < small_count; ++k) {
+    const uint32_t m = small_primes[k];
+    sieve_mark(dead, count, m, (uint32_t)mpz_fdiv_ui(start, m), 0);
+  }
+  sieve_mark(dead, count, 0x10001, (uint32_t)mpz_fdiv_ui(start, 0x10001), 1);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (dead[i]) continue;
+    if (cancel_pending(fd, job->job, p)) return PRIMED_OP_CANCELLED;
+    mpz_add_ui(p, start, 2 * (unsigned long)i);
+    if (mpz_sizeinbase(p, 2) != job->bits) break;
+    ++*tested;
+    if (mpz_millerrabin(p, PRIMED_MR_ROUNDS)) return PRIMED_OP_FOUND;
+  }
+  return PRIMED_OP_NONE;
+}
+
+static int worker_main(const char *addr) {
+  PRIMED_HDR hdr;
+  mpz_t start, p;
+  int fd = sock_open(addr, 0);
+  if (fd < 0) die(addr);
+  small_init();
+  mpz_inits(start, p, NULL);
+  while (msg_recv(fd, &hdr, start) == 0) {
+    uint32_t tested;
+    int op;
+    if (hdr.op != PRIMED_OP_JOB) continue; // a late CANCEL
+    op = run_job(fd, &hdr, start, p, &tested);
+    if (msg_send(fd, hdr.job, op, hdr.bits, tested, op == PRIMED_OP_FOUND ? p : NULL) != 0) break;
+  }
+  mpz_clears(start, p, NULL);
+  close(fd);
+  return 0;
+}
+
+// Coordinator
+
+typedef struct __SEARCH_STATS {
+  uint64_t jobs, tested, cancelled;
+} SEARCH_STATS;
+
+static uint32_t next_job = 1;
+
+// A FOUND from a worker is not taken on trust: in the job's interval, the
+// right size, p mod e != 1 and a probable prime
+static int found_valid(const mpz_t x, const mpz_t start, int interval, int bits) {
+  mpz_t i;
+  int ok;
+  if (mpz_sizeinbase(x, 2) != (size_t)bits / 2 || mpz_cmp(x, start) < 0) return 0;
+  mpz_init(i);
+  mpz_sub(i, x, start);
+  ok = mpz_even_p(i) && mpz_cmp_ui(i, 2 * (unsigned long)interval) < 0
+    && mpz_fdiv_ui(x, 0x10001) != 1 && mpz_millerrabin(x, PRIMED_MR_ROUNDS) != 0;
+  mpz_clear(i);
+  return ok;
+}
+
+// One key from the workers, -1 if every worker is gone
+static int key_search(RSA_PUBKEY *pub, RSA_PRIKEY *pri, int bits, int interval, NODE *node,
+                      int nnodes, RSA_DRBG *rnd, SEARCH_STATS *st) {
+  struct pollfd pfd[MAX_NODES];
+  mpz_t prime[2], x;
+  int found = 0, ret = -1;
+
+  mpz_inits(prime[0], prime[1], x, NULL);
+  for (;;) {
+    int busy = 0, alive = 0;
+    for (int i = 0; i < nnodes; ++i) {
+      NODE *w = &node[i];
+      if (w->fd < 0) continue;
+      ++alive;
+      if (w->job == 0 && found < 2) {
+        // p >= 3 * 2 ^ (bits - 2), odd
+        rsa_drbg_urandomb(x, rnd, bits / 2);
+        mpz_setbit(x, bits / 2 - 1);
+        mpz_setbit(x, bits / 2 - 2);
+        mpz_setbit(x, 0);
+        w->job = next_job++;
+        w->cancelled = 0;
+        mpz_set(w->start, x);
+        if (msg_send(w->fd, w->job, PRIMED_OP_JOB, bits / 2, interval, x) != 0) {
+          close(w->fd);
+          w->fd = -1;
+          --alive;
+          continue;
+        }
+        ++st->jobs;
+      }
+      busy += w->job != 0;
+    }
+    if (alive == 0) break;
+    if (found == 2 && busy == 0) {
+      ret = rsa_key_from_primes(pub, pri, prime[0], prime[1]);
+      break;
+    }
+
+    for (int i = 0; i < nnodes; ++i) {
+      pfd[i].fd = node[i].job ? node[i].fd : -1;
+      pfd[i].events = POLLIN;
+      pfd[i].revents = 0;
+    }
+    if (poll(pfd, nnodes, -1) < 0 && errno != EINTR) die("poll");
+    for (int i = 0; i < nnodes; ++i) {
+      NODE *w = &node[i];
+      PRIMED_HDR hdr;
+      if (!pfd[i].revents) continue;
+      if (msg_recv(w->fd, &hdr, x) != 0 || hdr.job != w->job) {
+        fprintf(stderr, "primed: lost worker %d\n", i);
+        close(w->fd);
+        w->fd = -1;
+        continue;
+      }
+      w->job = 0;
+      st->tested += hdr.count;
+      st->cancelled += hdr.op == PRIMED_OP_CANCELLED;
+      if (hdr.op != PRIMED_OP_FOUND || found == 2) continue;
+      if (!found_valid(x, w->start, interval, bits)) {
+        fprintf(stderr, "primed: bad prime from worker %d\n", i);
+        continue;
+      }
+      if (found == 1 && mpz_cmp(x, prime[0]) == 0) continue;
+      mpz_set(prime[found++], x);
+      if (found < 2) continue;
+      // p and q are in: stop everything still out
+      for (int k = 0; k < nnodes; ++k) {
+        if (node[k].fd < 0 || node[k].job == 0 || node[k].cancelled) continue;
+        node[k].cancelled = 1;
+        msg_send(node[k].fd, node[k].job, PRIMED_OP_CANCEL, 0, 0, NULL);
+      }
+    }
+  }
+  mpz_clears(prime[0], prime[1], x, NULL);
+  return ret;
+}
+
+// m ^ e ^ d = m
+static int key_check(const RSA_PUBKEY *pub, const RSA_PRIKEY *pri, RSA_DRBG *rnd) {
+  mpz_t m, c;
+  int ok;
+  mpz_inits(m, c, NULL);
+  rsa_drbg_urandomb(m, rnd, pub->RSA_SIZE - 1);
+  rsa_pub_exp(c, m, pub);
+  rsa_pri_exp(c, c, pri);
+  ok = mpz_cmp(c, m) == 0;
+  mpz_clears(m, c, NULL);
+  return ok;
+}
+
+static void usage(void) {
+  puts("Usage: primed -c addr                          (worker)\n"
+       "       primed [-l addr] [-w workers | -L local workers]\n"
+       "              [-n keys] [-b bits] [-i interval] [-B]  (coordinator)\n"
+       "  addr: unix:/path, host:port or :port");
+  exit(0);
+}
+
+int main(int argc, char *argv[]) {
+  const char *addr = NULL, *connect_addr = NULL;
+  char local_addr[64];
+  int nkeys = DEFAULT_KEYS, key_size = DEFAULT_KEY_SIZE, interval = DEFAULT_INTERVAL;
+  int nnodes = 0, local = 0, baseline = 0, listen_fd, opt;
+  NODE node[MAX_NODES];
+  pid_t pid[MAX_NODES];
+  SEARCH_STATS st = {0, 0, 0};
+  RSA_DRBG rnd;
+  double start, total = 0;
+
+  while ((opt = getopt(argc, argv, "c:l:w:L:n:b:i:Bh")) != -1) {
+    switch (opt) {
+    case 'c': connect_addr = optarg; break;
+    case 'l': addr         = optarg; break;
+    case 'w': nnodes       = atoi(optarg); break;
+    case 'L': nnodes       = atoi(optarg); local = 1; break;
+    case 'n': nkeys        = atoi(optarg); break;
+    case 'b': key_size     = atoi(optarg); break;
+    case 'i': interval     = atoi(optarg); break;
+    case 'B': baseline     = 1; break;
+    default: usage();
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+  if (connect_addr) return worker_main(connect_addr);
+  if (nnodes <= 0 || nnodes > MAX_NODES || nkeys <= 0 || interval <= 0
+      || interval > PRIMED_MAX_COUNT || key_size < 256 || key_size > MAX_RSA_SIZE
+      || key_size % 2) usage();
+  if (rsa_drbg_init_os(&rnd) != 0) {
+    fputs("No OS entropy source\n", stderr);
+    return 1;
+  }
+
+  // 1. Listen, start the local workers, wait for every worker
+  if (!addr) {
+    if (local) snprintf(local_addr, sizeof(local_addr), "unix:/tmp/rsa_primed.%d.sock", (int)getpid());
+    addr = local ? local_addr : PRIMED_SOCKET;
+  }
+  listen_fd = sock_open(addr, 1);
+  if (listen_fd < 0) die(addr);
+  for (int i = 0; local && i < nnodes; ++i) {
+    pid[i] = fork();
+    if (pid[i] < 0) die("fork");
+    if (pid[i] == 0) {
+      close(listen_fd);
+      exit(worker_main(addr));
+    }
+  }
+  fprintf(stderr, "primed: waiting for %d worker(s) on %s\n", nnodes, addr);
+  for (int i = 0; i < nnodes; ++i) {
+    node[i].fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (node[i].fd < 0) die("accept");
+    node[i].job = 0;
+    node[i].cancelled = 0;
+    mpz_init(node[i].start);
+  }
+
+  // 2. Keys
+  for (int k = 0; k < nkeys; ++k) {
+    RSA_PUBKEY pub;
+    RSA_PRIKEY pri;
+    SEARCH_STATS before = st;
+    double t;
+    int ok;
+    rsa_key_init(&pub, &pri);
+    start = now();
+    ok = key_search(&pub, &pri, key_size, interval, node, nnodes, &rnd, &st) == 0;
+    t = now() - start;
+    total += t;
+    ok = ok && key_check(&pub, &pri, &rnd);
+    printf("key %3d: %8.1f ms, %3lu jobs, %5lu tested, %2lu cancelled %s\n", k, t * 1e3,
+           (unsigned long)(st.jobs - before.jobs), (unsigned long)(st.tested - before.tested),
+           (unsigned long)(st.cancelled - before.cancelled), ok ? "OK" : "FAIL");
+    rsa_key_clear(&pub, &pri);
+    if (!ok) return 1;
+  }
+  printf("[primed %2d worker(s) %5d]: %8.1f ms/key\n", nnodes, key_size, total / nkeys * 1e3);
+
+  // 3. Single process rsa_key_gen_drbg for reference
+  if (baseline) {
+    int k;
+    total = 0;
+    for (k = 0; k < nkeys; ++k) {
+      RSA_PUBKEY pub;
+      RSA_PRIKEY pri;
+      rsa_key_init(&pub, &pri);
+      start = now();
+      if (rsa_key_gen_drbg(&pub, &pri, key_size, &rnd) != 0) {
+        puts("rsa_key_gen_drbg: unsupported size");
+        rsa_key_clear(&pub, &pri);
+        break;
+      }
+      total += now() - start;
+      rsa_key_clear(&pub, &pri);
+    }
+    if (k == nkeys) {
+      printf("[rsa_key_gen_drbg    %5d]: %8.1f ms/key\n", key_size, total / nkeys * 1e3);
+    }
+  }
+
+  // 4. Closing the connections ends the workers
+  for (int i = 0; i < nnodes; ++i) {
+    if (node[i].fd >= 0) close(node[i].fd);
+    mpz_clear(node[i].start);
+  }
+  close(listen_fd);
+  for (int i = 0; local && i < nnodes; ++i) waitpid(pid[i], NULL, 0);
+  if (strncmp(addr, "unix:", 5) == 0) unlink(addr + 5);
+  rsa_drbg_clear(&rnd);
+  return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef __PRIMED_H__
+#define __PRIMED_H__
+
+#include <stdint.h>
+
+// Distributed prime search protocol (network byte order, TCP or Unix socket)
+//
+// Coordinator -> worker
+//   PRIMED_OP_JOB    : search start + 2i, i < count, for a `bits`-bit prime
+//                      p with p mod 0x10001 != 1; payload is the odd start,
+//                      big-endian
+//   PRIMED_OP_CANCEL : stop job `job`, no payload
+// Worker -> coordinator, exactly one reply per job
+//   PRIMED_OP_FOUND     : the first such prime in the interval, same encoding
+//   PRIMED_OP_NONE      : the interval has none
+//   PRIMED_OP_CANCELLED : stopped by a CANCEL
+//   `count` of a reply is the number of sieve survivors the job tested.
+// A worker has one job at a time. A CANCEL for a job that has already
+// replied is ignored.
+
+#define PRIMED_SOCKET "unix:/tmp/rsa_primed.sock"
+
+#define PRIMED_OP_JOB       1
+#define PRIMED_OP_CANCEL    2
+#define PRIMED_OP_FOUND     3
+#define PRIMED_OP_NONE      4
+#define PRIMED_OP_CANCELLED 5
+
+#define PRIMED_MR_ROUNDS    56      // as rsa_key_gen
+#define PRIMED_MAX_COUNT    (1 << 20)
+#define PRIMED_MAX_BYTES    1024
+
+typedef struct __PRIMED_HDR {
+  uint32_t job;
+  uint16_t op;
+  uint16_t bits;
+  uint32_t count;
+  uint32_t len;
+} PRIMED_HDR;
+
+#endif
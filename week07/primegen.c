@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rsa.h"
+
+// Safe / strong prime generator, e.g. for DH parameters
+// Prints each prime in hex and the sieve statistics against the
+// heuristic expectation on stderr.
+
+static void usage(void) {
+  puts("Usage: primegen [-b bits] [-t threads] [-n count] [-S (strong, default safe)]");
+  exit(0);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  int bits = 1024, count = 1, kind = RSA_PRIME_SAFE, opt;
+  int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  RSA_PRIME_STATS st, sum;
+  RSA_DRBG rnd;
+  double start;
+  mpz_t p;
+
+  while ((opt = getopt(argc, argv, "b:t:n:Sh")) != -1) {
+    switch (opt) {
+    case 'b': bits    = atoi(optarg); break;
+    case 't': threads = atoi(optarg); break;
+    case 'n': count   = atoi(optarg); break;
+    case 'S': kind    = RSA_PRIME_STRONG; break;
+    default: usage();
+    }
+  }
+  if (bits < 128 || threads <= 0 || count <= 0) usage();
+  if (rsa_drbg_init_os(&rnd) != 0) {
+    fputs("No OS entropy source\n", stderr);
+    return 1;
+  }
+
+  mpz_init(p);
+  memset(&sum, 0, sizeof(sum));
+  start = now();
+  for (int i = 0; i < count; ++i) {
+    if (rsa_prime_gen(p, bits, kind, threads, &rnd, &st) != 0) {
+      fputs("rsa_prime_gen failed\n", stderr);
+      return 1;
+    }
+    gmp_printf("%Zx\n", p);
+    sum.positions     += st.positions;
+    sum.survivors     += st.survivors;
+    sum.mr_rounds     += st.mr_rounds;
+    sum.exp_positions += st.exp_positions;
+    sum.exp_survivors += st.exp_survivors;
+  }
+
+  fprintf(stderr, "%d %s prime(s) of %d bits, %d thread(s): %.3f s\n", count,
+          kind == RSA_PRIME_SAFE ? "safe" : "strong", bits, threads, now() - start);
+  fprintf(stderr, "%-10s %14s %14s\n", "", "observed", "expected");
+  fprintf(stderr, "%-10s %14.1f %14.1f\n", "positions",
+          (double)sum.positions / count, sum.exp_positions / count);
+  fprintf(stderr, "%-10s %14.1f %14.1f\n", "survivors",
+          (double)sum.survivors / count, sum.exp_survivors / count);
+  fprintf(stderr, "%-10s %14.1f\n", "MR rounds", (double)sum.mr_rounds / count);
+
+  mpz_clear(p);
+  rsa_drbg_clear(&rnd);
+  return 0;
+}
@@ -1,18 +1,119 @@
 #ifndef __RSA_H__
 #define __RSA_H__
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <gmp.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // If you want to disable CRT features, uncomment line below.
 //#define NO_RSA_CRT
 
+// If you want to collect counters and latency histograms, uncomment line below.
+//#define WITH_RSA_STATS
+
+// If you want hardware counters per keygen / pri_exp phase, uncomment line below.
+//#define WITH_RSA_PERF
+
+#define MAX_RSA_SIZE  16384
+#define RSA_MAX_BYTES (MAX_RSA_SIZE / 8)
+#define RSA_MAX_LIMBS (MAX_RSA_SIZE / GMP_NUMB_BITS + 2)
+
+// Montgomery multiplication, R = b ^ size
+// Values are size-limb vectors in Montgomery form (aR mod n). A lazy
+// context has R > 4n and keeps values in [0, 2n), REDC never subtracts.
+typedef struct __RSA_MONT {
+  mp_limb_t *n;
+  mp_limb_t *rr;   // R ^ 2 mod n
+  mp_limb_t *one;  // R mod n
+  mp_limb_t ninv;  // -n ^ -1 mod b
+  mp_size_t size;
+  int bits;
+  int lazy;
+} RSA_MONT;
+
+int  rsa_mont_init (RSA_MONT*, const mpz_t);
+int  rsa_mont_init_lazy(RSA_MONT*, const mpz_t);
+void rsa_mont_norm (mp_limb_t*, const RSA_MONT*);
+void rsa_mont_clear(RSA_MONT*);
+void rsa_mont_redc (mp_limb_t*, mp_limb_t*, const RSA_MONT*);
+void rsa_mont_mul  (mp_limb_t*, const mp_limb_t*, const mp_limb_t*, const RSA_MONT*);
+void rsa_mont_sqr  (mp_limb_t*, const mp_limb_t*, const RSA_MONT*);
+void rsa_mont_to   (mp_limb_t*, const mpz_t, const RSA_MONT*);
+void rsa_mont_from (mpz_t, const mp_limb_t*, const RSA_MONT*);
+void rsa_mont_powm (mpz_t, const mpz_t, const mpz_t, const RSA_MONT*);
+
+// Exponentiation plan, the sliding window schedule of one fixed exponent
+typedef struct __RSA_EXP_PLAN {
+  uint32_t *op;   // (squarings << 8) | odd power index + 1
+  int nops;
+  int w;          // window width
+  int tab;        // table size, odd powers base ^ 1 ... base ^ (2 * tab - 1)
+  int sqr, mul;   // operation count, table included
+} RSA_EXP_PLAN;
+
+int  rsa_plan_init     (RSA_EXP_PLAN*, const mpz_t);
+void rsa_plan_clear    (RSA_EXP_PLAN*);
+void rsa_mont_powm_plan(mpz_t, const mpz_t, const RSA_EXP_PLAN*, const RSA_MONT*);
+void rsa_mont_powm_plan_n(mp_limb_t*, const mp_limb_t*, const RSA_EXP_PLAN*, const RSA_MONT*);
+
+// Product of k powers under one modulus, the squarings are shared
+int  rsa_mont_multi_powm(mpz_t, const mpz_srcptr*, const mpz_srcptr*, int, const RSA_MONT*);
+
+// NTT multiplication (three primes below 2 ^ 62, CRT) for very large
+// moduli, forward transforms of n and of -n ^ -1 mod R kept in the context
+// rsa_powm switches to it from RSA_NTT_THRESHOLD limbs, 0 = never. The
+// value comes from ntt_speed, which found no crossover with mpz_powm.
+#ifndef RSA_NTT_THRESHOLD
+#define RSA_NTT_THRESHOLD 0
+#endif
+
+typedef struct __RSA_NTT {
+  mpz_t n;
+  mp_size_t size;   // limbs of n, R = b ^ size
+  int log;          // transform length 2 ^ log >= 2 * size
+  uint64_t *tw;     // roots, inverse roots and Shoup quotients, per prime
+  uint64_t *nhat;   // forward transforms of n
+  uint64_t *nihat;  // and of -n ^ -1 mod R
+  struct __RSA_NTT_TABLES *tables;
+} RSA_NTT;
+
+int  rsa_ntt_init (RSA_NTT*, const mpz_t);
+void rsa_ntt_clear(RSA_NTT*);
+void rsa_ntt_powm (mpz_t, const mpz_t, const mpz_t, const RSA_NTT*);
+void rsa_powm     (mpz_t, const mpz_t, const mpz_t, const mpz_t); // base, exp, mod
+
+// Modular inversion: binary extended GCD on limbs (odd moduli) and batches
+// under one modulus with one inversion, scratch kept in an arena
+typedef struct __RSA_ARENA {
+  mp_limb_t *limbs;
+  size_t size;
+} RSA_ARENA;
+
+void       rsa_arena_init (RSA_ARENA*);
+void       rsa_arena_clear(RSA_ARENA*);
+mp_limb_t *rsa_arena_get  (RSA_ARENA*, size_t);
+int        rsa_inv_limbs  (mp_limb_t*, const mp_limb_t*, const mp_limb_t*, mp_size_t);
+int        rsa_invert     (mpz_t, const mpz_t, const mpz_t);
+int        rsa_inv_batch  (mpz_ptr*, mpz_srcptr*, int, const RSA_MONT*, RSA_ARENA*);
+
 typedef struct __RSA_PUBKEY {
   mpz_t n;
   mpz_t e;
   int RSA_SIZE;
+  // Built by rsa_key_plan, mont.n == NULL if there is none
+  RSA_MONT mont;
+  RSA_EXP_PLAN plan;
 } RSA_PUBKEY;
 
+// Fields a key can be without (rsa_key_gen_lean), see rsa_key_derive
+enum { RSA_KEY_D = 1 };
+
 typedef struct __RSA_PRIKEY {
   mpz_t p;
   mpz_t q;
@@ -20,6 +121,7 @@ typedef struct __RSA_PRIKEY {
   mpz_t n;
   mpz_t e;
   int RSA_SIZE;
+  int missing;   // RSA_KEY_* not materialized, 0 for keys filled by hand
 #ifndef NO_RSA_CRT
   mpz_t dp;
   mpz_t dq;
@@ -27,17 +129,251 @@ typedef struct __RSA_PRIKEY {
 #endif
 } RSA_PRIKEY;
 
+// Private key packed for the CRT path, built once from an RSA_PRIKEY
+// Everything the operation reads is in one 64-byte aligned blob.
+typedef struct __RSA_HOTKEY {
+  void *blob;
+  size_t bytes;
+  RSA_MONT mp, mq;       // p and q, limbs in the blob
+  RSA_EXP_PLAN dp, dq;   // ops in the blob
+  mp_limb_t *qi;         // q ^ -1 * R mod p
+  int RSA_SIZE;
+} RSA_HOTKEY;
+
 // RSA Helper functions
 void rsa_add_mod(mpz_t, const mpz_t, const mpz_t, const mpz_t);
 void rsa_mul_mod(mpz_t, const mpz_t, const mpz_t, const mpz_t);
 
+// ChaCha20 DRBG with bulk buffering and deterministic forking
+#define RSA_DRBG_BUFSIZE 4096
+
+typedef struct __RSA_DRBG {
+  uint32_t key[8];
+  uint64_t stream;
+  uint64_t counter;
+  size_t   pos;     // next unread byte of buf
+  uint8_t  buf[RSA_DRBG_BUFSIZE];
+} RSA_DRBG;
+
+void rsa_drbg_init    (RSA_DRBG*, const uint8_t*, uint64_t); // 32-byte seed, stream id
+int  rsa_drbg_init_os (RSA_DRBG*);
+void rsa_drbg_fork    (RSA_DRBG*, const RSA_DRBG*, uint64_t);
+void rsa_drbg_clear   (RSA_DRBG*);
+void rsa_drbg_bytes   (RSA_DRBG*, void*, size_t);
+void rsa_drbg_urandomb(mpz_t, RSA_DRBG*, mp_bitcnt_t);
+
 // RSA key generation
-void rsa_key_init (RSA_PUBKEY*, RSA_PRIKEY*);
-void rsa_key_clear(RSA_PUBKEY*, RSA_PRIKEY*);
-int  rsa_key_gen  (RSA_PUBKEY*, RSA_PRIKEY*, int, gmp_randstate_t);
+void rsa_key_init    (RSA_PUBKEY*, RSA_PRIKEY*);
+void rsa_key_clear   (RSA_PUBKEY*, RSA_PRIKEY*);
+int  rsa_key_gen     (RSA_PUBKEY*, RSA_PRIKEY*, int, gmp_randstate_t);
+int  rsa_key_gen_drbg(RSA_PUBKEY*, RSA_PRIKEY*, int, RSA_DRBG*);
+int  rsa_key_gen_lean(RSA_PUBKEY*, RSA_PRIKEY*, int, gmp_randstate_t);
+int  rsa_key_derive  (RSA_PRIKEY*, int); // RSA_KEY_* fields
+int  rsa_key_size_ok (int);              // sizes rsa_key_gen supports
+int  rsa_key_plan    (RSA_PUBKEY*);
+int  rsa_key_from_primes     (RSA_PUBKEY*, RSA_PRIKEY*, const mpz_t, const mpz_t);
+int  rsa_key_from_primes_lean(RSA_PUBKEY*, RSA_PRIKEY*, const mpz_t, const mpz_t);
+// d differs by path, both work: rsa_key_gen, rsa_key_gen_drbg and
+// rsa_key_from_primes keep e ^ -1 mod phi(n) = (p - 1)(q - 1) as before,
+// rsa_key_derive makes the smallest one, e ^ -1 mod lambda(n) =
+// lcm(p - 1, q - 1). Compare keys by n and e, not by d.
+
+// Safe (p = 2q + 1) and strong (Gordon) primes, sieved and multi-threaded
+enum { RSA_PRIME_SAFE, RSA_PRIME_STRONG };
+
+typedef struct __RSA_PRIME_STATS {
+  uint64_t positions;     // progression positions the sieve looked at
+  uint64_t survivors;     // positions where every form passed trial division
+  uint64_t mr_rounds;
+  double   exp_positions; // heuristic expectation for one prime
+  double   exp_survivors;
+} RSA_PRIME_STATS;
+
+int rsa_prime_gen(mpz_t, int, int, int, RSA_DRBG*, RSA_PRIME_STATS*); // bits, kind, threads
 
 // RSA encode, decode, sign and verify (RFC 8017)
 void rsa_pub_exp(mpz_t, const mpz_t, const RSA_PUBKEY*);
 void rsa_pri_exp(mpz_t, const mpz_t, const RSA_PRIKEY*);
+int  rsa_hotkey_init (RSA_HOTKEY*, const RSA_PRIKEY*);
+void rsa_hotkey_clear(RSA_HOTKEY*);
+void rsa_pri_exp_hot (mpz_t, const mpz_t, const RSA_HOTKEY*);
+
+// Low-latency private operation: the mod p and mod q halves run on the
+// two helper threads of a pool at once, Garner on the caller. A busy pool
+// (or NO_RSA_CRT) falls back to rsa_pri_exp.
+typedef struct __RSA_CRT_POOL RSA_CRT_POOL;
+
+RSA_CRT_POOL *rsa_crt_pool_new (int); // spin rounds before parking on a futex
+void          rsa_crt_pool_free(RSA_CRT_POOL*);
+void          rsa_pri_exp_par  (mpz_t, const mpz_t, const RSA_PRIKEY*, RSA_CRT_POOL*);
+
+// Sharded cache of packed private keys by key id, for many tenant keys
+// Lookups take no lock; a miss calls the loader for the RSA_PRIKEY, packs
+// it and may evict (CLOCK) to stay under the byte budget. The key from
+// rsa_cache_get stays valid until rsa_cache_put on the same thread.
+#define RSA_CACHE_MAX_THREADS 256
+
+typedef struct __RSA_CACHE RSA_CACHE;
+typedef int (*RSA_CACHE_LOADER)(RSA_PRIKEY*, uint64_t, void*); // key, id, arg; 0 = ok
+
+typedef struct __RSA_CACHE_STATS {
+  uint64_t hits, misses, evictions;
+  uint64_t entries, bytes;
+  uint64_t retired; // evicted, waiting for readers to move on
+} RSA_CACHE_STATS;
+
+RSA_CACHE        *rsa_cache_new  (size_t, int, RSA_CACHE_LOADER, void*); // bytes, shards
+void              rsa_cache_free (RSA_CACHE*);
+const RSA_HOTKEY *rsa_cache_get  (RSA_CACHE*, uint64_t);
+void              rsa_cache_put  (RSA_CACHE*);
+void              rsa_cache_stats(RSA_CACHE*, RSA_CACHE_STATS*);
+
+// Batched public operations, one key per vector lane
+// Kernel is picked at run time (AVX-512 IFMA, AVX2, scalar), the RSA_SIMD
+// environment variable (scalar, avx2, ifma) caps it.
+enum { RSA_SIMD_SCALAR, RSA_SIMD_AVX2, RSA_SIMD_IFMA };
+
+void        rsa_pub_exp_batch(mpz_ptr*, mpz_srcptr*, const RSA_PUBKEY**, int);
+int         rsa_simd_level   (void);
+int         rsa_simd_select  (int);
+const char *rsa_simd_name    (int);
+
+// Barrett reduction, mu = floor(b ^ 2k / n)
+typedef struct __RSA_BARRETT {
+  mpz_t n;
+  mpz_t mu;
+  mp_size_t k; // limbs of n
+} RSA_BARRETT;
+
+void rsa_barrett_init   (RSA_BARRETT*, const mpz_t);
+void rsa_barrett_clear  (RSA_BARRETT*);
+void rsa_barrett_reduce (mpz_t, const mpz_t, const RSA_BARRETT*);
+void rsa_barrett_mul_mod(mpz_t, const mpz_t, const mpz_t, const RSA_BARRETT*);
+void rsa_barrett_add_mod(mpz_t, const mpz_t, const mpz_t, const RSA_BARRETT*);
+void rsa_barrett_sub_mod(mpz_t, const mpz_t, const mpz_t, const RSA_BARRETT*);
+
+// SHA-256 (FIPS 180-4)
+#define RSA_HASH_SIZE 32
+
+typedef struct __RSA_SHA256 {
+  uint32_t h[8];
+  uint64_t len;
+  uint8_t  buf[64];
+} RSA_SHA256;
+
+void rsa_sha256_init  (RSA_SHA256*);
+void rsa_sha256_update(RSA_SHA256*, const void*, size_t);
+void rsa_sha256_final (RSA_SHA256*, uint8_t*);
+void rsa_sha256       (uint8_t*, const void*, size_t);
+
+// Data conversion and padding, on caller-provided buffers
+int  rsa_i2osp      (uint8_t*, size_t, const mpz_t);
+void rsa_os2ip      (mpz_t, const uint8_t*, size_t);
+void rsa_mgf1_xor   (uint8_t*, size_t, const uint8_t*, size_t);
+int  rsa_oaep_encode(uint8_t*, size_t, const uint8_t*, size_t, const uint8_t*, size_t, RSA_DRBG*);
+int  rsa_oaep_decode(uint8_t*, size_t*, uint8_t*, size_t, const uint8_t*, size_t);
+int  rsa_pss_encode (uint8_t*, size_t, const uint8_t*, size_t, RSA_DRBG*);
+int  rsa_pss_decode (uint8_t*, size_t, const uint8_t*, size_t);
+
+// RSAES-OAEP and RSASSA-PSS with SHA-256 and MGF1-SHA-256
+// Seeds and salts are drawn from the RSA_DRBG, one per thread.
+int rsa_oaep_encrypt(uint8_t*, const uint8_t*, size_t, const uint8_t*, size_t, const RSA_PUBKEY*, RSA_DRBG*);
+int rsa_oaep_decrypt(uint8_t*, size_t*, const uint8_t*, const uint8_t*, size_t, const RSA_PRIKEY*);
+int rsa_pss_sign    (uint8_t*, const uint8_t*, size_t, const RSA_PRIKEY*, RSA_DRBG*);
+int rsa_pss_sign_hash(uint8_t*, const uint8_t*, const RSA_PRIKEY*, RSA_DRBG*); // SHA-256 digest
+int rsa_pss_verify  (const uint8_t*, const uint8_t*, size_t, const RSA_PUBKEY*);
+
+// Instrumentation
+// Recording hooks compile to nothing unless WITH_RSA_STATS is defined,
+// the snapshot API is always there (and reads zeros).
+enum { RSA_STAT_KEYGEN, RSA_STAT_PRI_EXP, RSA_STAT_PUB_EXP, RSA_STAT_OPS };
+enum {
+  RSA_CNT_CANDIDATES,   // prime candidates drawn
+  RSA_CNT_MR_REJECTED,  // candidates that failed Miller-Rabin
+  RSA_CNT_GCD_REJECTED, // primes rejected by the gcd check
+  RSA_CNT_MR_ROUNDS,    // passes count every round, failures count one
+  RSA_CNT_SIZE_RETRY,   // (p, q) pairs redrawn because of the size of n
+  RSA_CNT_SIEVE_REJECTED, // candidates with a factor below 256
+  RSA_CNT_MAX
+};
+
+#define RSA_STAT_SIZES   (MAX_RSA_SIZE / 1024 + 1) // index = bits / 1024, 0 = other
+#define RSA_HIST_SUB     5                          // 32 sub-buckets, ~3% error
+#define RSA_HIST_BUCKETS ((40 - RSA_HIST_SUB + 2) << RSA_HIST_SUB) // up to 2 ^ 40 ns
+
+typedef struct __RSA_HIST {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t bucket[RSA_HIST_BUCKETS];
+} RSA_HIST;
+
+// Histograms of a snapshot are on the heap, NULL where nothing was
+// recorded; rsa_stats_clear frees them
+typedef struct __RSA_STATS {
+  uint64_t counter[RSA_CNT_MAX];
+  RSA_HIST *latency[RSA_STAT_OPS][RSA_STAT_SIZES]; // in ns
+} RSA_STATS;
+
+void     rsa_stats_snapshot (RSA_STATS*);
+void     rsa_stats_clear    (RSA_STATS*);
+uint64_t rsa_hist_percentile(const RSA_HIST*, double);
+void     rsa_stats_print    (FILE*, const RSA_STATS*);
+
+uint64_t rsa_stat_now   (void);
+void     rsa_stat_add   (int, uint64_t);
+void     rsa_stat_record(int, int, uint64_t);
+
+#ifdef WITH_RSA_STATS
+#define RSA_STAT_ADD(cnt, v)         rsa_stat_add(cnt, v)
+#define RSA_STAT_START(t)            uint64_t t = rsa_stat_now()
+#define RSA_STAT_STOP(t, op, size)   rsa_stat_record(op, size, rsa_stat_now() - (t))
+#else
+#define RSA_STAT_ADD(cnt, v)         ((void)0)
+#define RSA_STAT_START(t)            ((void)0)
+#define RSA_STAT_STOP(t, op, size)   ((void)0)
+#endif
+
+// Hardware counters per phase (perf_event_open)
+// Hooks compile to nothing unless WITH_RSA_PERF is defined. Each thread
+// opens its own counter group the first time it enters a phase. Phases
+// nest, and a phase is only charged for the time outside its inner
+// phases. Events the kernel or the machine does not count read as -1.
+enum {
+  RSA_PHASE_SIEVE,     // keygen: one prime search, drawing and trial division
+  RSA_PHASE_MR,        // keygen: Miller-Rabin
+  RSA_PHASE_INVERT,    // keygen: d, dp, dq, qi
+  RSA_PHASE_REDUCE,    // pri_exp: in mod p, in mod q
+  RSA_PHASE_EXP,       // pri_exp: exponentiations
+  RSA_PHASE_RECOMBINE, // pri_exp: Garner
+  RSA_PHASE_MAX
+};
+enum {
+  RSA_EV_CYCLES, RSA_EV_INSTRUCTIONS, RSA_EV_BRANCH_MISSES, RSA_EV_L1D_MISSES, RSA_EV_LLC_MISSES,
+  RSA_EV_MAX
+};
+
+typedef struct __RSA_PERF {
+  uint64_t calls[RSA_PHASE_MAX][RSA_STAT_SIZES];
+  uint64_t ns[RSA_PHASE_MAX][RSA_STAT_SIZES];
+  int64_t  ev[RSA_PHASE_MAX][RSA_STAT_SIZES][RSA_EV_MAX]; // -1: not counted
+} RSA_PERF;
+
+void rsa_perf_snapshot(RSA_PERF*);
+void rsa_perf_print   (FILE*, const RSA_PERF*);
+void rsa_perf_begin   (int, int); // phase, key size
+void rsa_perf_end     (void);
+
+#ifdef WITH_RSA_PERF
+#define RSA_PERF_BEGIN(phase, size)  rsa_perf_begin(phase, size)
+#define RSA_PERF_END()               rsa_perf_end()
+#else
+#define RSA_PERF_BEGIN(phase, size)  ((void)0)
+#define RSA_PERF_END()               ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
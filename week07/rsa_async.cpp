@@ -0,0 +1,118 @@
+#include "rsa_async.hpp"
+
+namespace rsa {
+
+// completion_queue
+
+void completion_queue::post(std::coroutine_handle<> h) {
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    ready_.push_back(h);
+  }
+  cond_.notify_one();
+}
+
+std::size_t completion_queue::poll() {
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    running_.swap(ready_);
+  }
+  // Resume outside the lock, resumed coroutines may post again
+  for (auto h : running_) h.resume();
+  std::size_t n = running_.size();
+  running_.clear();
+  return n;
+}
+
+std::size_t completion_queue::run_one() {
+  {
+    std::unique_lock<std::mutex> g(lock_);
+    cond_.wait(g, [this] { return !ready_.empty(); });
+    running_.swap(ready_);
+  }
+  for (auto h : running_) h.resume();
+  std::size_t n = running_.size();
+  running_.clear();
+  return n;
+}
+
+// crypto_executor
+
+// Index of the worker running on this thread, -1 elsewhere
+static thread_local int current_worker = -1;
+static thread_local const void* current_executor = nullptr;
+
+crypto_executor::crypto_executor(unsigned threads) {
+  if (threads == 0) threads = 1;
+  for (unsigned i = 0; i < threads; ++i) workers_.push_back(std::make_unique<worker>());
+  for (unsigned i = 0; i < threads; ++i) {
+    workers_[i]->thread = std::thread([this, i] { loop(i); });
+  }
+}
+
+crypto_executor::~crypto_executor() {
+  {
+    std::lock_guard<std::mutex> g(idle_lock_);
+    stop_ = true;
+  }
+  idle_cond_.notify_all();
+  for (auto& w : workers_) w->thread.join();
+}
+
+void crypto_executor::submit(work_item* w) {
+  unsigned idx;
+  // Work spawned by a worker stays local, everything else is spread
+  if (current_executor == this) idx = static_cast<unsigned>(current_worker);
+  else idx = next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+  {
+    std::lock_guard<std::mutex> g(workers_[idx]->lock);
+    workers_[idx]->queue.push_back(w);
+  }
+  queued_.fetch_add(1);
+  if (sleepers_.load() != 0) {
+    std::lock_guard<std::mutex> g(idle_lock_);
+    idle_cond_.notify_one();
+  }
+}
+
+work_item* crypto_executor::pop(unsigned self) {
+  const unsigned n = static_cast<unsigned>(workers_.size());
+  // Own queue first (FIFO), then steal from the back of the others
+  for (unsigned k = 0; k < n; ++k) {
+    worker& w = *workers_[(self + k) % n];
+    std::lock_guard<std::mutex> g(w.lock);
+    if (w.queue.empty()) continue;
+    work_item* item;
+    if (k == 0) {
+      item = w.queue.front();
+      w.queue.pop_front();
+    } else {
+      item = w.queue.back();
+      w.queue.pop_back();
+    }
+    queued_.fetch_sub(1);
+    return item;
+  }
+  return nullptr;
+}
+
+void crypto_executor::loop(unsigned self) {
+  current_worker = static_cast<int>(self);
+  current_executor = this;
+  for (;;) {
+    work_item* w = pop(self);
+    if (w) {
+      w->run(w);
+      continue;
+    }
+    // Park, queued_ is rechecked after announcing ourselves as a sleeper
+    std::unique_lock<std::mutex> g(idle_lock_);
+    sleepers_.fetch_add(1);
+    idle_cond_.wait(g, [this] { return stop_ || queued_.load() != 0; });
+    sleepers_.fetch_sub(1);
+    if (stop_ && queued_.load() == 0) return;
+  }
+}
+
+}  // namespace rsa
@@ -0,0 +1,141 @@
+#ifndef __RSA_ASYNC_HPP__
+#define __RSA_ASYNC_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "rsa.h"
+
+// co_await-able RSA operations (C++20)
+//
+//   rsa::completion_queue io;        // drained by the I/O thread
+//   rsa::crypto_executor  crypto;    // per-core worker queues
+//   co_await rsa::async_pri_exp(crypto, io, sig, msg, &pri);
+//
+// The awaitable itself is the work item, so a submission does not allocate.
+// A crypto worker runs the operation and posts the coroutine back to the
+// scheduler it was awaited from.
+
+namespace rsa {
+
+// Somewhere a suspended coroutine can be resumed
+class scheduler {
+public:
+  virtual ~scheduler() = default;
+  virtual void post(std::coroutine_handle<> h) = 0;
+};
+
+// Thread-safe queue of ready coroutines, resumed by whoever drains it
+class completion_queue : public scheduler {
+public:
+  void post(std::coroutine_handle<> h) override;
+  std::size_t poll();     // resume everything ready, never blocks
+  std::size_t run_one();  // block until one coroutine was resumed
+
+private:
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::vector<std::coroutine_handle<>> ready_, running_;
+};
+
+// Intrusive work item
+struct work_item {
+  void (*run)(work_item*);
+};
+
+// Crypto worker pool: one queue per worker, idle workers steal
+class crypto_executor {
+public:
+  explicit crypto_executor(unsigned threads = std::thread::hardware_concurrency());
+  ~crypto_executor();
+  crypto_executor(const crypto_executor&) = delete;
+  crypto_executor& operator=(const crypto_executor&) = delete;
+
+  void submit(work_item* w);
+  unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+private:
+  struct worker {
+    std::mutex lock;
+    std::deque<work_item*> queue;
+    std::thread thread;
+  };
+
+  work_item* pop(unsigned self);
+  void loop(unsigned self);
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::atomic<unsigned> next_{0};
+  std::atomic<std::size_t> queued_{0};
+  std::atomic<unsigned> sleepers_{0};
+  std::atomic<bool> stop_{false};
+  std::mutex idle_lock_;
+  std::condition_variable idle_cond_;
+};
+
+// Awaitable that runs f() on the executor and resumes on `sched`
+template <typename F>
+class call_op : private work_item {
+public:
+  call_op(crypto_executor& ex, scheduler& sched, F f)
+    : work_item{&call_op::execute}, ex_(ex), sched_(sched), f_(std::move(f)) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h) {
+    handle_ = h;
+    ex_.submit(this);
+  }
+  void await_resume() const noexcept {}
+
+private:
+  static void execute(work_item* w) {
+    auto* self = static_cast<call_op*>(w);
+    self->f_();
+    self->sched_.post(self->handle_);
+  }
+
+  crypto_executor& ex_;
+  scheduler& sched_;
+  F f_;
+  std::coroutine_handle<> handle_;
+};
+
+template <typename F>
+call_op<F> async_call(crypto_executor& ex, scheduler& sched, F f) {
+  return call_op<F>(ex, sched, std::move(f));
+}
+
+// out and in must stay alive until the co_await returns
+inline auto async_pri_exp(crypto_executor& ex, scheduler& sched,
+                          mpz_ptr out, mpz_srcptr in, const RSA_PRIKEY* pri) {
+  return async_call(ex, sched, [=] { rsa_pri_exp(out, in, pri); });
+}
+
+inline auto async_pub_exp(crypto_executor& ex, scheduler& sched,
+                          mpz_ptr out, mpz_srcptr in, const RSA_PUBKEY* pub) {
+  return async_call(ex, sched, [=] { rsa_pub_exp(out, in, pub); });
+}
+
+// Fire-and-forget coroutine, for tests and benchmarks
+struct detached {
+  struct promise_type {
+    detached get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+}  // namespace rsa
+
+#endif
@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// Barrett reduction (HAC 14.42) in base b = 2 ^ GMP_NUMB_BITS
+//   k  = limbs of n
+//   mu = floor(b ^ 2k / n)
+// For 0 <= x < b ^ 2k:
+//   q3 = floor(floor(x / b ^ (k - 1)) * mu / b ^ (k + 1))   (high half)
+//   r  = (x - q3 * n) mod b ^ (k + 1)                        (low half)
+// and r < 3n, so at most two subtractions are left.
+// Work buffers live on the stack: once the output has room, nothing allocates.
+
+// rp[0, len) = a * b mod b ^ len, rp must not overlap a, b
+static void mullo(mp_limb_t *rp, const mp_limb_t *ap, mp_size_t an,
+                  const mp_limb_t *bp, mp_size_t bn, mp_size_t len) {
+  memset(rp, 0, len * sizeof(mp_limb_t));
+  for (mp_size_t i = 0; i < an && i < len; ++i) {
+    mp_size_t n = len - i < bn ? len - i : bn;
+    mp_limb_t cy = mpn_addmul_1(rp + i, bp, n, ap[i]);
+    if (i + n < len) rp[i + n] += cy;
+  }
+}
+
+void rsa_barrett_init(RSA_BARRETT *br, const mpz_t n) {
+  mpz_t t;
+  br->k = mpz_size(n);
+  mpz_init_set(br->n, n);
+  mpz_init(br->mu);
+  mpz_init(t);
+  mpz_setbit(t, 2 * br->k * GMP_NUMB_BITS);
+  mpz_fdiv_q(br->mu, t, n);
+  mpz_clear(t);
+}
+
+void rsa_barrett_clear(RSA_BARRETT *br) {
+  mpz_clears(br->n, br->mu, NULL);
+}
+
+// rp[0, k) = x mod n, x has xn <= 2k limbs
+static void barrett_reduce_n(mp_limb_t *rp, const mp_limb_t *xp, mp_size_t xn,
+                             const RSA_BARRETT *br) {
+  const mp_size_t k = br->k;
+  const mp_limb_t *np = mpz_limbs_read(br->n);
+  const mp_limb_t *mp = mpz_limbs_read(br->mu);
+  const mp_size_t mn = mpz_size(br->mu);
+  mp_limb_t q2[2 * RSA_MAX_LIMBS + 2], r[RSA_MAX_LIMBS + 1], r2[RSA_MAX_LIMBS + 1];
+  mp_size_t q1n = xn - (k - 1), q3n;
+
+  // Short input: already reduced up to subtractions
+  if (q1n <= 0) {
+    memset(r, 0, (k + 1) * sizeof(mp_limb_t));
+    memcpy(r, xp, xn * sizeof(mp_limb_t));
+    goto subtract;
+  }
+
+  // 1. q3, the high half of q1 * mu
+  if (q1n >= mn) mpn_mul(q2, xp + k - 1, q1n, mp, mn);
+  else mpn_mul(q2, mp, mn, xp + k - 1, q1n);
+  q3n = q1n + mn - (k + 1);
+
+  // 2. r = (x - q3 * n) mod b ^ (k + 1), only the low half of q3 * n
+  memset(r, 0, (k + 1) * sizeof(mp_limb_t));
+  memcpy(r, xp, (xn < k + 1 ? xn : k + 1) * sizeof(mp_limb_t));
+  if (q3n > 0) {
+    mullo(r2, q2 + k + 1, q3n, np, k, k + 1);
+    mpn_sub_n(r, r, r2, k + 1); // borrow wraps mod b ^ (k + 1)
+  }
+
+subtract:
+  // 3. At most two subtractions
+  for (int i = 0; i < 2 && (r[k] || mpn_cmp(r, np, k) >= 0); ++i) {
+    r[k] -= mpn_sub_n(r, r, np, k);
+  }
+  memcpy(rp, r, k * sizeof(mp_limb_t));
+}
+
+static void limbs_to_mpz(mpz_t rop, const mp_limb_t *p, mp_size_t n) {
+  mp_limb_t *rp = mpz_limbs_write(rop, n);
+  memcpy(rp, p, n * sizeof(mp_limb_t));
+  while (n > 0 && p[n - 1] == 0) --n;
+  mpz_limbs_finish(rop, n);
+}
+
+// rop = x mod n, 0 <= x < n ^ 2
+void rsa_barrett_reduce(mpz_t rop, const mpz_t x, const RSA_BARRETT *br) {
+  mp_limb_t r[RSA_MAX_LIMBS];
+  barrett_reduce_n(r, mpz_limbs_read(x), mpz_size(x), br);
+  limbs_to_mpz(rop, r, br->k);
+}
+
+// rop = a * b mod n, 0 <= a, b < n
+void rsa_barrett_mul_mod(mpz_t rop, const mpz_t a, const mpz_t b, const RSA_BARRETT *br) {
+  mp_limb_t t[2 * RSA_MAX_LIMBS], r[RSA_MAX_LIMBS];
+  mp_size_t an = mpz_size(a), bn = mpz_size(b);
+  if (an == 0 || bn == 0) {
+    mpz_set_ui(rop, 0);
+    return;
+  }
+  if (a == b) mpn_sqr(t, mpz_limbs_read(a), an);
+  else if (an >= bn) mpn_mul(t, mpz_limbs_read(a), an, mpz_limbs_read(b), bn);
+  else mpn_mul(t, mpz_limbs_read(b), bn, mpz_limbs_read(a), an);
+  barrett_reduce_n(r, t, an + bn, br);
+  limbs_to_mpz(rop, r, br->k);
+}
+
+// rop = a + b mod n, 0 <= a, b < n
+void rsa_barrett_add_mod(mpz_t rop, const mpz_t a, const mpz_t b, const RSA_BARRETT *br) {
+  mpz_add(rop, a, b);
+  if (mpz_cmp(rop, br->n) >= 0) mpz_sub(rop, rop, br->n);
+}
+
+// rop = a - b mod n, 0 <= a, b < n
+void rsa_barrett_sub_mod(mpz_t rop, const mpz_t a, const mpz_t b, const RSA_BARRETT *br) {
+  mpz_sub(rop, a, b);
+  if (mpz_sgn(rop) < 0) mpz_add(rop, rop, br->n);
+}
@@ -0,0 +1,387 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "rsa.h"
+
+// Sharded cache of packed private keys (RSA_HOTKEY) by key id
+//
+// Lookups take no lock: a shard is an array of hash chains whose links are
+// atomic pointers, and entries never change once they are published.
+// Writers (a miss that inserts, the eviction it causes) hold the shard's
+// mutex. An evicted entry is unlinked at once but freed only when no
+// reader can still hold it, by epochs: a reader publishes the epoch it
+// entered in, the epoch moves on only when every active reader has seen
+// the current one, and an entry retired in epoch E is freed once the epoch
+// has reached E + 2.
+//
+// Eviction is CLOCK per shard under bytes / shards: a hit sets the entry's
+// reference bit, the hand clears set bits and evicts the first clear one.
+// Retired entries are collected by the shard's next miss, by the eviction
+// path for every other shard, and every CACHE_SWEEP_PUTS puts of a thread,
+// so a shard that only gets hits still drains its limbo.
+//
+// Readers are per thread: each thread gets a slot (recycled when it exits)
+// and every cache has one cache line per slot for its epoch and counters.
+// A thread that exits between get and put is taken out of every cache on
+// its way out, or its epoch would hold back reclamation for good.
+
+#define SLOT_FREE        ((uint64_t)0)
+#define CACHE_SWEEP_PUTS 64
+
+typedef struct __CACHE_ENTRY {
+  _Atomic(struct __CACHE_ENTRY*) next; // hash chain
+  struct __CACHE_ENTRY *limbo;         // retired list
+  uint64_t id;
+  uint64_t retired;                    // epoch it was unlinked in
+  size_t bytes;
+  int ring;                            // index in the CLOCK ring
+  atomic_int ref;
+  RSA_HOTKEY hk;
+} CACHE_ENTRY;
+
+typedef struct __CACHE_SHARD {
+  pthread_mutex_t lock;
+  _Atomic(CACHE_ENTRY*) *bucket;
+  size_t mask;
+  CACHE_ENTRY **ring;
+  int count, cap, hand;
+  size_t bytes, budget;
+  uint64_t evictions;
+  CACHE_ENTRY *limbo;
+  atomic_int has_limbo; // limbo != NULL, read without the lock
+} CACHE_SHARD;
+
+// One line per reader thread: entered epoch (epoch << 1 | 1, 0 = outside)
+typedef struct __CACHE_READER {
+  _Atomic uint64_t epoch;
+  _Atomic uint64_t hits, misses;
+  int depth;
+  int puts;     // until the next limbo sweep
+} __attribute__((aligned(64))) CACHE_READER;
+
+struct __RSA_CACHE {
+  struct __RSA_CACHE *next; // live caches, see slot_release
+  CACHE_SHARD *shard;
+  int shards;
+  _Atomic uint64_t epoch;
+  RSA_CACHE_LOADER load;
+  void *arg;
+  CACHE_READER reader[RSA_CACHE_MAX_THREADS];
+};
+
+// Thread slots, shared by every cache
+static _Atomic uint64_t slot_used[RSA_CACHE_MAX_THREADS / 64];
+static pthread_key_t slot_key;
+static pthread_once_t slot_once = PTHREAD_ONCE_INIT;
+static _Thread_local int slot_self = -1;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static RSA_CACHE *cache_list;
+
+// Thread exit: leave every cache the thread is still inside
+static void slot_release(void *p) {
+  const int s = (int)(intptr_t)p - 1;
+  pthread_mutex_lock(&cache_lock);
+  for (RSA_CACHE *c = cache_list; c; c = c->next) {
+    if (c->reader[s].depth == 0) continue;
+    c->reader[s].depth = 0;
+    atomic_store_explicit(&c->reader[s].epoch, SLOT_FREE, memory_order_release);
+  }
+  pthread_mutex_unlock(&cache_lock);
+  slot_self = -1;
+  atomic_fetch_and(&slot_used[s / 64], ~((uint64_t)1 << (s % 64)));
+}
+
+static void slot_init(void) {
+  pthread_key_create(&slot_key, slot_release);
+}
+
+// -1 once RSA_CACHE_MAX_THREADS threads hold one
+static int slot_get(void) {
+  if (slot_self >= 0) return slot_self;
+  pthread_once(&slot_once, slot_init);
+  for (int w = 0; w < RSA_CACHE_MAX_THREADS / 64; ++w) {
+    uint64_t used = atomic_load(&slot_used[w]);
+    while (~used) {
+      const int b = __builtin_ctzll(~used);
+      if (atomic_compare_exchange_weak(&slot_used[w], &used, used | (uint64_t)1 << b)) {
+        slot_self = w * 64 + b;
+        pthread_setspecific(slot_key, (void*)(intptr_t)(slot_self + 1));
+        return slot_self;
+      }
+    }
+  }
+  return -1;
+}
+
+static uint64_t hash_id(uint64_t id) {
+  id ^= id >> 33;
+  id *= UINT64_C(0xff51afd7ed558ccd);
+  id ^= id >> 33;
+  return id;
+}
+
+RSA_CACHE *rsa_cache_new(size_t budget, int shards, RSA_CACHE_LOADER load, void *arg) {
+  RSA_CACHE *c;
+  size_t buckets = 64;
+  if (shards <= 0 || !load) return NULL;
+  c = aligned_alloc(64, (sizeof(RSA_CACHE) + 63) / 64 * 64);
+  if (!c) return NULL;
+  memset(c, 0, sizeof(*c));
+  c->shard = calloc(shards, sizeof(CACHE_SHARD));
+  if (!c->shard) {
+    free(c);
+    return NULL;
+  }
+  c->shards = shards;
+  c->load = load;
+  c->arg = arg;
+  atomic_init(&c->epoch, 1);
+  // About one chain per 2KB of budget (a 2048-bit key packs to ~2KB)
+  while (buckets * shards * 2048 < budget) buckets <<= 1;
+  for (int i = 0; i < shards; ++i) {
+    CACHE_SHARD *s = &c->shard[i];
+    pthread_mutex_init(&s->lock, NULL);
+    s->bucket = calloc(buckets, sizeof(*s->bucket));
+    s->mask = buckets - 1;
+    s->budget = budget / shards;
+    if (!s->bucket) {
+      rsa_cache_free(c);
+      return NULL;
+    }
+  }
+  pthread_mutex_lock(&cache_lock);
+  c->next = cache_list;
+  cache_list = c;
+  pthread_mutex_unlock(&cache_lock);
+  return c;
+}
+
+static void entry_free(CACHE_ENTRY *e) {
+  rsa_hotkey_clear(&e->hk);
+  free(e);
+}
+
+// Caller must be sure no reader is left, i.e. no other thread uses c
+void rsa_cache_free(RSA_CACHE *c) {
+  RSA_CACHE **p;
+  pthread_mutex_lock(&cache_lock);
+  for (p = &cache_list; *p && *p != c; p = &(*p)->next);
+  if (*p) *p = c->next;
+  pthread_mutex_unlock(&cache_lock);
+  for (int i = 0; i < c->shards; ++i) {
+    CACHE_SHARD *s = &c->shard[i];
+    for (int k = 0; k < s->count; ++k) entry_free(s->ring[k]);
+    while (s->limbo) {
+      CACHE_ENTRY *e = s->limbo;
+      s->limbo = e->limbo;
+      entry_free(e);
+    }
+    free(s->ring);
+    free(s->bucket);
+    pthread_mutex_destroy(&s->lock);
+  }
+  free(c->shard);
+  free(c);
+}
+
+// Moves the epoch on if every reader inside has caught up with it
+static uint64_t epoch_advance(RSA_CACHE *c) {
+  uint64_t e = atomic_load(&c->epoch);
+  for (int i = 0; i < RSA_CACHE_MAX_THREADS; ++i) {
+    const uint64_t r = atomic_load(&c->reader[i].epoch);
+    if (r != SLOT_FREE && r >> 1 != e) return e;
+  }
+  atomic_compare_exchange_strong(&c->epoch, &e, e + 1);
+  return atomic_load(&c->epoch);
+}
+
+// Shard lock held
+static void limbo_collect(RSA_CACHE *c, CACHE_SHARD *s) {
+  const uint64_t e = epoch_advance(c);
+  CACHE_ENTRY **p = &s->limbo;
+  while (*p) {
+    CACHE_ENTRY *x = *p;
+    if (x->retired + 2 <= e) {
+      *p = x->limbo;
+      entry_free(x);
+    } else {
+      p = &x->limbo;
+    }
+  }
+  atomic_store_explicit(&s->has_limbo, s->limbo != NULL, memory_order_relaxed);
+}
+
+// Collects every shard with retired entries whose lock is free
+// skip: a shard whose lock the caller already holds, or NULL
+static void limbo_sweep(RSA_CACHE *c, const CACHE_SHARD *skip) {
+  for (int i = 0; i < c->shards; ++i) {
+    CACHE_SHARD *s = &c->shard[i];
+    if (s == skip || !atomic_load_explicit(&s->has_limbo, memory_order_relaxed)) continue;
+    if (pthread_mutex_trylock(&s->lock) != 0) continue;
+    if (s->limbo) limbo_collect(c, s);
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+// Unlinks the entry at ring[k] and moves the last one into its place
+static void evict(RSA_CACHE *c, CACHE_SHARD *s, int k) {
+  CACHE_ENTRY *x = s->ring[k];
+  _Atomic(CACHE_ENTRY*) *link = &s->bucket[hash_id(x->id) >> 8 & s->mask];
+  while (atomic_load_explicit(link, memory_order_relaxed) != x) {
+    link = &atomic_load_explicit(link, memory_order_relaxed)->next;
+  }
+  atomic_store_explicit(link, atomic_load_explicit(&x->next, memory_order_relaxed),
+                        memory_order_release);
+  atomic_thread_fence(memory_order_seq_cst);
+  x->retired = atomic_load(&c->epoch);
+  x->limbo = s->limbo;
+  s->limbo = x;
+  atomic_store_explicit(&s->has_limbo, 1, memory_order_relaxed);
+  s->bytes -= x->bytes;
+  s->ring[k] = s->ring[--s->count];
+  s->ring[k]->ring = k;
+  if (s->hand >= s->count) s->hand = 0;
+  ++s->evictions;
+}
+
+// CLOCK: clear reference bits until an unreferenced entry comes up
+static void make_room(RSA_CACHE *c, CACHE_SHARD *s, size_t bytes) {
+  while (s->count > 0 && s->bytes + bytes > s->budget) {
+    CACHE_ENTRY *x = s->ring[s->hand];
+    if (atomic_load_explicit(&x->ref, memory_order_relaxed)) {
+      atomic_store_explicit(&x->ref, 0, memory_order_relaxed);
+      s->hand = (s->hand + 1) % s->count;
+    } else {
+      evict(c, s, s->hand);
+    }
+  }
+}
+
+static CACHE_ENTRY *lookup(const CACHE_SHARD *s, uint64_t id, uint64_t h) {
+  CACHE_ENTRY *x = atomic_load_explicit(&s->bucket[h >> 8 & s->mask], memory_order_acquire);
+  while (x && x->id != id) x = atomic_load_explicit(&x->next, memory_order_acquire);
+  return x;
+}
+
+static void reader_enter(RSA_CACHE *c, CACHE_READER *r) {
+  if (r->depth++ > 0) return;
+  // Store, full fence, then the chain loads; pairs with the fence in evict
+  // (Dekker): a writer retiring after this store sees the slot and waits,
+  // one that retired before it has already unlinked what it retired
+  atomic_store(&r->epoch, atomic_load(&c->epoch) << 1 | 1);
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+static void reader_leave(CACHE_READER *r) {
+  if (--r->depth == 0) atomic_store_explicit(&r->epoch, SLOT_FREE, memory_order_release);
+}
+
+// Packed key for id, loaded and built on a miss
+// Valid until the matching rsa_cache_put on the same thread. NULL if the
+// loader fails or the thread limit is reached.
+const RSA_HOTKEY *rsa_cache_get(RSA_CACHE *c, uint64_t id) {
+  const int slot = slot_get();
+  const uint64_t h = hash_id(id);
+  CACHE_SHARD *s = &c->shard[h % c->shards];
+  CACHE_READER *r;
+  CACHE_ENTRY *x, *y;
+  RSA_PRIKEY pri;
+  int ok;
+
+  if (slot < 0) return NULL;
+  r = &c->reader[slot];
+  reader_enter(c, r);
+  x = lookup(s, id, h);
+  if (x) {
+    // Only write the shared line when the bit is not already set
+    if (!atomic_load_explicit(&x->ref, memory_order_relaxed)) {
+      atomic_store_explicit(&x->ref, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&r->hits, atomic_load_explicit(&r->hits, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    return &x->hk;
+  }
+  atomic_store_explicit(&r->misses, atomic_load_explicit(&r->misses, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+
+  // Miss: build outside the lock, another thread may be doing the same
+  x = calloc(1, sizeof(*x));
+  if (!x) goto fail;
+  rsa_key_init(NULL, &pri);
+  ok = c->load(&pri, id, c->arg) == 0 && rsa_hotkey_init(&x->hk, &pri) == 0;
+  rsa_key_clear(NULL, &pri);
+  if (!ok) {
+    free(x);
+    goto fail;
+  }
+  x->id = id;
+  x->bytes = sizeof(*x) + x->hk.bytes;
+
+  pthread_mutex_lock(&s->lock);
+  y = lookup(s, id, h);
+  if (y) {
+    pthread_mutex_unlock(&s->lock);
+    entry_free(x);
+    return &y->hk;
+  }
+  make_room(c, s, x->bytes);
+  if (s->count == s->cap) {
+    const int cap = s->cap ? 2 * s->cap : 64;
+    CACHE_ENTRY **ring = realloc(s->ring, cap * sizeof(*ring));
+    if (!ring) {
+      pthread_mutex_unlock(&s->lock);
+      entry_free(x);
+      goto fail;
+    }
+    s->ring = ring;
+    s->cap = cap;
+  }
+  x->ring = s->count;
+  s->ring[s->count++] = x;
+  s->bytes += x->bytes;
+  {
+    _Atomic(CACHE_ENTRY*) *head = &s->bucket[h >> 8 & s->mask];
+    atomic_store_explicit(&x->next, atomic_load_explicit(head, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(head, x, memory_order_release);
+  }
+  if (s->limbo) limbo_collect(c, s);
+  if (c->shards > 1) limbo_sweep(c, s);
+  pthread_mutex_unlock(&s->lock);
+  return &x->hk;
+
+fail:
+  reader_leave(r);
+  return NULL;
+}
+
+// Ends the use of the key the last rsa_cache_get on this thread returned
+// No-op after a get that returned NULL (or without a get).
+void rsa_cache_put(RSA_CACHE *c) {
+  CACHE_READER *r;
+  if (slot_self < 0 || c->reader[slot_self].depth == 0) return;
+  r = &c->reader[slot_self];
+  reader_leave(r);
+  if (r->depth == 0 && ++r->puts == CACHE_SWEEP_PUTS) {
+    r->puts = 0;
+    limbo_sweep(c, NULL);
+  }
+}
+
+void rsa_cache_stats(RSA_CACHE *c, RSA_CACHE_STATS *st) {
+  memset(st, 0, sizeof(*st));
+  for (int i = 0; i < RSA_CACHE_MAX_THREADS; ++i) {
+    st->hits   += atomic_load_explicit(&c->reader[i].hits, memory_order_relaxed);
+    st->misses += atomic_load_explicit(&c->reader[i].misses, memory_order_relaxed);
+  }
+  for (int i = 0; i < c->shards; ++i) {
+    CACHE_SHARD *s = &c->shard[i];
+    pthread_mutex_lock(&s->lock);
+    st->evictions += s->evictions;
+    st->entries   += s->count;
+    st->bytes     += s->bytes;
+    for (CACHE_ENTRY *x = s->limbo; x; x = x->limbo) ++st->retired;
+    pthread_mutex_unlock(&s->lock);
+  }
+}
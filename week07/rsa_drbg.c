@@ -0,0 +1,167 @@
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#include "rsa.h"
+
+// ChaCha20 DRBG
+//
+// Output is the ChaCha20 keystream (64-bit counter, 64-bit nonce) under the
+// current key, produced RSA_DRBG_BUFSIZE bytes at a time. Every refill also
+// draws 32 extra bytes that replace the key (fast key erasure), so old
+// output cannot be recomputed from a later state.
+//
+// A fork is one ChaCha20 block under a nonce the output never uses, with the
+// child id as the counter. It is deterministic, costs one block, and leaves
+// the parent untouched.
+
+#define FORK_NONCE 0xffffffffffffffffUL
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define QR(a, b, c, d) do { \
+    a += b; d ^= a; d = ROTL(d, 16); \
+    c += d; b ^= c; b = ROTL(b, 12); \
+    a += b; d ^= a; d = ROTL(d, 8);  \
+    c += d; b ^= c; b = ROTL(b, 7);  \
+  } while (0)
+
+static void store32_le(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t load32_le(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void chacha20_block(uint8_t out[64], const uint32_t key[8], uint64_t counter, uint64_t nonce) {
+  uint32_t in[16], x[16];
+  in[0] = 0x61707865; in[1] = 0x3320646e; in[2] = 0x79622d32; in[3] = 0x6b206574;
+  memcpy(in + 4, key, 8 * sizeof(uint32_t));
+  in[12] = (uint32_t)counter; in[13] = (uint32_t)(counter >> 32);
+  in[14] = (uint32_t)nonce;   in[15] = (uint32_t)(nonce >> 32);
+  memcpy(x, in, sizeof(x));
+
+  for (int i = 0; i < 10; ++i) {
+    QR(x[0], x[4], x[8],  x[12]);
+    QR(x[1], x[5], x[9],  x[13]);
+    QR(x[2], x[6], x[10], x[14]);
+    QR(x[3], x[7], x[11], x[15]);
+    QR(x[0], x[5], x[10], x[15]);
+    QR(x[1], x[6], x[11], x[12]);
+    QR(x[2], x[7], x[8],  x[13]);
+    QR(x[3], x[4], x[9],  x[14]);
+  }
+  for (int i = 0; i < 16; ++i) store32_le(out + 4 * i, x[i] + in[i]);
+}
+
+// LANES consecutive blocks at once, written lane-wise so that the
+// compiler turns every quarter round into vector instructions
+#define LANES 8
+
+static void chacha20_blocks(uint8_t *out, const uint32_t key[8], uint64_t counter, uint64_t nonce) {
+  uint32_t in[16][LANES], x[16][LANES];
+  for (int l = 0; l < LANES; ++l) {
+    in[0][l] = 0x61707865; in[1][l] = 0x3320646e; in[2][l] = 0x79622d32; in[3][l] = 0x6b206574;
+    for (int i = 0; i < 8; ++i) in[4 + i][l] = key[i];
+    in[12][l] = (uint32_t)(counter + l); in[13][l] = (uint32_t)((counter + l) >> 32);
+    in[14][l] = (uint32_t)nonce;         in[15][l] = (uint32_t)(nonce >> 32);
+  }
+  memcpy(x, in, sizeof(x));
+
+#define VQR(a, b, c, d) for (int l = 0; l < LANES; ++l) QR(x[a][l], x[b][l], x[c][l], x[d][l])
+  for (int i = 0; i < 10; ++i) {
+    VQR(0, 4, 8, 12); VQR(1, 5, 9, 13); VQR(2, 6, 10, 14); VQR(3, 7, 11, 15);
+    VQR(0, 5, 10, 15); VQR(1, 6, 11, 12); VQR(2, 7, 8, 13); VQR(3, 4, 9, 14);
+  }
+#undef VQR
+  for (int l = 0; l < LANES; ++l) {
+    for (int i = 0; i < 16; ++i) store32_le(out + 64 * l + 4 * i, x[i][l] + in[i][l]);
+  }
+}
+
+static void drbg_refill(RSA_DRBG *g) {
+  uint8_t next[64];
+  for (size_t off = 0; off < RSA_DRBG_BUFSIZE; off += 64 * LANES) {
+    chacha20_blocks(g->buf + off, g->key, g->counter, g->stream);
+    g->counter += LANES;
+  }
+  // Rekey from the block right after the buffer
+  chacha20_block(next, g->key, g->counter, g->stream);
+  for (int i = 0; i < 8; ++i) g->key[i] = load32_le(next + 4 * i);
+  g->counter = 0;
+  g->pos = 0;
+  memset(next, 0, sizeof(next));
+}
+
+void rsa_drbg_init(RSA_DRBG *g, const uint8_t *seed, uint64_t stream) {
+  for (int i = 0; i < 8; ++i) g->key[i] = load32_le(seed + 4 * i);
+  g->stream = stream;
+  g->counter = 0;
+  g->pos = RSA_DRBG_BUFSIZE; // refill on first use
+}
+
+// Seed from the kernel, -1 if no entropy source is available
+int rsa_drbg_init_os(RSA_DRBG *g) {
+  uint8_t seed[32];
+  size_t got = 0;
+  while (got < sizeof(seed)) {
+    ssize_t n = getrandom(seed + got, sizeof(seed) - got, 0);
+    if (n <= 0) break;
+    got += n;
+  }
+  if (got < sizeof(seed)) {
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    got = read(fd, seed, sizeof(seed)) == (ssize_t)sizeof(seed) ? sizeof(seed) : 0;
+    close(fd);
+    if (!got) return -1;
+  }
+  rsa_drbg_init(g, seed, 0);
+  memset(seed, 0, sizeof(seed));
+  return 0;
+}
+
+// Independent substream number `id`, same parent and id give the same child
+void rsa_drbg_fork(RSA_DRBG *child, const RSA_DRBG *parent, uint64_t id) {
+  uint8_t blk[64];
+  chacha20_block(blk, parent->key, id, FORK_NONCE);
+  rsa_drbg_init(child, blk, 0);
+  memset(blk, 0, sizeof(blk));
+}
+
+void rsa_drbg_clear(RSA_DRBG *g) {
+  memset(g, 0, sizeof(*g));
+}
+
+void rsa_drbg_bytes(RSA_DRBG *g, void *out, size_t len) {
+  uint8_t *p = out;
+  while (len) {
+    size_t n;
+    if (g->pos == RSA_DRBG_BUFSIZE) drbg_refill(g);
+    n = RSA_DRBG_BUFSIZE - g->pos;
+    if (n > len) n = len;
+    memcpy(p, g->buf + g->pos, n);
+    memset(g->buf + g->pos, 0, n); // handed out bytes do not stay in the state
+    g->pos += n;
+    p += n;
+    len -= n;
+  }
+}
+
+// Same contract as mpz_urandomb: uniform in [0, 2 ^ bits)
+void rsa_drbg_urandomb(mpz_t rop, RSA_DRBG *g, mp_bitcnt_t bits) {
+  const mp_size_t n = (bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+  mp_limb_t *rp;
+  mp_size_t len = n;
+  if (n == 0) {
+    mpz_set_ui(rop, 0);
+    return;
+  }
+  rp = mpz_limbs_write(rop, n);
+  rsa_drbg_bytes(g, rp, n * sizeof(mp_limb_t));
+  if (bits % GMP_NUMB_BITS) rp[n - 1] &= ((mp_limb_t)1 << (bits % GMP_NUMB_BITS)) - 1;
+  while (len > 0 && rp[len - 1] == 0) --len;
+  mpz_limbs_finish(rop, len);
+}
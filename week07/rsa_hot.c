@@ -0,0 +1,171 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// Packed private key for the CRT path
+//
+// RSA_PRIKEY is eight mpz_t, each with its own heap block, and mpz_powm
+// rebuilds its Montgomery constants on every call. The hot key holds
+// everything the private operation reads in one 64-byte aligned blob,
+// every part starting on its own cache line:
+//
+//   p, R^2 mod p, R mod p | q, R^2 mod q, R mod q | qi R mod p | dp ops | dq ops
+//
+// qi is kept in Montgomery form, so one Montgomery multiplication of a
+// plain value by it gives the plain product. The exponent plans replace
+// the window tables: the table itself depends on the input and is built
+// on the stack, the schedule that indexes it is the part worth keeping.
+
+#define LINE 64
+
+static size_t line_up(size_t bytes) {
+  return (bytes + LINE - 1) / LINE * LINE;
+}
+
+// Copies a Montgomery context into the blob at *at, m points there after
+static void pack_mont(RSA_MONT *dst, const RSA_MONT *src, uint8_t **at) {
+  const size_t bytes = src->size * sizeof(mp_limb_t);
+  *dst = *src;
+  dst->n   = (mp_limb_t*)*at;
+  dst->rr  = (mp_limb_t*)(*at + line_up(bytes));
+  dst->one = (mp_limb_t*)(*at + 2 * line_up(bytes));
+  memcpy(dst->n, src->n, bytes);
+  memcpy(dst->rr, src->rr, bytes);
+  memcpy(dst->one, src->one, bytes);
+  *at += 3 * line_up(bytes);
+}
+
+static void pack_plan(RSA_EXP_PLAN *dst, const RSA_EXP_PLAN *src, uint8_t **at) {
+  *dst = *src;
+  dst->op = (uint32_t*)*at;
+  memcpy(dst->op, src->op, src->nops * sizeof(uint32_t));
+  *at += line_up(src->nops * sizeof(uint32_t));
+}
+
+// Works with and without NO_RSA_CRT, dp, dq and qi are derived from d
+// (a lean key has no d and brings its own dp and dq)
+int rsa_hotkey_init(RSA_HOTKEY *hk, const RSA_PRIKEY *pri) {
+  RSA_MONT mp, mq;
+  RSA_EXP_PLAN pp, pq;
+  mp_limb_t qi[RSA_MAX_LIMBS];
+  mpz_t t, u;
+  size_t bytes;
+  uint8_t *at;
+  int ret = -1;
+
+  hk->blob = NULL;
+  mp.n = mq.n = NULL;
+  pp.op = pq.op = NULL;
+  mpz_inits(t, u, NULL);
+  if (rsa_mont_init(&mp, pri->p) != 0 || rsa_mont_init(&mq, pri->q) != 0) goto out;
+#ifndef NO_RSA_CRT
+  if (pri->missing & RSA_KEY_D) {
+    // Lean key, dp and dq are there
+    if (rsa_plan_init(&pp, pri->dp) != 0 || rsa_plan_init(&pq, pri->dq) != 0) goto out;
+  } else
+#endif
+  {
+    mpz_sub_ui(u, pri->p, 1);
+    mpz_mod(t, pri->d, u);
+    if (rsa_plan_init(&pp, t) != 0) goto out;
+    mpz_sub_ui(u, pri->q, 1);
+    mpz_mod(t, pri->d, u);
+    if (rsa_plan_init(&pq, t) != 0) goto out;
+  }
+  if (!mpz_invert(t, pri->q, pri->p)) goto out;
+  rsa_mont_to(qi, t, &mp);
+
+  bytes = 3 * line_up(mp.size * sizeof(mp_limb_t)) + 3 * line_up(mq.size * sizeof(mp_limb_t))
+        + line_up(mp.size * sizeof(mp_limb_t))
+        + line_up(pp.nops * sizeof(uint32_t)) + line_up(pq.nops * sizeof(uint32_t));
+  hk->blob = aligned_alloc(LINE, bytes);
+  if (!hk->blob) goto out;
+  hk->bytes = bytes;
+  at = (uint8_t*)hk->blob;
+  pack_mont(&hk->mp, &mp, &at);
+  pack_mont(&hk->mq, &mq, &at);
+  hk->qi = (mp_limb_t*)at;
+  memcpy(hk->qi, qi, mp.size * sizeof(mp_limb_t));
+  at += line_up(mp.size * sizeof(mp_limb_t));
+  pack_plan(&hk->dp, &pp, &at);
+  pack_plan(&hk->dq, &pq, &at);
+  hk->RSA_SIZE = pri->RSA_SIZE;
+  ret = 0;
+out:
+  rsa_mont_clear(&mp);
+  rsa_mont_clear(&mq);
+  rsa_plan_clear(&pp);
+  rsa_plan_clear(&pq);
+  mpz_clears(t, u, NULL);
+  return ret;
+}
+
+void rsa_hotkey_clear(RSA_HOTKEY *hk) {
+  free(hk->blob);
+  hk->blob = NULL;
+}
+
+// rp = x mod m in Montgomery form, x has xn limbs
+static void to_mont(mp_limb_t *rp, const mp_limb_t *xp, mp_size_t xn, const RSA_MONT *m) {
+  mp_limb_t q[RSA_MAX_LIMBS + 1], r[RSA_MAX_LIMBS];
+  const mp_size_t s = m->size;
+  memset(r, 0, s * sizeof(mp_limb_t));
+  if (xn >= s) mpn_tdiv_qr(q, r, 0, xp, xn, m->n, s);
+  else memcpy(r, xp, xn * sizeof(mp_limb_t));
+  rsa_mont_mul(rp, r, m->rr, m);
+}
+
+// rp = a R ^ -1 mod m
+static void from_mont(mp_limb_t *rp, const mp_limb_t *ap, const RSA_MONT *m) {
+  mp_limb_t t[2 * RSA_MAX_LIMBS];
+  memcpy(t, ap, m->size * sizeof(mp_limb_t));
+  memset(t + m->size, 0, m->size * sizeof(mp_limb_t));
+  rsa_mont_redc(rp, t, m);
+}
+
+// out = in ^ d mod n, 0 <= in < n (Garner: y = xq + q * ((xp - xq) qi mod p))
+void rsa_pri_exp_hot(mpz_t out, const mpz_t in, const RSA_HOTKEY *hk) {
+  const RSA_MONT *mp = &hk->mp, *mq = &hk->mq;
+  const mp_size_t ps = mp->size, qs = mq->size, xn = mpz_size(in);
+  const mp_limb_t *xp = mpz_limbs_read(in);
+  mp_limb_t a[RSA_MAX_LIMBS], b[RSA_MAX_LIMBS], h[RSA_MAX_LIMBS], *yp;
+  mp_size_t yn = ps + qs;
+  RSA_STAT_START(t0);
+
+  if (xn == 0) {
+    mpz_set_ui(out, 0);
+    return;
+  }
+  RSA_PERF_BEGIN(RSA_PHASE_REDUCE, hk->RSA_SIZE);
+  to_mont(a, xp, xn, mp);
+  to_mont(b, xp, xn, mq);
+  RSA_PERF_END();
+  RSA_PERF_BEGIN(RSA_PHASE_EXP, hk->RSA_SIZE);
+  rsa_mont_powm_plan_n(a, a, &hk->dp, mp);
+  rsa_mont_powm_plan_n(b, b, &hk->dq, mq);
+  RSA_PERF_END();
+
+  RSA_PERF_BEGIN(RSA_PHASE_RECOMBINE, hk->RSA_SIZE);
+  from_mont(a, a, mp);
+  from_mont(b, b, mq);
+  // h = (xp - xq mod p) qi mod p
+  if (qs > ps || (qs == ps && mpn_cmp(b, mp->n, ps) >= 0)) {
+    mp_limb_t q[RSA_MAX_LIMBS + 1];
+    mpn_tdiv_qr(q, h, 0, b, qs, mp->n, ps);
+  } else {
+    memset(h, 0, ps * sizeof(mp_limb_t));
+    memcpy(h, b, qs * sizeof(mp_limb_t));
+  }
+  if (mpn_sub_n(h, a, h, ps)) mpn_add_n(h, h, mp->n, ps);
+  rsa_mont_mul(h, h, hk->qi, mp);
+
+  // y = xq + q h < n
+  yp = mpz_limbs_write(out, yn);
+  if (qs >= ps) mpn_mul(yp, mq->n, qs, h, ps);
+  else mpn_mul(yp, h, ps, mq->n, qs);
+  mpn_add(yp, yp, yn, b, qs);
+  while (yn > 0 && yp[yn - 1] == 0) --yn;
+  mpz_limbs_finish(out, yn);
+  RSA_PERF_END();
+  RSA_STAT_STOP(t0, RSA_STAT_PRI_EXP, hk->RSA_SIZE);
+}
@@ -0,0 +1,290 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// Modular inversion
+//
+// rsa_inv_limbs: binary extended GCD on limbs for an odd modulus (Pornin,
+// "Optimized Binary GCD for Modular Inversion", 2020). The inner loop runs
+// INV_K steps of the binary GCD on 64-bit approximations of a and b (low
+// INV_K bits exact, top 33 bits of the longer one), collects them into a
+// 2x2 matrix of small signed factors and then applies the matrix to the
+// full-size a, b and to u, v in one pass each. u and v are divided by
+// 2 ^ INV_K every time (Montgomery style), so a = x * u and b = x * v stay
+// true mod n and v is the inverse once a = 0 and b = 1.
+// It needs no allocation and no mpz, but GMP's mpz_invert (Lehmer and
+// half-GCD in assembly) is still faster on a single value, see inv_speed.c.
+//
+// rsa_inv_batch: Montgomery's trick, one mpz_invert and 3(count - 1)
+// Montgomery multiplications. The inputs are not converted: the prefix
+// products pick up a factor R ^ -1 per step, and the running inverse picks
+// them back up on the way down, so what comes out is the plain inverse.
+
+#define INV_K 31
+#define INV_LOW ((UINT64_C(1) << INV_K) - 1)
+
+void rsa_arena_init(RSA_ARENA *ar) {
+  ar->limbs = NULL;
+  ar->size = 0;
+}
+
+void rsa_arena_clear(RSA_ARENA *ar) {
+  free(ar->limbs);
+  rsa_arena_init(ar);
+}
+
+// Scratch of at least `size` limbs, kept for the next call
+mp_limb_t *rsa_arena_get(RSA_ARENA *ar, size_t size) {
+  if (size > ar->size) {
+    mp_limb_t *p = realloc(ar->limbs, size * sizeof(mp_limb_t));
+    if (!p) return NULL;
+    ar->limbs = p;
+    ar->size = size;
+  }
+  return ar->limbs;
+}
+
+// (a, b) = (a f0 + b g0, a f1 + b g1) / 2 ^ INV_K over n limbs, one pass
+// The low INV_K bits of both sums are zero, so every limb is shifted as
+// soon as the next one is known. Returns bit 0 / 1 set if the new a / b
+// came out negative, they are stored as their absolute values.
+static int update_ab(mp_limb_t *ap, mp_limb_t *bp, mp_size_t n,
+                     int64_t f0, int64_t g0, int64_t f1, int64_t g1) {
+  __int128 ca = 0, cb = 0;
+  mp_limb_t la = 0, lb = 0;
+  int neg = 0;
+  for (mp_size_t i = 0; i < n; ++i) {
+    const mp_limb_t x = ap[i], y = bp[i];
+    ca += (__int128)x * f0 + (__int128)y * g0;
+    cb += (__int128)x * f1 + (__int128)y * g1;
+    if (i > 0) {
+      ap[i - 1] = la >> INV_K | (mp_limb_t)ca << (GMP_NUMB_BITS - INV_K);
+      bp[i - 1] = lb >> INV_K | (mp_limb_t)cb << (GMP_NUMB_BITS - INV_K);
+    }
+    la = (mp_limb_t)ca;
+    lb = (mp_limb_t)cb;
+    ca >>= GMP_NUMB_BITS;
+    cb >>= GMP_NUMB_BITS;
+  }
+  ap[n - 1] = la >> INV_K | (mp_limb_t)ca << (GMP_NUMB_BITS - INV_K);
+  bp[n - 1] = lb >> INV_K | (mp_limb_t)cb << (GMP_NUMB_BITS - INV_K);
+  // |result| < 2 ^ (64 n), the rest of the carry is only the sign
+  if (ca < 0) {
+    mpn_neg(ap, ap, n);
+    neg |= 1;
+  }
+  if (cb < 0) {
+    mpn_neg(bp, bp, n);
+    neg |= 2;
+  }
+  return neg;
+}
+
+// (u, v) = (u f0 + v g0, u f1 + v g1) / 2 ^ INV_K mod n, ninv = -n ^ -1
+// Montgomery style: a multiple q n (q < 2 ^ INV_K) clears the low bits of
+// each sum, the quotient lands in (-2n, 3n) and is brought into [0, n).
+static void update_uv(mp_limb_t *up, mp_limb_t *vp, const mp_limb_t *np, mp_size_t n,
+                      mp_limb_t ninv, int64_t f0, int64_t g0, int64_t f1, int64_t g1) {
+  __int128 cu = (__int128)up[0] * f0 + (__int128)vp[0] * g0;
+  __int128 cv = (__int128)up[0] * f1 + (__int128)vp[0] * g1;
+  const mp_limb_t qu = ((mp_limb_t)cu * ninv) & INV_LOW, qv = ((mp_limb_t)cv * ninv) & INV_LOW;
+  mp_limb_t lu, lv;
+  int64_t tu, tv;
+  cu += (__int128)qu * np[0];
+  cv += (__int128)qv * np[0];
+  lu = (mp_limb_t)cu;
+  lv = (mp_limb_t)cv;
+  cu >>= GMP_NUMB_BITS;
+  cv >>= GMP_NUMB_BITS;
+  for (mp_size_t i = 1; i < n; ++i) {
+    const mp_limb_t x = up[i], y = vp[i];
+    cu += (__int128)x * f0 + (__int128)y * g0 + (__int128)qu * np[i];
+    cv += (__int128)x * f1 + (__int128)y * g1 + (__int128)qv * np[i];
+    up[i - 1] = lu >> INV_K | (mp_limb_t)cu << (GMP_NUMB_BITS - INV_K);
+    vp[i - 1] = lv >> INV_K | (mp_limb_t)cv << (GMP_NUMB_BITS - INV_K);
+    lu = (mp_limb_t)cu;
+    lv = (mp_limb_t)cv;
+    cu >>= GMP_NUMB_BITS;
+    cv >>= GMP_NUMB_BITS;
+  }
+  up[n - 1] = lu >> INV_K | (mp_limb_t)cu << (GMP_NUMB_BITS - INV_K);
+  vp[n - 1] = lv >> INV_K | (mp_limb_t)cv << (GMP_NUMB_BITS - INV_K);
+  // Top limb, signed and small
+  tu = (int64_t)(cu >> INV_K);
+  tv = (int64_t)(cv >> INV_K);
+  while (tu < 0) tu += mpn_add_n(up, up, np, n);
+  while (tu > 0 || mpn_cmp(up, np, n) >= 0) tu -= mpn_sub_n(up, up, np, n);
+  while (tv < 0) tv += mpn_add_n(vp, vp, np, n);
+  while (tv > 0 || mpn_cmp(vp, np, n) >= 0) tv -= mpn_sub_n(vp, vp, np, n);
+}
+
+// `len` bits (<= 64) of xp starting at bit pos
+static uint64_t get_bits(const mp_limb_t *xp, mp_size_t n, long pos, int len) {
+  const mp_size_t i = pos / GMP_NUMB_BITS;
+  const int sh = pos % GMP_NUMB_BITS;
+  uint64_t r = xp[i] >> sh;
+  if (sh && i + 1 < n) r |= xp[i + 1] << (GMP_NUMB_BITS - sh);
+  return len < 64 ? r & ((UINT64_C(1) << len) - 1) : r;
+}
+
+// rp = a ^ -1 mod n, n odd, a < n, all of n limbs
+// -1 if gcd(a, n) != 1
+int rsa_inv_limbs(mp_limb_t *rp, const mp_limb_t *ap, const mp_limb_t *np, mp_size_t n) {
+  mp_limb_t a[RSA_MAX_LIMBS], b[RSA_MAX_LIMBS], u[RSA_MAX_LIMBS], v[RSA_MAX_LIMBS], ninv;
+  mp_size_t an = n; // limbs of max(a, b), only shrinks
+  long limit;
+
+  if (n <= 0 || n > RSA_MAX_LIMBS || !(np[0] & 1)) return -1;
+  // Every outer step takes INV_K bits off len(a) + len(b) <= 2 len(n)
+  limit = (2 * (long)n * GMP_NUMB_BITS + INV_K - 1) / INV_K + 1;
+  ninv = np[0];
+  for (int i = 0; i < 6; ++i) ninv *= 2 - np[0] * ninv;
+  ninv = -ninv;
+  memcpy(a, ap, n * sizeof(mp_limb_t));
+  memcpy(b, np, n * sizeof(mp_limb_t));
+  memset(u, 0, n * sizeof(mp_limb_t));
+  memset(v, 0, n * sizeof(mp_limb_t));
+  u[0] = 1;
+
+  for (long it = 0; it < limit; ++it) {
+    uint64_t xa, xb, f0 = 1, g0 = 0, f1 = 0, g1 = 1;
+    int neg;
+    while (an > 0 && (a[an - 1] | b[an - 1]) == 0) --an;
+    if (mpn_zero_p(a, an)) break;
+    if (an == 1) {
+      xa = a[0];
+      xb = b[0];
+    } else {
+      const long len = an * GMP_NUMB_BITS - __builtin_clzll(a[an - 1] | b[an - 1]);
+      xa = get_bits(a, an, len - 33, 33) << INV_K | (a[0] & INV_LOW);
+      xb = get_bits(b, an, len - 33, 33) << INV_K | (b[0] & INV_LOW);
+    }
+    // Branch-free: the swap and the subtraction are masked in, the
+    // direction of each step is a coin toss for the branch predictor
+    for (int i = 0; i < INV_K; ++i) {
+      const uint64_t odd = -(xa & 1), swap = odd & -(uint64_t)(xa < xb);
+      uint64_t t = (xa ^ xb) & swap;
+      xa ^= t;
+      xb ^= t;
+      t = (f0 ^ f1) & swap;
+      f0 ^= t;
+      f1 ^= t;
+      t = (g0 ^ g1) & swap;
+      g0 ^= t;
+      g1 ^= t;
+      xa -= xb & odd;
+      f0 -= f1 & odd;
+      g0 -= g1 & odd;
+      xa >>= 1;
+      f1 <<= 1;
+      g1 <<= 1;
+    }
+    neg = update_ab(a, b, an, (int64_t)f0, (int64_t)g0, (int64_t)f1, (int64_t)g1);
+    if (neg & 1) f0 = -f0, g0 = -g0;
+    if (neg & 2) f1 = -f1, g1 = -g1;
+    update_uv(u, v, np, n, ninv, (int64_t)f0, (int64_t)g0, (int64_t)f1, (int64_t)g1);
+  }
+
+  // b = gcd(a, n)
+  if (!mpn_zero_p(a, n) || b[0] != 1 || (n > 1 && !mpn_zero_p(b + 1, n - 1))) return -1;
+  memcpy(rp, v, n * sizeof(mp_limb_t));
+  return 0;
+}
+
+// rop = a ^ -1 mod n, -1 if there is none
+// Odd moduli go through rsa_inv_limbs, even ones through mpz_invert.
+int rsa_invert(mpz_t rop, const mpz_t a, const mpz_t n) {
+  mp_limb_t x[RSA_MAX_LIMBS], y[RSA_MAX_LIMBS], *rp;
+  const mp_size_t s = mpz_size(n);
+  mpz_t r;
+
+  if (mpz_even_p(n) || mpz_cmp_ui(n, 1) <= 0 || s > RSA_MAX_LIMBS) {
+    return mpz_invert(rop, a, n) ? 0 : -1;
+  }
+  mpz_init(r);
+  mpz_mod(r, a, n);
+  memset(x, 0, s * sizeof(mp_limb_t));
+  memcpy(x, mpz_limbs_read(r), mpz_size(r) * sizeof(mp_limb_t));
+  mpz_clear(r);
+  memcpy(y, mpz_limbs_read(n), s * sizeof(mp_limb_t)); // rop may be n
+  rp = mpz_limbs_write(rop, s);
+  if (rsa_inv_limbs(rp, x, y, s) != 0) {
+    mpz_limbs_finish(rop, 0);
+    return -1;
+  }
+  mpz_limbs_finish(rop, s);
+  return 0;
+}
+
+// rop[i] = a[i] ^ -1 mod n for every i, rop[i] may be a[i]
+// -1 if any a[i] has no inverse (rop is left untouched). The arena may be
+// NULL, then the scratch is allocated for this call only.
+int rsa_inv_batch(mpz_ptr *rop, mpz_srcptr *a, int count, const RSA_MONT *m, RSA_ARENA *ar) {
+  const mp_size_t s = m->size;
+  RSA_ARENA tmp;
+  mp_limb_t *x, *c, inv[RSA_MAX_LIMBS], t[RSA_MAX_LIMBS];
+  int ret = -1;
+
+  if (count <= 0) return 0;
+  if (!ar) {
+    rsa_arena_init(&tmp);
+    ar = &tmp;
+  }
+  // x[i] = a[i] mod n, c[i] = x[0] ... x[i] * R ^ -i
+  x = rsa_arena_get(ar, 2 * (size_t)count * s);
+  if (!x) goto out;
+  c = x + (size_t)count * s;
+  for (int i = 0; i < count; ++i) {
+    mp_limb_t *xi = x + (size_t)i * s;
+    mpz_t n;
+    mpz_roinit_n(n, m->n, s); // a lazy context has a zero top limb
+    memset(xi, 0, s * sizeof(mp_limb_t));
+    if (mpz_sgn(a[i]) >= 0 && mpz_cmp(a[i], n) < 0) {
+      memcpy(xi, mpz_limbs_read(a[i]), mpz_size(a[i]) * sizeof(mp_limb_t));
+    } else {
+      mpz_t r;
+      mpz_init(r);
+      mpz_mod(r, a[i], n);
+      memcpy(xi, mpz_limbs_read(r), mpz_size(r) * sizeof(mp_limb_t));
+      mpz_clear(r);
+    }
+    if (i == 0) memcpy(c, xi, s * sizeof(mp_limb_t));
+    else rsa_mont_mul(c + (size_t)i * s, c + (size_t)(i - 1) * s, xi, m);
+  }
+
+  // inv = c[count - 1] ^ -1 = (x[0] ... x[i]) ^ -1 * R ^ i with i = count - 1,
+  // then each step down: x[i] ^ -1 = c[i - 1] * inv * R ^ -1, and
+  // inv * x[i] * R ^ -1 has the form above for i - 1
+  // (mpz_invert: GMP's Lehmer / half-GCD beats rsa_inv_limbs on one value)
+  {
+    mpz_t cn, n, r;
+    int ok;
+    mpz_roinit_n(cn, c + (size_t)(count - 1) * s, s);
+    mpz_roinit_n(n, m->n, s);
+    mpz_init(r);
+    ok = mpz_invert(r, cn, n);
+    memset(inv, 0, s * sizeof(mp_limb_t));
+    memcpy(inv, mpz_limbs_read(r), mpz_size(r) * sizeof(mp_limb_t));
+    mpz_clear(r);
+    if (!ok) goto out;
+  }
+  for (int i = count - 1; i > 0; --i) {
+    rsa_mont_mul(t, c + (size_t)(i - 1) * s, inv, m);
+    rsa_mont_mul(inv, inv, x + (size_t)i * s, m);
+    memcpy(c + (size_t)i * s, t, s * sizeof(mp_limb_t));
+  }
+  memcpy(c, inv, s * sizeof(mp_limb_t));
+  // rop may alias a, so nothing is written before every inverse is known
+  for (int i = 0; i < count; ++i) {
+    mp_size_t k = s;
+    mp_limb_t *ci = c + (size_t)i * s;
+    if (m->lazy) rsa_mont_norm(ci, m);
+    while (k > 0 && ci[k - 1] == 0) --k;
+    memcpy(mpz_limbs_write(rop[i], s), ci, s * sizeof(mp_limb_t));
+    mpz_limbs_finish(rop[i], k);
+  }
+  ret = 0;
+out:
+  if (ar == &tmp) rsa_arena_clear(&tmp);
+  return ret;
+}
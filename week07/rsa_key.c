@@ -1,8 +1,9 @@
+#include <limits.h>
+
 #include "rsa.h"
 
 // Pre-declared
 #define RSA_SIZE_MULTIPLER 1024
-#define MAX_RSA_SIZE       4096
 
 // -1 is for unsupported rsa size
 const static int RSA_MR_ITER[MAX_RSA_SIZE / RSA_SIZE_MULTIPLER + 1][2] = {
@@ -10,99 +11,303 @@ const static int RSA_MR_ITER[MAX_RSA_SIZE / RSA_SIZE_MULTIPLER + 1][2] = {
   {-1, -1}, // 1024
   {56, 56}, // 2048
   {-1, -1}, // 3072
-  {-1, -1}, // 4096
+  {56, 56}, // 4096
+  {-1, -1}, {-1, -1}, {-1, -1},
+  {56, 56}, // 8192
+  {-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}, {-1, -1},
+  {56, 56}, // 15360
+  {56, 56}, // 16384
 };
 
+// Random source of the prime search
+typedef struct __RAND_SRC {
+  void (*urandomb)(mpz_t, void*, mp_bitcnt_t);
+  void *ctx;
+} RAND_SRC;
+
+static void gmp_urandomb(mpz_t rop, void *ctx, mp_bitcnt_t bits) {
+  mpz_urandomb(rop, (__gmp_randstate_struct*)ctx, bits);
+}
+
+static void drbg_urandomb(mpz_t rop, void *ctx, mp_bitcnt_t bits) {
+  rsa_drbg_urandomb(rop, (RSA_DRBG*)ctx, bits);
+}
+
+// Odd primes below 256
+static const uint8_t SMALL_PRIMES[] = {
+    3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,  53,  59,
+   61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113, 127, 131, 137,
+  139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223, 227,
+  229, 233, 239, 241, 251,
+};
+
+// 0 if p > 251 has a factor in SMALL_PRIMES
+// One mpz_fdiv_ui per product of primes that fits in a limb, then word
+// divisions: about 80% of odd candidates die here, before a modular
+// exponentiation in mpz_millerrabin.
+static int sieve_pass(const mpz_t p) {
+  const int count = sizeof(SMALL_PRIMES);
+  for (int i = 0; i < count;) {
+    unsigned long prod = 1, r;
+    int j = i;
+    while (j < count && prod <= ~0UL / 251) prod *= SMALL_PRIMES[j++];
+    r = mpz_fdiv_ui(p, prod);
+    for (; i < j; ++i) {
+      if (r % SMALL_PRIMES[i] == 0) return 0;
+    }
+  }
+  return 1;
+}
+
 // Helper function
-static void prime_gen(mpz_t p, int psize, int mriter, gmp_randstate_t rnd){
+// The sieve phase spans the whole search, Miller-Rabin nests inside it, so
+// candidates that die in the sieve cost no counter reads.
+static void prime_gen(mpz_t p, int psize, int mriter, const RAND_SRC *rnd){
+  RSA_PERF_BEGIN(RSA_PHASE_SIEVE, 2 * psize);
   for (;;) {
-    mpz_urandomb(p, rnd, psize);
+    int pass;
+    rnd->urandomb(p, rnd->ctx, psize);
     mpz_setbit(p, 0);         // odd
     mpz_setbit(p, psize - 1); // p >= 2 ^ (psize - 1)
-    if (mpz_millerrabin(p, mriter) != 0) break;
+    RSA_STAT_ADD(RSA_CNT_CANDIDATES, 1);
+    if (!sieve_pass(p)) {
+      RSA_STAT_ADD(RSA_CNT_SIEVE_REJECTED, 1);
+      continue;
+    }
+    RSA_PERF_BEGIN(RSA_PHASE_MR, 2 * psize);
+    pass = mpz_millerrabin(p, mriter);
+    RSA_PERF_END();
+    if (pass != 0) break;
+    // Almost every composite dies in the first round
+    RSA_STAT_ADD(RSA_CNT_MR_REJECTED, 1);
+    RSA_STAT_ADD(RSA_CNT_MR_ROUNDS, 1);
   }
+  RSA_PERF_END();
+  RSA_STAT_ADD(RSA_CNT_MR_ROUNDS, mriter);
 }
 
+// Either key may be NULL
 void rsa_key_init(RSA_PUBKEY *pub, RSA_PRIKEY *pri) {
-  // pubkey
-  mpz_inits(pub->n, pub->e, NULL);
-  pub->RSA_SIZE = 0;
-  // prikey
-  mpz_inits(pri->p, pri->q, pri->d, pri->n, pri->e, NULL);
-  pri->RSA_SIZE = 0;
+  if (pub) {
+    mpz_inits(pub->n, pub->e, NULL);
+    pub->RSA_SIZE = 0;
+    pub->mont.n = NULL;
+    pub->plan.op = NULL;
+  }
+  if (pri) {
+    mpz_inits(pri->p, pri->q, pri->d, pri->n, pri->e, NULL);
+    pri->RSA_SIZE = 0;
+    pri->missing = 0;
 #ifndef NO_RSA_CRT
-  mpz_inits(pri->dp, pri->dq, pri->qi, NULL);
+    mpz_inits(pri->dp, pri->dq, pri->qi, NULL);
 #endif
+  }
 }
 
 void rsa_key_clear(RSA_PUBKEY *pub, RSA_PRIKEY *pri) {
-  // pubkey
-  mpz_clears(pub->n, pub->e, NULL);
-  // prikey
-  mpz_clears(pri->p, pri->q, pri->d, pri->n, pri->e, NULL);
+  if (pub) {
+    mpz_clears(pub->n, pub->e, NULL);
+    rsa_mont_clear(&pub->mont);
+    rsa_plan_clear(&pub->plan);
+  }
+  if (pri) {
+    mpz_clears(pri->p, pri->q, pri->d, pri->n, pri->e, NULL);
 #ifndef NO_RSA_CRT
-  mpz_clears(pri->dp, pri->dq, pri->qi, NULL);
+    mpz_clears(pri->dp, pri->dq, pri->qi, NULL);
 #endif
+  }
 }
 
-int rsa_key_gen(RSA_PUBKEY *pub, RSA_PRIKEY *pri, int size, gmp_randstate_t rnd) {
+// Montgomery context and exponent plan of a loaded public key
+// Call again after changing n or e by hand.
+int rsa_key_plan(RSA_PUBKEY *pub) {
+  rsa_mont_clear(&pub->mont);
+  rsa_plan_clear(&pub->plan);
+  if (rsa_mont_init(&pub->mont, pub->n) != 0) return -1;
+  if (rsa_plan_init(&pub->plan, pub->e) != 0) {
+    rsa_mont_clear(&pub->mont);
+    return -1;
+  }
+  return 0;
+}
+
+// a ^ -1 mod m for one-limb numbers, 0 if there is none
+static unsigned long inv_word(unsigned long a, unsigned long m) {
+  long r0 = (long)m, r1 = (long)(a % m), t0 = 0, t1 = 1;
+  while (r1) {
+    const long k = r0 / r1, r = r0 - k * r1, t = t0 - k * t1;
+    r0 = r1; r1 = r;
+    t0 = t1; t1 = t;
+  }
+  if (r0 != 1) return 0;
+  return (unsigned long)(t0 < 0 ? t0 + (long)m : t0);
+}
+
+// rop = e ^ -1 mod m, 0 if there is none
+// For a one-limb e the extended GCD runs on words: with t = -m ^ -1 mod e,
+// 1 + t m is a multiple of e and rop = (1 + t m) / e < m. Shared by dp, dq
+// and d; a bigger e falls back to mpz_invert.
+static int inv_mod(mpz_t rop, const mpz_t e, const mpz_t m) {
+  unsigned long ev, t;
+  if (!mpz_fits_ulong_p(e) || mpz_cmp_ui(e, 1) <= 0 || mpz_cmp_ui(e, LONG_MAX) > 0) {
+    return mpz_invert(rop, e, m);
+  }
+  ev = mpz_get_ui(e);
+  t = inv_word(mpz_fdiv_ui(m, ev), ev);
+  if (t == 0) return 0;
+  mpz_mul_ui(rop, m, ev - t);
+  mpz_add_ui(rop, rop, 1);
+  mpz_divexact_ui(rop, rop, ev);
+  return 1;
+}
+
+// Both halves of a key from two primes, e = 0x10001, p and q may be the
+// key's own. lean (CRT builds): d = 0, see rsa_key_derive.
+static int key_finish(RSA_PUBKEY *pub, RSA_PRIKEY *pri, const mpz_t p, const mpz_t q, int lean) {
+  mpz_t u, v;
+  int ok = 1;
+  if (mpz_cmp(p, q) == 0 || mpz_cmp_ui(q, 3) < 0 || mpz_cmp_ui(p, 3) < 0
+      || mpz_fdiv_ui(p, 0x10001) == 1 || mpz_fdiv_ui(q, 0x10001) == 1) return -1;
+  mpz_set_ui(pri->e, 0x10001);
+  mpz_set(pri->p, p);
+  mpz_set(pri->q, q);
+  // 1. N := pq
+  mpz_mul(pri->n, pri->p, pri->q);
+  pri->RSA_SIZE = (int)mpz_sizeinbase(pri->n, 2);
+  pri->missing = 0;
+  mpz_inits(u, v, NULL);
+  RSA_PERF_BEGIN(RSA_PHASE_INVERT, pri->RSA_SIZE);
+  mpz_sub_ui(u, pri->p, 1);
+  mpz_sub_ui(v, pri->q, 1);
+#ifndef NO_RSA_CRT
+  // 2. dp := e ^ -1 mod (p - 1)
+  //    dq := e ^ -1 mod (q - 1)
+  //    qi := Inverse[q, p]
+  ok = inv_mod(pri->dp, pri->e, u) && inv_mod(pri->dq, pri->e, v)
+    && mpz_invert(pri->qi, pri->q, pri->p);
+  if (lean) {
+    mpz_set_ui(pri->d, 0); // not a stale one from an earlier key
+    pri->missing = RSA_KEY_D;
+  }
+#else
+  lean = 0;
+#endif
+  // 3. d := Inverse[e, phi(N)]
+  if (!lean) {
+    mpz_mul(u, u, v);
+    ok = ok && inv_mod(pri->d, pri->e, u);
+  }
+  RSA_PERF_END();
+  mpz_clears(u, v, NULL);
+  if (!ok) return -1;
+  // Public key generation
+  // 1. RSA_SIZE, e, n
+  pub->RSA_SIZE = pri->RSA_SIZE;
+  mpz_set(pub->e, pri->e);
+  mpz_set(pub->n, pri->n);
+  // 2. Montgomery context and plan for e
+  return rsa_key_plan(pub);
+}
+
+// 1 if rsa_key_gen makes keys of this size
+int rsa_key_size_ok(int size) {
+  return size > 0 && size <= MAX_RSA_SIZE && size % RSA_SIZE_MULTIPLER == 0
+    && RSA_MR_ITER[size / RSA_SIZE_MULTIPLER][0] != -1
+    && RSA_MR_ITER[size / RSA_SIZE_MULTIPLER][1] != -1;
+}
+
+static int key_gen(RSA_PUBKEY *pub, RSA_PRIKEY *pri, int size, const RAND_SRC *rnd, int lean) {
   int mriter[2];
   mpz_t tmp;
+  RSA_STAT_START(t0);
   // Private key generation
   // 1. RSA_SIZE check
   //    Calculate Miller-Rabin iteration number
   //    e = 0x10001
-  if (size <= 0 || size > MAX_RSA_SIZE || size % RSA_SIZE_MULTIPLER != 0) return -1;
+  if (!rsa_key_size_ok(size)) return -1;
   pri->RSA_SIZE = size;
   mriter[0] = RSA_MR_ITER[size / RSA_SIZE_MULTIPLER][0];
   mriter[1] = RSA_MR_ITER[size / RSA_SIZE_MULTIPLER][1];
-  if (mriter[0] == -1 || mriter[1] == -1) return -1;
   mpz_set_ui(pri->e, 0x10001);
   mpz_init(tmp);
   // 2. Create p, q
-  do {
+  for (;;) {
     // Create p
     for (;;) {
       prime_gen(pri->p, size / 2, mriter[0], rnd);
-      mpz_gcd(tmp, pri->p, pri->e);
-      if (mpz_cmp_ui(tmp, 1) != 0) continue;
+      mpz_sub_ui(tmp, pri->p, 1);
+      mpz_gcd(tmp, tmp, pri->e);
+      if (mpz_cmp_ui(tmp, 1) != 0) {
+        RSA_STAT_ADD(RSA_CNT_GCD_REJECTED, 1);
+        continue;
+      }
       break;
     }
     // Create q
     for (;;) {
       prime_gen(pri->q, size / 2, mriter[1], rnd);
-      mpz_gcd(tmp, pri->q, pri->e);
-      if (mpz_cmp_ui(tmp, 1) != 0) continue;
+      mpz_sub_ui(tmp, pri->q, 1);
+      mpz_gcd(tmp, tmp, pri->e);
+      if (mpz_cmp_ui(tmp, 1) != 0) {
+        RSA_STAT_ADD(RSA_CNT_GCD_REJECTED, 1);
+        continue;
+      }
       if (mpz_cmp(pri->p, pri->q) == 0) continue;
       break;
     }
     // if len(pq) < size, recreate
     mpz_mul(tmp, pri->p, pri->q);
-  } while(mpz_sizeinbase(tmp, 2) == size);
-  // 3. d := Inverse[e, phi(N)]
-  mpz_sub_ui(pri->p, pri->p, 1);
-  mpz_sub_ui(pri->q, pri->q, 1);
-  mpz_mul(tmp, pri->p, pri->q);
-  mpz_invert(pri->d, pri->e, tmp);
-#ifndef NO_RSA_CRT
-  // dp := e ^ -1 mod (p - 1)
-  // dq := e ^ -1 mod (q - 1)
-  mpz_invert(pri->dp, pri->e, pri->p);
-  mpz_invert(pri->dq, pri->e, pri->q);
-#endif
-  mpz_add_ui(pri->p, pri->p, 1);
-  mpz_add_ui(pri->q, pri->q, 1);
-  // 4. N := pq
-  mpz_mul(pri->n, pri->p, pri->q);
+    if (mpz_sizeinbase(tmp, 2) == (size_t)size) break;
+    RSA_STAT_ADD(RSA_CNT_SIZE_RETRY, 1);
+  }
   mpz_clear(tmp);
-#ifndef NO_RSA_CRT
-  // qi := Inverse[q, p]
-  mpz_invert(pri->qi, pri->q, pri->p);
-#endif
-  // Public key generation
-  // 1. RSA_SIZE, e, n
-  pub->RSA_SIZE = pri->RSA_SIZE;
-  mpz_set(pub->e, pri->e);
-  mpz_set(pub->n, pri->n);
+  if (key_finish(pub, pri, pri->p, pri->q, lean) != 0) return -1;
+  RSA_STAT_STOP(t0, RSA_STAT_KEYGEN, size);
   return 0;
 }
+
+// Sizes rsa_key_gen does not make are fine too; -1 if p == q or e divides
+// p - 1 or q - 1
+int rsa_key_from_primes(RSA_PUBKEY *pub, RSA_PRIKEY *pri, const mpz_t p, const mpz_t q) {
+  return key_finish(pub, pri, p, q, 0);
+}
+
+// Same, CRT-only as rsa_key_gen_lean
+int rsa_key_from_primes_lean(RSA_PUBKEY *pub, RSA_PRIKEY *pri, const mpz_t p, const mpz_t q) {
+  return key_finish(pub, pri, p, q, 1);
+}
+
+// Materializes the fields (RSA_KEY_*) the key is missing from p, q and e
+// d is e ^ -1 mod lambda(n) = lcm(p - 1, q - 1), the smallest working d.
+int rsa_key_derive(RSA_PRIKEY *pri, int fields) {
+  mpz_t u, v;
+  int ok;
+  fields &= pri->missing;
+  if (!fields) return 0;
+  mpz_inits(u, v, NULL);
+  mpz_sub_ui(u, pri->p, 1);
+  mpz_sub_ui(v, pri->q, 1);
+  mpz_lcm(u, u, v);
+  ok = inv_mod(pri->d, pri->e, u);
+  mpz_clears(u, v, NULL);
+  if (!ok) return -1;
+  pri->missing &= ~fields;
+  return 0;
+}
+
+int rsa_key_gen(RSA_PUBKEY *pub, RSA_PRIKEY *pri, int size, gmp_randstate_t rnd) {
+  const RAND_SRC src = {gmp_urandomb, rnd};
+  return key_gen(pub, pri, size, &src, 0);
+}
+
+// CRT-only profile: p, q, n, e, dp, dq and qi, d is left for rsa_key_derive
+// Without CRT there is nothing to leave out, same as rsa_key_gen.
+int rsa_key_gen_lean(RSA_PUBKEY *pub, RSA_PRIKEY *pri, int size, gmp_randstate_t rnd) {
+  const RAND_SRC src = {gmp_urandomb, rnd};
+  return key_gen(pub, pri, size, &src, 1);
+}
+
+int rsa_key_gen_drbg(RSA_PUBKEY *pub, RSA_PRIKEY *pri, int size, RSA_DRBG *rnd) {
+  const RAND_SRC src = {drbg_urandomb, rnd};
+  return key_gen(pub, pri, size, &src, 0);
+}
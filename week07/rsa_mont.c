@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// Montgomery multiplication on fixed-size limb vectors
+// Same algorithm as powmod_montgomery in week05, but R = b ^ size with
+// b = 2 ^ GMP_NUMB_BITS, so the reduction is one row per limb (REDC)
+// instead of two full multiplications and a division by a power of two.
+
+#define MONT_WINDOW 4
+
+// rp[0, n) = x, x < b ^ n
+static void limbs_from_mpz(mp_limb_t *rp, mp_size_t n, const mpz_t x) {
+  const mp_size_t xn = mpz_size(x);
+  memcpy(rp, mpz_limbs_read(x), xn * sizeof(mp_limb_t));
+  memset(rp + xn, 0, (n - xn) * sizeof(mp_limb_t));
+}
+
+static void limbs_to_mpz(mpz_t rop, const mp_limb_t *p, mp_size_t n) {
+  mp_limb_t *rp = mpz_limbs_write(rop, n);
+  memcpy(rp, p, n * sizeof(mp_limb_t));
+  while (n > 0 && p[n - 1] == 0) --n;
+  mpz_limbs_finish(rop, n);
+}
+
+// -n ^ -1 mod b, Newton iteration doubles the correct bits each step
+static mp_limb_t limb_neg_inverse(mp_limb_t n0) {
+  mp_limb_t x = n0; // n0 * n0 == 1 mod 8
+  for (int i = 0; i < 6; ++i) x *= 2 - n0 * x;
+  return -x;
+}
+
+// R = b ^ size for a modulus that fits in size limbs
+static int mont_setup(RSA_MONT *m, const mpz_t n, mp_size_t size, int lazy) {
+  mpz_t t;
+  if (mpz_sgn(n) <= 0 || mpz_even_p(n) || size > RSA_MAX_LIMBS) return -1;
+  m->size = size;
+  m->bits = (int)mpz_sizeinbase(n, 2);
+  m->lazy = lazy;
+  m->n   = malloc(3 * m->size * sizeof(mp_limb_t));
+  if (!m->n) return -1;
+  m->rr  = m->n + m->size;
+  m->one = m->rr + m->size;
+  m->ninv = limb_neg_inverse(mpz_getlimbn(n, 0));
+  limbs_from_mpz(m->n, m->size, n);
+
+  mpz_init(t);
+  // one := R mod n
+  mpz_setbit(t, m->size * GMP_NUMB_BITS);
+  mpz_mod(t, t, n);
+  limbs_from_mpz(m->one, m->size, t);
+  // rr := R ^ 2 mod n
+  mpz_set_ui(t, 0);
+  mpz_setbit(t, 2 * m->size * GMP_NUMB_BITS);
+  mpz_mod(t, t, n);
+  limbs_from_mpz(m->rr, m->size, t);
+  mpz_clear(t);
+  return 0;
+}
+
+int rsa_mont_init(RSA_MONT *m, const mpz_t n) {
+  return mont_setup(m, n, mpz_size(n), 0);
+}
+
+// Redundant form: R > 4n, one more limb than n when its top limb has
+// fewer than two free bits. For a, b < 2n, (a b + q n) / R < 2n < R, so
+// REDC drops its final compare and subtraction; values stay in [0, 2n)
+// and rsa_mont_from reduces once on the way out.
+int rsa_mont_init_lazy(RSA_MONT *m, const mpz_t n) {
+  const mp_size_t size = (mp_size_t)((mpz_sizeinbase(n, 2) + 2 + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS);
+  return mont_setup(m, n, size, 1);
+}
+
+void rsa_mont_clear(RSA_MONT *m) {
+  free(m->n);
+  m->n = m->rr = m->one = NULL;
+}
+
+// rp = tp * R ^ -1 mod n, tp has 2 * size limbs and is clobbered
+// tp < n * R gives rp < n, or rp < 2n for a lazy context
+void rsa_mont_redc(mp_limb_t *rp, mp_limb_t *tp, const RSA_MONT *m) {
+  const mp_size_t s = m->size;
+  mp_limb_t cy;
+  // Row i clears limb i. Its carry belongs at limb i + s, park it in the
+  // limb that was just cleared and add all of them at once.
+  for (mp_size_t i = 0; i < s; ++i) {
+    tp[i] = mpn_addmul_1(tp + i, m->n, s, tp[i] * m->ninv);
+  }
+  cy = mpn_add_n(rp, tp + s, tp, s);
+  if (m->lazy) return; // cy == 0, the sum is below 2n < R
+  if (cy || mpn_cmp(rp, m->n, s) >= 0) mpn_sub_n(rp, rp, m->n, s);
+}
+
+// rp = a * b * R ^ -1 mod n, rp may alias a or b
+void rsa_mont_mul(mp_limb_t *rp, const mp_limb_t *ap, const mp_limb_t *bp, const RSA_MONT *m) {
+  mp_limb_t t[2 * RSA_MAX_LIMBS];
+  if (ap == bp) {
+    rsa_mont_sqr(rp, ap, m);
+    return;
+  }
+  mpn_mul_n(t, ap, bp, m->size);
+  rsa_mont_redc(rp, t, m);
+}
+
+// rp = a ^ 2 * R ^ -1 mod n, rp may alias a
+// a_i * a_j and a_j * a_i are the same product, so mpn_sqr computes every
+// cross product once, doubles the sum with a shift and adds the diagonal
+// a_i ^ 2: about (s ^ 2 + s) / 2 limb products instead of s ^ 2.
+void rsa_mont_sqr(mp_limb_t *rp, const mp_limb_t *ap, const RSA_MONT *m) {
+  mp_limb_t t[2 * RSA_MAX_LIMBS];
+  mpn_sqr(t, ap, m->size);
+  rsa_mont_redc(rp, t, m);
+}
+
+// 0 <= a < n
+static int is_reduced(const mpz_t a, const RSA_MONT *m) {
+  const mp_size_t an = mpz_size(a);
+  if (mpz_sgn(a) < 0 || an > m->size) return 0;
+  return an < m->size || mpn_cmp(mpz_limbs_read(a), m->n, an) < 0;
+}
+
+// rp = a * R mod n
+void rsa_mont_to(mp_limb_t *rp, const mpz_t a, const RSA_MONT *m) {
+  mp_limb_t t[RSA_MAX_LIMBS];
+  if (!is_reduced(a, m)) {
+    mpz_t r;
+    mpz_init(r);
+    limbs_to_mpz(r, m->n, m->size);
+    mpz_mod(r, a, r);
+    limbs_from_mpz(t, m->size, r);
+    mpz_clear(r);
+  } else {
+    limbs_from_mpz(t, m->size, a);
+  }
+  rsa_mont_mul(rp, t, m->rr, m);
+}
+
+// rop = a * R ^ -1 mod n
+void rsa_mont_from(mpz_t rop, const mp_limb_t *ap, const RSA_MONT *m) {
+  mp_limb_t t[2 * RSA_MAX_LIMBS];
+  memcpy(t, ap, m->size * sizeof(mp_limb_t));
+  memset(t + m->size, 0, m->size * sizeof(mp_limb_t));
+  rsa_mont_redc(t, t, m);
+  if (m->lazy) rsa_mont_norm(t, m);
+  limbs_to_mpz(rop, t, m->size);
+}
+
+// a in [0, 2n) to [0, n), for values of a lazy context
+void rsa_mont_norm(mp_limb_t *ap, const RSA_MONT *m) {
+  if (mpn_cmp(ap, m->n, m->size) >= 0) mpn_sub_n(ap, ap, m->n, m->size);
+}
+
+static int exp_window(const mpz_t e, mp_bitcnt_t lo, int w) {
+  int d = 0;
+  for (int i = w - 1; i >= 0; --i) d = (d << 1) | mpz_tstbit(e, lo + i);
+  return d;
+}
+
+// rop = base ^ e mod n, fixed 4-bit window
+void rsa_mont_powm(mpz_t rop, const mpz_t base, const mpz_t e, const RSA_MONT *m) {
+  const mp_size_t s = m->size;
+  mp_limb_t tab[(1 << MONT_WINDOW) * RSA_MAX_LIMBS], acc[RSA_MAX_LIMBS];
+  mp_bitcnt_t bits = mpz_sizeinbase(e, 2);
+  mp_bitcnt_t pos;
+
+  if (mpz_sgn(e) == 0) {
+    rsa_mont_from(rop, m->one, m);
+    return;
+  }
+
+  // tab[i] = base ^ i (Montgomery form)
+  memcpy(tab, m->one, s * sizeof(mp_limb_t));
+  rsa_mont_to(tab + s, base, m);
+  for (int i = 2; i < (1 << MONT_WINDOW); ++i) {
+    rsa_mont_mul(tab + i * s, tab + (i - 1) * s, tab + s, m);
+  }
+
+  // Top window is partial
+  pos = (bits - 1) / MONT_WINDOW * MONT_WINDOW;
+  memcpy(acc, tab + exp_window(e, pos, MONT_WINDOW) * s, s * sizeof(mp_limb_t));
+  while (pos > 0) {
+    pos -= MONT_WINDOW;
+    for (int i = 0; i < MONT_WINDOW; ++i) rsa_mont_sqr(acc, acc, m);
+    int d = exp_window(e, pos, MONT_WINDOW);
+    if (d) rsa_mont_mul(acc, acc, tab + d * s, m);
+  }
+  rsa_mont_from(rop, acc, m);
+}
@@ -2,35 +2,55 @@
 
 void rsa_pub_exp(mpz_t out, const mpz_t in, const RSA_PUBKEY *pub) {
   // in^e mod n = out
-  // Case 1. e == 0x10001
-  if (mpz_cmp_ui(pub->e, 0x10001)) {
-    mpz_set(out, in);
+  RSA_STAT_START(t0);
+  if (pub->mont.n) {
+    // Case 1. Precomputed plan (rsa_key_plan)
+    rsa_mont_powm_plan(out, in, &pub->plan, &pub->mont);
+  } else if (mpz_cmp_ui(pub->e, 0x10001) == 0) {
+    // Case 2. e == 0x10001, out may alias in
+    mpz_t t;
+    mpz_init_set(t, in);
     for (int i = 0; i < 16; ++i) {
-      rsa_mul_mod(out, out, out, pub->n);
+      rsa_mul_mod(t, t, t, pub->n);
     }
-    rsa_mul_mod(out, out, in, pub->n);
-    return;
+    rsa_mul_mod(out, t, in, pub->n);
+    mpz_clear(t);
+  } else {
+    // Case 3. General case
+    rsa_powm(out, in, pub->e, pub->n);
   }
-
-  // Case 2. General case
-  mpz_powm(out, in, pub->e, pub->n);
+  RSA_STAT_STOP(t0, RSA_STAT_PUB_EXP, pub->RSA_SIZE);
 }
 
 #ifndef NO_RSA_CRT
 void rsa_pri_exp(mpz_t out, const mpz_t in, const RSA_PRIKEY *pri) {
   mpz_t x, y;
+  RSA_STAT_START(t0);
   mpz_inits(x, y, NULL);
-  mpz_powm(x, in, pri->d, pri->p);
-  mpz_powm(y, in, pri->d, pri->q);
+  RSA_PERF_BEGIN(RSA_PHASE_REDUCE, pri->RSA_SIZE);
+  mpz_mod(x, in, pri->p);
+  mpz_mod(y, in, pri->q);
+  RSA_PERF_END();
+  RSA_PERF_BEGIN(RSA_PHASE_EXP, pri->RSA_SIZE);
+  rsa_powm(x, x, pri->dp, pri->p);
+  rsa_powm(y, y, pri->dq, pri->q);
+  RSA_PERF_END();
 
+  RSA_PERF_BEGIN(RSA_PHASE_RECOMBINE, pri->RSA_SIZE);
   mpz_sub(x, x, y);
   mpz_mul(x, x, pri->qi);
   mpz_addmul(y, x, pri->q);
   mpz_mod(out, y, pri->n);
+  RSA_PERF_END();
   mpz_clears(x, y, NULL);
+  RSA_STAT_STOP(t0, RSA_STAT_PRI_EXP, pri->RSA_SIZE);
 }
 #else
 void rsa_pri_exp(mpz_t out, const mpz_t in, const RSA_PRIKEY *pri) {
-  mpz_powm(out, in, pri->d, pri->n);
+  RSA_STAT_START(t0);
+  RSA_PERF_BEGIN(RSA_PHASE_EXP, pri->RSA_SIZE);
+  rsa_powm(out, in, pri->d, pri->n);
+  RSA_PERF_END();
+  RSA_STAT_STOP(t0, RSA_STAT_PRI_EXP, pri->RSA_SIZE);
 }
 #endif
@@ -0,0 +1,193 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// Simultaneous multi-exponentiation, rop = b_0 ^ e_0 * ... * b_{k-1} ^ e_{k-1} mod n
+//
+// All k exponents are scanned together from the top bit, so the squarings
+// are shared and only the multiplications grow with k. Two schedules, the
+// cheaper one (by counting) is used:
+//   joint (Shamir): fixed w-bit windows over all exponents at once, one
+//     table of every product b_0 ^ d_0 * ... * b_{k-1} ^ d_{k-1}, 2 ^ (kw)
+//     entries, so each window costs one multiplication for all k bases.
+//     Wins for small k and short exponents.
+//   interleaved (Straus / Moller): a sliding window per exponent with its
+//     own odd-power table, a base is multiplied in where its window ends.
+//     Wins for long exponents, the tables stay linear in k.
+
+#define JOINT_MAX_BITS 6 // k * w, table of 64 entries
+#define INTER_MAX_WINDOW 6
+
+// Interleaved state of one exponent: the next bit to scan, and the open
+// window that is due to be multiplied in at bit `due`
+typedef struct __WINDOW {
+  long next, due;
+  int w, digit;
+} WINDOW;
+
+// Multiplications of a joint schedule with window w (squarings are the same)
+static long joint_cost(const mpz_srcptr *e, int k, int w, long bits) {
+  long windows = (bits + w - 1) / w, cost = (1L << (k * w)) - 1 - k;
+  // A window is skipped only when every digit is zero
+  for (long pos = 0; pos < windows; ++pos) {
+    int nz = 0;
+    for (int i = 0; i < k && !nz; ++i) {
+      for (int b = 0; b < w && !nz; ++b) nz = mpz_tstbit(e[i], pos * w + b);
+    }
+    cost += nz;
+  }
+  return cost;
+}
+
+// Multiplications of a sliding window of width w on e, table included
+static long window_cost(const mpz_t e, int w) {
+  long i = (long)mpz_sizeinbase(e, 2) - 1, cost = w > 1 ? 1L << (w - 1) : 0;
+  while (i >= 0) {
+    long j;
+    if (!mpz_tstbit(e, i)) {
+      --i;
+      continue;
+    }
+    j = i - w + 1 > 0 ? i - w + 1 : 0;
+    while (!mpz_tstbit(e, j)) ++j;
+    ++cost;
+    i = j - 1;
+  }
+  return cost;
+}
+
+// d = w-bit digit of e at bit `pos`
+static int digit_at(const mpz_t e, long pos, int w) {
+  int d = 0;
+  for (int b = w - 1; b >= 0; --b) d = d << 1 | mpz_tstbit(e, pos + b);
+  return d;
+}
+
+static void joint_powm(mp_limb_t *acc, const mpz_srcptr *base, const mpz_srcptr *e,
+                       int k, int w, long bits, mp_limb_t *tab, const RSA_MONT *m) {
+  const mp_size_t s = m->size;
+  const int entries = 1 << (k * w);
+  const long windows = (bits + w - 1) / w;
+  int started = 0;
+
+  // tab[idx], idx = d_0 | d_1 << w | ...; one multiplication per entry by
+  // lowering the first nonzero digit
+  memcpy(tab, m->one, s * sizeof(mp_limb_t));
+  for (int i = 0; i < k; ++i) rsa_mont_to(tab + ((mp_size_t)1 << (i * w)) * s, base[i], m);
+  for (int idx = 1; idx < entries; ++idx) {
+    int i = 0;
+    while (((idx >> (i * w)) & ((1 << w) - 1)) == 0) ++i;
+    if (idx == 1 << (i * w)) continue; // the base itself
+    rsa_mont_mul(tab + idx * s, tab + (idx - (1 << (i * w))) * s, tab + ((mp_size_t)1 << (i * w)) * s, m);
+  }
+
+  for (long pos = windows - 1; pos >= 0; --pos) {
+    int idx = 0;
+    for (int i = 0; i < k; ++i) idx |= digit_at(e[i], pos * w, w) << (i * w);
+    if (started) {
+      for (int b = 0; b < w; ++b) rsa_mont_sqr(acc, acc, m);
+      if (idx) rsa_mont_mul(acc, acc, tab + idx * s, m);
+    } else if (idx) {
+      memcpy(acc, tab + idx * s, s * sizeof(mp_limb_t));
+      started = 1;
+    }
+  }
+  if (!started) memcpy(acc, m->one, s * sizeof(mp_limb_t));
+}
+
+static void inter_powm(mp_limb_t *acc, const mpz_srcptr *base, const mpz_srcptr *e,
+                       int k, long bits, mp_limb_t *tab, WINDOW *win, const RSA_MONT *m) {
+  const mp_size_t s = m->size, stride = (mp_size_t)1 << (INTER_MAX_WINDOW - 1);
+  int started = 0;
+
+  // tab[i][j] = base_i ^ (2j + 1)
+  for (int i = 0; i < k; ++i) {
+    mp_limb_t *t = tab + i * stride * s, sq[RSA_MAX_LIMBS];
+    rsa_mont_to(t, base[i], m);
+    if (win[i].w > 1) rsa_mont_sqr(sq, t, m);
+    for (int j = 1; j < 1 << (win[i].w - 1); ++j) rsa_mont_mul(t + j * s, t + (j - 1) * s, sq, m);
+    win[i].next = (long)mpz_sizeinbase(e[i], 2) - 1;
+    if (mpz_sgn(e[i]) == 0) win[i].next = -1;
+    win[i].due = -1;
+  }
+
+  for (long pos = bits - 1; pos >= 0; --pos) {
+    if (started) rsa_mont_sqr(acc, acc, m);
+    for (int i = 0; i < k; ++i) {
+      WINDOW *x = &win[i];
+      if (x->next == pos && mpz_tstbit(e[i], pos)) {
+        // Open the window [j, pos], it is multiplied in at bit j so the
+        // squarings in between are the shared ones
+        long j = pos - x->w + 1 > 0 ? pos - x->w + 1 : 0;
+        while (!mpz_tstbit(e[i], j)) ++j;
+        x->digit = 0;
+        for (long b = pos; b >= j; --b) x->digit = x->digit << 1 | mpz_tstbit(e[i], b);
+        x->due = j;
+      } else if (x->next == pos) {
+        x->next = pos - 1;
+      }
+      if (x->due != pos) continue;
+      if (started) rsa_mont_mul(acc, acc, tab + (i * stride + x->digit / 2) * s, m);
+      else memcpy(acc, tab + (i * stride + x->digit / 2) * s, s * sizeof(mp_limb_t));
+      started = 1;
+      x->next = pos - 1;
+      x->due = -1;
+    }
+  }
+  if (!started) memcpy(acc, m->one, s * sizeof(mp_limb_t));
+}
+
+// -1 on a negative exponent or no memory
+int rsa_mont_multi_powm(mpz_t rop, const mpz_srcptr *base, const mpz_srcptr *e, int k,
+                        const RSA_MONT *m) {
+  const mp_size_t s = m->size;
+  mp_limb_t acc[RSA_MAX_LIMBS], *tab;
+  long bits = 0, best_joint = -1, inter = 0;
+  int jw = 0;
+  WINDOW *win;
+
+  if (k <= 0) {
+    mpz_set_ui(rop, 1);
+    return 0;
+  }
+  for (int i = 0; i < k; ++i) {
+    if (mpz_sgn(e[i]) < 0) return -1;
+    if ((long)mpz_sizeinbase(e[i], 2) > bits) bits = mpz_sizeinbase(e[i], 2);
+  }
+
+  win = malloc(k * sizeof(WINDOW));
+  if (!win) return -1;
+  // Cheapest window per exponent for the interleaved schedule
+  for (int i = 0; i < k; ++i) {
+    long c = -1;
+    for (int ww = 1; ww <= INTER_MAX_WINDOW; ++ww) {
+      const long cw = window_cost(e[i], ww);
+      if (c < 0 || cw < c) {
+        c = cw;
+        win[i].w = ww;
+      }
+    }
+    inter += c;
+  }
+  // Cheapest joint window, if any fits
+  for (int ww = 1; k * ww <= JOINT_MAX_BITS; ++ww) {
+    const long c = joint_cost(e, k, ww, bits);
+    if (best_joint < 0 || c < best_joint) {
+      best_joint = c;
+      jw = ww;
+    }
+  }
+
+  if (best_joint >= 0 && best_joint <= inter) {
+    tab = malloc(((size_t)1 << (k * jw)) * s * sizeof(mp_limb_t));
+    if (tab) joint_powm(acc, base, e, k, jw, bits, tab, m);
+  } else {
+    tab = malloc((size_t)k * (1 << (INTER_MAX_WINDOW - 1)) * s * sizeof(mp_limb_t));
+    if (tab) inter_powm(acc, base, e, k, bits, tab, win, m);
+  }
+  free(win);
+  if (!tab) return -1;
+  free(tab);
+  rsa_mont_from(rop, acc, m);
+  return 0;
+}
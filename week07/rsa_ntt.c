@@ -0,0 +1,405 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// Number-theoretic transform multiplication for very large moduli
+//
+// The limbs of a and b are the coefficients: the product is the cyclic
+// convolution of length N = 2 ^ log >= 2 * size, done modulo three primes
+// k 2 ^ e + 1 below 2 ^ 62 and put back together by CRT. A coefficient is
+// at most size * 2 ^ 128, well below the product of the primes (~2 ^ 184),
+// so the CRT gives it exactly and a carry pass turns the coefficients back
+// into limbs.
+//
+// A Montgomery multiplication is three products: T = a b, m = T n' mod R
+// and m n. The forward transforms of n and n' = -n ^ -1 mod R are kept in
+// the context, those of the window table in rsa_ntt_powm, so a squaring is
+// three forward and three inverse transforms (per prime), and a
+// multiplication by a table entry is too.
+//
+// Butterflies follow Harvey: values stay in [0, 2p), twiddle products use
+// Shoup's precomputed quotient. Pointwise products are Montgomery products
+// modulo p (R = 2 ^ 64), the 2 ^ -64 they leave is folded into the 1 / N
+// scaling of the inverse transform.
+
+#define NTT_PRIMES 3
+
+typedef unsigned __int128 u128;
+
+static const uint64_t NTT_P[NTT_PRIMES] = {
+  4179340454199820289ULL, // 29 * 2 ^ 57 + 1
+  2485986994308513793ULL, // 69 * 2 ^ 55 + 1
+  1945555039024054273ULL, // 27 * 2 ^ 56 + 1
+};
+static const uint64_t NTT_G[NTT_PRIMES] = {3, 5, 5}; // primitive roots
+
+#define NTT_MAX_LOG 55
+
+// Per-prime constants, one set per context
+typedef struct __NTT_PRIME {
+  uint64_t p, pinv;     // -p ^ -1 mod 2 ^ 64
+  uint64_t oneq;        // floor(2 ^ 64 / p), reduces a limb to [0, 2p)
+  uint64_t scale, scaleq; // 2 ^ 64 / N mod p, Shoup quotient
+} NTT_PRIME;
+
+struct __RSA_NTT_TABLES {
+  NTT_PRIME prime[NTT_PRIMES];
+  uint64_t p12lo, p12hi;  // p1 p2
+  uint64_t i12, i123;     // p1 ^ -1 mod p2, (p1 p2) ^ -1 mod p3, times 2 ^ 64
+  uint64_t p1m3;          // p1 2 ^ 64 mod p3
+};
+
+static uint64_t mul_mod(uint64_t a, uint64_t b, uint64_t p) {
+  return (uint64_t)((u128)a * b % p);
+}
+
+static uint64_t pow_mod(uint64_t a, uint64_t e, uint64_t p) {
+  uint64_t r = 1;
+  for (; e; e >>= 1) {
+    if (e & 1) r = mul_mod(r, a, p);
+    a = mul_mod(a, a, p);
+  }
+  return r;
+}
+
+// a w mod p in [0, 2p) for any a < 2 ^ 64, wq = floor(w 2 ^ 64 / p)
+static inline uint64_t shoup(uint64_t a, uint64_t w, uint64_t wq, uint64_t p) {
+  const uint64_t q = (uint64_t)(((u128)a * wq) >> 64);
+  return a * w - q * p;
+}
+
+static inline uint64_t shoup_q(uint64_t w, uint64_t p) {
+  return (uint64_t)(((u128)w << 64) / p);
+}
+
+// a b 2 ^ -64 mod p in [0, 2p) for a, b < 2p
+static inline uint64_t mont(uint64_t a, uint64_t b, const NTT_PRIME *q) {
+  const u128 t = (u128)a * b;
+  const uint64_t m = (uint64_t)t * q->pinv;
+  return (uint64_t)((t + (u128)m * q->p) >> 64);
+}
+
+// Decimation in frequency, natural order in, bit-reversed order out
+static void ntt_fwd(uint64_t *a, const uint64_t *rt, const uint64_t *rtq, size_t n, uint64_t p) {
+  const uint64_t p2 = 2 * p;
+  for (size_t h = n / 2; h >= 1; h /= 2) {
+    for (size_t k = 0; k < n; k += 2 * h) {
+      uint64_t *x = a + k, *y = a + k + h;
+      for (size_t j = 0; j < h; ++j) {
+        const uint64_t u = x[j], v = y[j];
+        const uint64_t s = u + v;
+        x[j] = s >= p2 ? s - p2 : s;
+        y[j] = shoup(u - v + p2, rt[h + j], rtq[h + j], p);
+      }
+    }
+  }
+}
+
+// Decimation in time with inverse roots, bit-reversed in, natural out,
+// not yet divided by n
+static void ntt_inv(uint64_t *a, const uint64_t *rt, const uint64_t *rtq, size_t n, uint64_t p) {
+  const uint64_t p2 = 2 * p;
+  for (size_t h = 1; h < n; h *= 2) {
+    for (size_t k = 0; k < n; k += 2 * h) {
+      uint64_t *x = a + k, *y = a + k + h;
+      for (size_t j = 0; j < h; ++j) {
+        const uint64_t u = x[j], t = shoup(y[j], rt[h + j], rtq[h + j], p);
+        const uint64_t s = u + t, d = u - t + p2;
+        x[j] = s >= p2 ? s - p2 : s;
+        y[j] = d >= p2 ? d - p2 : d;
+      }
+    }
+  }
+}
+
+// Twiddles of prime i: roots, their quotients, inverse roots, quotients
+// rt[h + j] = w_2h ^ j for h = 1, 2, 4, ... N / 2
+static const uint64_t *twiddle(const RSA_NTT *c, int i, int inverse) {
+  return c->tw + ((size_t)(4 * i + 2 * inverse) << c->log);
+}
+
+// -1 unless n is odd and > 1
+int rsa_ntt_init(RSA_NTT *c, const mpz_t n) {
+  struct __RSA_NTT_TABLES *tb;
+  mpz_t r, ni;
+  size_t len;
+  mp_size_t s;
+  int log = 1;
+
+  c->tw = c->nhat = c->nihat = NULL;
+  c->tables = NULL;
+  if (mpz_cmp_ui(n, 1) <= 0 || mpz_even_p(n)) return -1;
+  s = mpz_size(n);
+  while (((size_t)1 << log) < (size_t)(2 * s)) ++log;
+  if (log > NTT_MAX_LOG) return -1;
+  len = (size_t)1 << log;
+
+  mpz_init_set(c->n, n);
+  c->size = s;
+  c->log = log;
+  c->tables = tb = malloc(sizeof(*tb));
+  c->tw = malloc(4 * NTT_PRIMES * len * sizeof(uint64_t));
+  c->nhat = malloc(NTT_PRIMES * len * sizeof(uint64_t));
+  c->nihat = malloc(NTT_PRIMES * len * sizeof(uint64_t));
+  if (!tb || !c->tw || !c->nhat || !c->nihat) {
+    rsa_ntt_clear(c);
+    return -1;
+  }
+
+  for (int i = 0; i < NTT_PRIMES; ++i) {
+    NTT_PRIME *q = &tb->prime[i];
+    uint64_t *rt = (uint64_t*)twiddle(c, i, 0), *irt = (uint64_t*)twiddle(c, i, 1);
+    uint64_t inv = 1;
+    q->p = NTT_P[i];
+    // Newton: inv = p ^ -1 mod 2 ^ 64, six steps from 1 bit
+    for (int k = 0; k < 6; ++k) inv *= 2 - q->p * inv;
+    q->pinv = -inv;
+    q->oneq = shoup_q(1, q->p);
+    q->scale = mul_mod(pow_mod(len % q->p, q->p - 2, q->p), pow_mod(2, 64, q->p), q->p);
+    q->scaleq = shoup_q(q->scale, q->p);
+    for (size_t h = 1; h < len; h *= 2) {
+      const uint64_t w = pow_mod(NTT_G[i], (q->p - 1) / (2 * h), q->p);
+      const uint64_t wi = pow_mod(w, q->p - 2, q->p);
+      uint64_t x = 1, y = 1;
+      for (size_t j = 0; j < h; ++j) {
+        rt[h + j] = x;
+        rt[len + h + j] = shoup_q(x, q->p);
+        irt[h + j] = y;
+        irt[len + h + j] = shoup_q(y, q->p);
+        x = mul_mod(x, w, q->p);
+        y = mul_mod(y, wi, q->p);
+      }
+    }
+  }
+  {
+    const uint64_t p1 = NTT_P[0], p2 = NTT_P[1], p3 = NTT_P[2];
+    const u128 p12 = (u128)p1 * p2;
+    const uint64_t r64_2 = pow_mod(2, 64, p2), r64_3 = pow_mod(2, 64, p3);
+    tb->p12lo = (uint64_t)p12;
+    tb->p12hi = (uint64_t)(p12 >> 64);
+    tb->i12 = mul_mod(pow_mod(p1 % p2, p2 - 2, p2), r64_2, p2);
+    tb->i123 = mul_mod(pow_mod((uint64_t)(p12 % p3), p3 - 2, p3), r64_3, p3);
+    tb->p1m3 = mul_mod(p1 % p3, r64_3, p3);
+  }
+
+  // n' = -n ^ -1 mod R
+  mpz_inits(r, ni, NULL);
+  mpz_setbit(r, (mp_bitcnt_t)GMP_NUMB_BITS * s);
+  mpz_invert(ni, n, r);
+  mpz_sub(ni, r, ni);
+  for (int k = 0; k < 2; ++k) {
+    const mpz_srcptr v = k ? ni : n;
+    uint64_t *f = k ? c->nihat : c->nhat;
+    const mp_size_t vn = mpz_size(v);
+    const mp_limb_t *vp = mpz_limbs_read(v);
+    for (int i = 0; i < NTT_PRIMES; ++i) {
+      const NTT_PRIME *q = &tb->prime[i];
+      uint64_t *a = f + ((size_t)i << log);
+      for (mp_size_t j = 0; j < vn; ++j) a[j] = shoup(vp[j], 1, q->oneq, q->p);
+      memset(a + vn, 0, (len - vn) * sizeof(uint64_t));
+      ntt_fwd(a, twiddle(c, i, 0), twiddle(c, i, 0) + len, len, q->p);
+    }
+  }
+  mpz_clears(r, ni, NULL);
+  return 0;
+}
+
+void rsa_ntt_clear(RSA_NTT *c) {
+  if (c->tables) mpz_clear(c->n);
+  free(c->tables);
+  free(c->tw);
+  free(c->nhat);
+  free(c->nihat);
+  c->tables = NULL;
+  c->tw = c->nhat = c->nihat = NULL;
+}
+
+// f = forward transforms of x (xn <= N limbs), NTT_PRIMES << log entries
+static void ntt_load(uint64_t *f, const mp_limb_t *xp, mp_size_t xn, const RSA_NTT *c) {
+  const size_t len = (size_t)1 << c->log;
+  for (int i = 0; i < NTT_PRIMES; ++i) {
+    const NTT_PRIME *q = &c->tables->prime[i];
+    uint64_t *a = f + i * len;
+    for (mp_size_t j = 0; j < xn; ++j) a[j] = shoup(xp[j], 1, q->oneq, q->p);
+    memset(a + xn, 0, (len - xn) * sizeof(uint64_t));
+    ntt_fwd(a, twiddle(c, i, 0), twiddle(c, i, 0) + len, len, q->p);
+  }
+}
+
+static void ntt_pointwise(uint64_t *f, const uint64_t *a, const uint64_t *b, const RSA_NTT *c) {
+  const size_t len = (size_t)1 << c->log;
+  for (int i = 0; i < NTT_PRIMES; ++i) {
+    const NTT_PRIME *q = &c->tables->prime[i];
+    for (size_t j = i * len; j < (i + 1) * len; ++j) f[j] = mont(a[j], b[j], q);
+  }
+}
+
+// rp = the first rn limbs of the convolution whose transforms are in f
+// f is overwritten
+static void ntt_store(mp_limb_t *rp, mp_size_t rn, uint64_t *f, const RSA_NTT *c) {
+  const struct __RSA_NTT_TABLES *tb = c->tables;
+  const NTT_PRIME *q1 = &tb->prime[0], *q2 = &tb->prime[1], *q3 = &tb->prime[2];
+  const size_t len = (size_t)1 << c->log;
+  const uint64_t *f1 = f, *f2 = f + len, *f3 = f + 2 * len;
+  uint64_t c0 = 0, c1 = 0; // carry, below 2 ^ 122
+
+  for (int i = 0; i < NTT_PRIMES; ++i) {
+    ntt_inv(f + i * len, twiddle(c, i, 1), twiddle(c, i, 1) + len, len, tb->prime[i].p);
+  }
+  for (mp_size_t k = 0; k < rn; ++k) {
+    uint64_t r1 = 0, r2 = 0, r3 = 0, x2, x3, t;
+    u128 v, w;
+    if ((size_t)k < len) {
+      r1 = shoup(f1[k], q1->scale, q1->scaleq, q1->p);
+      r2 = shoup(f2[k], q2->scale, q2->scaleq, q2->p);
+      r3 = shoup(f3[k], q3->scale, q3->scaleq, q3->p);
+      if (r1 >= q1->p) r1 -= q1->p;
+      if (r2 >= q2->p) r2 -= q2->p;
+      if (r3 >= q3->p) r3 -= q3->p;
+    }
+    // Garner: v = r1 + x2 p1 + x3 p1 p2
+    x2 = mont(r2 + q2->p - (r1 >= q2->p ? r1 - q2->p : r1), tb->i12, q2);
+    if (x2 >= q2->p) x2 -= q2->p;
+    t = shoup(r1, 1, q3->oneq, q3->p) + mont(x2, tb->p1m3, q3); // < 4 p3
+    if (t >= 2 * q3->p) t -= 2 * q3->p;
+    if (t >= q3->p) t -= q3->p;
+    x3 = mont(r3 + q3->p - t, tb->i123, q3);
+    if (x3 >= q3->p) x3 -= q3->p;
+
+    v = (u128)x2 * NTT_P[0] + r1;
+    w = (u128)x3 * tb->p12lo;
+    // carry += v + x3 p12, then the low limb goes out
+    w += (uint64_t)v;
+    w += c0;
+    rp[k] = (uint64_t)w;
+    w >>= 64;
+    w += (u128)x3 * tb->p12hi + (uint64_t)(v >> 64);
+    w += c1;
+    c0 = (uint64_t)w;
+    c1 = (uint64_t)(w >> 64);
+  }
+}
+
+// rp = t R ^ -1 mod n, t has 2 size limbs and t < n R
+static void ntt_redc(mp_limb_t *rp, mp_limb_t *t, uint64_t *f, mp_limb_t *m, mp_limb_t *u,
+                     const RSA_NTT *c) {
+  const mp_size_t s = c->size;
+  const mp_limb_t *np = mpz_limbs_read(c->n);
+  mp_limb_t cy;
+  ntt_load(f, t, s, c);
+  ntt_pointwise(f, f, c->nihat, c);
+  ntt_store(m, s, f, c);
+  ntt_load(f, m, s, c);
+  ntt_pointwise(f, f, c->nhat, c);
+  ntt_store(u, 2 * s, f, c);
+  cy = mpn_add_n(u, u, t, 2 * s);
+  if (cy || mpn_cmp(u + s, np, s) >= 0) mpn_sub_n(rp, u + s, np, s);
+  else memcpy(rp, u + s, s * sizeof(mp_limb_t));
+}
+
+// Scratch of one exponentiation, limbs after the transforms
+typedef struct __NTT_WORK {
+  uint64_t *f, *fa;
+  mp_limb_t *t, *m, *u;
+} NTT_WORK;
+
+// rp = a b R ^ -1 mod n from the transforms of a and b
+static void ntt_mont_mul(mp_limb_t *rp, const uint64_t *fa, const uint64_t *fb, NTT_WORK *w,
+                         const RSA_NTT *c) {
+  ntt_pointwise(w->f, fa, fb, c);
+  ntt_store(w->t, 2 * c->size, w->f, c);
+  ntt_redc(rp, w->t, w->f, w->m, w->u, c);
+}
+
+// rop = base ^ e mod n, e >= 0
+void rsa_ntt_powm(mpz_t rop, const mpz_t base, const mpz_t e, const RSA_NTT *c) {
+  const mp_size_t s = c->size;
+  const size_t flen = (size_t)NTT_PRIMES << c->log;
+  RSA_EXP_PLAN pl;
+  NTT_WORK w;
+  mp_limb_t *tab, *acc, *rp;
+  uint64_t *ftab, *block;
+  mpz_t x;
+  size_t bytes;
+  mp_size_t rn;
+
+  if (mpz_sgn(e) <= 0 || rsa_plan_init(&pl, e) != 0) {
+    mpz_powm(rop, base, e, c->n);
+    return;
+  }
+  // f, fa, table transforms | t, u (2s each), m, acc, table
+  bytes = (2 + pl.tab) * flen * sizeof(uint64_t) + (6 + pl.tab) * s * sizeof(mp_limb_t);
+  block = malloc(bytes);
+  if (!block) {
+    rsa_plan_clear(&pl);
+    mpz_powm(rop, base, e, c->n);
+    return;
+  }
+  w.f = block;
+  w.fa = w.f + flen;
+  ftab = w.fa + flen;
+  w.t = (mp_limb_t*)(ftab + pl.tab * flen);
+  w.u = w.t + 2 * s;
+  w.m = w.u + 2 * s;
+  acc = w.m + s;
+  tab = acc + s;
+
+  // tab[0] = base R mod n
+  mpz_init(x);
+  mpz_mul_2exp(x, base, (mp_bitcnt_t)GMP_NUMB_BITS * s);
+  mpz_mod(x, x, c->n);
+  memset(tab, 0, s * sizeof(mp_limb_t));
+  memcpy(tab, mpz_limbs_read(x), mpz_size(x) * sizeof(mp_limb_t));
+  mpz_clear(x);
+  ntt_load(ftab, tab, s, c);
+
+  // tab[i] = base ^ (2i + 1), acc = base ^ 2 while it is built
+  if (pl.tab > 1) {
+    ntt_mont_mul(acc, ftab, ftab, &w, c);
+    ntt_load(w.fa, acc, s, c);
+    for (int i = 1; i < pl.tab; ++i) {
+      ntt_mont_mul(tab + i * s, ftab + (i - 1) * flen, w.fa, &w, c);
+      ntt_load(ftab + i * flen, tab + i * s, s, c);
+    }
+  }
+
+  memcpy(acc, tab + ((pl.op[0] & 0xff) - 1) * s, s * sizeof(mp_limb_t));
+  for (int i = 1; i < pl.nops; ++i) {
+    const uint32_t op = pl.op[i];
+    for (uint32_t k = op >> 8; k > 0; --k) {
+      ntt_load(w.fa, acc, s, c);
+      ntt_mont_mul(acc, w.fa, w.fa, &w, c);
+    }
+    if (op & 0xff) {
+      ntt_load(w.fa, acc, s, c);
+      ntt_mont_mul(acc, w.fa, ftab + ((op & 0xff) - 1) * flen, &w, c);
+    }
+  }
+
+  // Out of Montgomery form: acc R ^ -1
+  memcpy(w.t, acc, s * sizeof(mp_limb_t));
+  memset(w.t + s, 0, s * sizeof(mp_limb_t));
+  ntt_redc(acc, w.t, w.f, w.m, w.u, c);
+  rn = s;
+  while (rn > 0 && acc[rn - 1] == 0) --rn;
+  rp = mpz_limbs_write(rop, s);
+  memcpy(rp, acc, rn * sizeof(mp_limb_t));
+  mpz_limbs_finish(rop, rn);
+
+  free(block);
+  rsa_plan_clear(&pl);
+}
+
+// rop = base ^ e mod n, mpz_powm below RSA_NTT_THRESHOLD limbs of n
+// The NTT context costs two forward transforms, nothing next to the
+// thousands of products of one exponentiation.
+void rsa_powm(mpz_t rop, const mpz_t base, const mpz_t e, const mpz_t n) {
+  RSA_NTT c;
+  if (RSA_NTT_THRESHOLD <= 0 || (long)mpz_size(n) < RSA_NTT_THRESHOLD || mpz_sgn(e) < 0
+      || rsa_ntt_init(&c, n) != 0) {
+    mpz_powm(rop, base, e, n);
+    return;
+  }
+  rsa_ntt_powm(rop, base, e, &c);
+  rsa_ntt_clear(&c);
+}
@@ -0,0 +1,279 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// Every routine below works inside the caller's buffers.
+// Hash contexts live on the stack, MGF1 masks are XORed in place.
+
+// Helper functions
+// OAEP seeds and PSS salts must not be predictable, so they come from the
+// ChaCha20 DRBG, never from a gmp_randstate_t (Mersenne Twister)
+static void rand_bytes(uint8_t *out, size_t len, RSA_DRBG *rnd) {
+  rsa_drbg_bytes(rnd, out, len);
+}
+
+// 0xff.. if a == b, 0 otherwise
+static size_t ct_eq(size_t a, size_t b) {
+  size_t x = a ^ b;
+  return ((x | (0 - x)) >> (sizeof(size_t) * 8 - 1)) - 1;
+}
+
+static size_t ct_diff(const uint8_t *a, const uint8_t *b, size_t len) {
+  uint8_t d = 0;
+  for (size_t i = 0; i < len; ++i) d |= a[i] ^ b[i];
+  return d;
+}
+
+static size_t mod_bytes(const mpz_t n) {
+  return (mpz_sizeinbase(n, 2) + 7) / 8;
+}
+
+// I2OSP: x -> big-endian octet string of exactly len bytes
+int rsa_i2osp(uint8_t *out, size_t len, const mpz_t x) {
+  size_t cnt;
+  if (mpz_sgn(x) < 0) return -1;
+  if (mpz_sgn(x) == 0) {
+    memset(out, 0, len);
+    return 0;
+  }
+  cnt = mpz_sizeinbase(x, 256);
+  if (cnt > len) return -1;
+  memset(out, 0, len - cnt);
+  mpz_export(out + len - cnt, &cnt, 1, 1, 1, 0, x);
+  return 0;
+}
+
+// OS2IP: big-endian octet string -> x
+void rsa_os2ip(mpz_t x, const uint8_t *in, size_t len) {
+  mpz_import(x, len, 1, 1, 1, 0, in);
+}
+
+// buf ^= MGF1-SHA-256(seed, len)
+void rsa_mgf1_xor(uint8_t *buf, size_t len, const uint8_t *seed, size_t seedlen) {
+  RSA_SHA256 base, ctx;
+  uint8_t cnt[4], h[RSA_HASH_SIZE];
+
+  // Seed is absorbed once, each block only hashes the counter
+  rsa_sha256_init(&base);
+  rsa_sha256_update(&base, seed, seedlen);
+  for (uint32_t c = 0; len; ++c) {
+    size_t n = len < RSA_HASH_SIZE ? len : RSA_HASH_SIZE;
+    cnt[0] = (uint8_t)(c >> 24); cnt[1] = (uint8_t)(c >> 16);
+    cnt[2] = (uint8_t)(c >> 8);  cnt[3] = (uint8_t)c;
+    ctx = base;
+    rsa_sha256_update(&ctx, cnt, 4);
+    rsa_sha256_final(&ctx, h);
+    for (size_t i = 0; i < n; ++i) buf[i] ^= h[i];
+    buf += n;
+    len -= n;
+  }
+}
+
+// EME-OAEP encoding
+// em = 0x00 || maskedSeed || maskedDB, k bytes
+int rsa_oaep_encode(uint8_t *em, size_t k, const uint8_t *msg, size_t mlen,
+                    const uint8_t *label, size_t llen, RSA_DRBG *rnd) {
+  const size_t hlen = RSA_HASH_SIZE;
+  uint8_t *seed = em + 1, *db = em + 1 + hlen;
+  size_t dblen;
+
+  if (k < 2 * hlen + 2 || mlen > k - 2 * hlen - 2) return -1;
+  dblen = k - hlen - 1;
+
+  // DB = lHash || PS || 0x01 || M
+  rsa_sha256(db, label, llen);
+  memset(db + hlen, 0, dblen - mlen - hlen - 1);
+  db[dblen - mlen - 1] = 0x01;
+  memcpy(db + dblen - mlen, msg, mlen);
+
+  em[0] = 0x00;
+  rand_bytes(seed, hlen, rnd);
+  rsa_mgf1_xor(db, dblen, seed, hlen);
+  rsa_mgf1_xor(seed, hlen, db, dblen);
+  return 0;
+}
+
+// EME-OAEP decoding, em is unmasked in place
+// msg needs room for k - 2 * RSA_HASH_SIZE - 2 bytes
+int rsa_oaep_decode(uint8_t *msg, size_t *mlen, uint8_t *em, size_t k,
+                    const uint8_t *label, size_t llen) {
+  const size_t hlen = RSA_HASH_SIZE;
+  uint8_t *seed = em + 1, *db = em + 1 + hlen;
+  uint8_t lhash[RSA_HASH_SIZE];
+  size_t dblen, bad, found = 0, idx = 0;
+
+  if (k < 2 * hlen + 2) return -1;
+  dblen = k - hlen - 1;
+
+  rsa_mgf1_xor(seed, hlen, db, dblen);
+  rsa_mgf1_xor(db, dblen, seed, hlen);
+  rsa_sha256(lhash, label, llen);
+
+  // No early exit: every check is folded into one mask
+  bad = ~ct_eq(em[0], 0) | ~ct_eq(ct_diff(db, lhash, hlen), 0);
+  for (size_t i = hlen; i < dblen; ++i) {
+    size_t is1 = ct_eq(db[i], 0x01), is0 = ct_eq(db[i], 0x00);
+    idx   |= ~found & is1 & i;
+    bad   |= ~found & ~is0 & ~is1;
+    found |= is1;
+  }
+  bad |= ~found;
+  if (bad) return -1;
+
+  *mlen = dblen - idx - 1;
+  memcpy(msg, db + idx + 1, *mlen);
+  return 0;
+}
+
+// EMSA-PSS encoding
+// em is ceil(embits / 8) bytes, mhash is RSA_HASH_SIZE bytes
+int rsa_pss_encode(uint8_t *em, size_t embits, const uint8_t *mhash, size_t slen,
+                   RSA_DRBG *rnd) {
+  static const uint8_t zeros[8] = {0};
+  const size_t hlen = RSA_HASH_SIZE;
+  const size_t emlen = (embits + 7) / 8;
+  size_t dblen;
+  uint8_t *db = em, *h, *salt;
+  RSA_SHA256 ctx;
+
+  if (emlen < hlen + slen + 2) return -1;
+  dblen = emlen - hlen - 1;
+  h = em + dblen;
+  salt = db + dblen - slen;
+
+  // DB = PS || 0x01 || salt
+  memset(db, 0, dblen - slen - 1);
+  db[dblen - slen - 1] = 0x01;
+  rand_bytes(salt, slen, rnd);
+
+  // H = Hash(0x00 * 8 || mHash || salt)
+  rsa_sha256_init(&ctx);
+  rsa_sha256_update(&ctx, zeros, 8);
+  rsa_sha256_update(&ctx, mhash, hlen);
+  rsa_sha256_update(&ctx, salt, slen);
+  rsa_sha256_final(&ctx, h);
+
+  rsa_mgf1_xor(db, dblen, h, hlen);
+  db[0] &= 0xff >> (8 * emlen - embits);
+  em[emlen - 1] = 0xbc;
+  return 0;
+}
+
+// EMSA-PSS verification, em is unmasked in place
+int rsa_pss_decode(uint8_t *em, size_t embits, const uint8_t *mhash, size_t slen) {
+  static const uint8_t zeros[8] = {0};
+  const size_t hlen = RSA_HASH_SIZE;
+  const size_t emlen = (embits + 7) / 8;
+  const uint8_t topmask = 0xff >> (8 * emlen - embits);
+  size_t dblen;
+  uint8_t *db = em, *h, hh[RSA_HASH_SIZE];
+  RSA_SHA256 ctx;
+
+  if (emlen < hlen + slen + 2) return -1;
+  if (em[emlen - 1] != 0xbc || (em[0] & ~topmask)) return -1;
+  dblen = emlen - hlen - 1;
+  h = em + dblen;
+
+  rsa_mgf1_xor(db, dblen, h, hlen);
+  db[0] &= topmask;
+  for (size_t i = 0; i < dblen - slen - 1; ++i) {
+    if (db[i] != 0x00) return -1;
+  }
+  if (db[dblen - slen - 1] != 0x01) return -1;
+
+  rsa_sha256_init(&ctx);
+  rsa_sha256_update(&ctx, zeros, 8);
+  rsa_sha256_update(&ctx, mhash, hlen);
+  rsa_sha256_update(&ctx, db + dblen - slen, slen);
+  rsa_sha256_final(&ctx, hh);
+  return ct_diff(h, hh, hlen) ? -1 : 0;
+}
+
+// RSAES-OAEP-ENCRYPT, c is k bytes
+int rsa_oaep_encrypt(uint8_t *c, const uint8_t *msg, size_t mlen,
+                     const uint8_t *label, size_t llen,
+                     const RSA_PUBKEY *pub, RSA_DRBG *rnd) {
+  const size_t k = mod_bytes(pub->n);
+  mpz_t x;
+
+  if (rsa_oaep_encode(c, k, msg, mlen, label, llen, rnd) != 0) return -1;
+  mpz_init2(x, k * 8);
+  rsa_os2ip(x, c, k);
+  rsa_pub_exp(x, x, pub);
+  rsa_i2osp(c, k, x);
+  mpz_clear(x);
+  return 0;
+}
+
+// RSAES-OAEP-DECRYPT, c is k bytes
+int rsa_oaep_decrypt(uint8_t *msg, size_t *mlen, const uint8_t *c,
+                     const uint8_t *label, size_t llen, const RSA_PRIKEY *pri) {
+  const size_t k = mod_bytes(pri->n);
+  uint8_t em[RSA_MAX_BYTES];
+  int ret = -1;
+  mpz_t x;
+
+  if (k > RSA_MAX_BYTES) return -1;
+  mpz_init2(x, k * 8);
+  rsa_os2ip(x, c, k);
+  if (mpz_cmp(x, pri->n) < 0) {
+    rsa_pri_exp(x, x, pri);
+    rsa_i2osp(em, k, x);
+    ret = rsa_oaep_decode(msg, mlen, em, k, label, llen);
+  }
+  mpz_clear(x);
+  return ret;
+}
+
+// RSASSA-PSS-SIGN, salt length = hash length, s is k bytes
+int rsa_pss_sign(uint8_t *s, const uint8_t *msg, size_t mlen,
+                 const RSA_PRIKEY *pri, RSA_DRBG *rnd) {
+  uint8_t mhash[RSA_HASH_SIZE];
+  rsa_sha256(mhash, msg, mlen);
+  return rsa_pss_sign_hash(s, mhash, pri, rnd);
+}
+
+// Same from the SHA-256 digest of the message, mhash may alias s
+int rsa_pss_sign_hash(uint8_t *s, const uint8_t *mhash, const RSA_PRIKEY *pri,
+                      RSA_DRBG *rnd) {
+  const size_t embits = mpz_sizeinbase(pri->n, 2) - 1;
+  const size_t emlen = (embits + 7) / 8;
+  const size_t k = mod_bytes(pri->n);
+  uint8_t h[RSA_HASH_SIZE];
+  mpz_t x;
+
+  // EM is built right-aligned in the signature buffer
+  memcpy(h, mhash, RSA_HASH_SIZE);
+  memset(s, 0, k - emlen);
+  if (rsa_pss_encode(s + k - emlen, embits, h, RSA_HASH_SIZE, rnd) != 0) return -1;
+  mpz_init2(x, k * 8);
+  rsa_os2ip(x, s, k);
+  rsa_pri_exp(x, x, pri);
+  rsa_i2osp(s, k, x);
+  mpz_clear(x);
+  return 0;
+}
+
+// RSASSA-PSS-VERIFY, s is k bytes
+int rsa_pss_verify(const uint8_t *s, const uint8_t *msg, size_t mlen,
+                   const RSA_PUBKEY *pub) {
+  const size_t embits = mpz_sizeinbase(pub->n, 2) - 1;
+  const size_t emlen = (embits + 7) / 8;
+  const size_t k = mod_bytes(pub->n);
+  uint8_t mhash[RSA_HASH_SIZE], em[RSA_MAX_BYTES];
+  int ret = -1;
+  mpz_t x;
+
+  if (k > RSA_MAX_BYTES) return -1;
+  mpz_init2(x, k * 8);
+  rsa_os2ip(x, s, k);
+  if (mpz_cmp(x, pub->n) < 0) {
+    rsa_pub_exp(x, x, pub);
+    if (rsa_i2osp(em, emlen, x) == 0) {
+      rsa_sha256(mhash, msg, mlen);
+      ret = rsa_pss_decode(em, embits, mhash, RSA_HASH_SIZE);
+    }
+  }
+  mpz_clear(x);
+  return ret;
+}
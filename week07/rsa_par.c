@@ -0,0 +1,168 @@
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "rsa.h"
+
+// CRT halves in parallel for single-request latency
+//
+// The pool keeps two helper threads for its whole life, one per half. A
+// call hands x ^ dp mod p to one and x ^ dq mod q to the other by bumping
+// their job sequence, waits for both and recombines (Garner) on the
+// calling thread, so the call costs about one mpz_powm of half size plus
+// two wake-ups. Both sides wait the same way: spin on the word for `spin`
+// rounds, then park on it with a futex. A helper that is still spinning
+// is woken with no system call at all.
+//
+// One call at a time per pool: a caller that finds the pool busy runs the
+// serial rsa_pri_exp instead of queueing behind it.
+
+typedef struct __CRT_HELPER {
+  _Atomic uint32_t go;     // job sequence, bumped by the caller
+  _Atomic uint32_t done;   // last finished sequence
+  _Atomic uint32_t go_sleepers, done_sleepers;
+  pthread_t th;
+  int started;
+  mpz_t r;                 // result, kept across calls
+  mpz_srcptr in, e, m;
+  int size;                // key size, for the perf phases
+  struct __RSA_CRT_POOL *pool;
+} __attribute__((aligned(64))) CRT_HELPER;
+
+struct __RSA_CRT_POOL {
+  CRT_HELPER half[2];
+  pthread_mutex_t busy;
+  uint32_t seq;
+  int spin;
+  atomic_int stop;
+};
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// Returns once *w != old: `spin` rounds of polling, then the futex
+static uint32_t wait_change(_Atomic uint32_t *w, uint32_t old, _Atomic uint32_t *sleepers,
+                            int spin) {
+  uint32_t v;
+  for (int i = 0; i < spin; ++i) {
+    if ((v = atomic_load_explicit(w, memory_order_acquire)) != old) return v;
+    cpu_relax();
+  }
+  // seq_cst on both sides: either the waker sees the sleeper or this sees
+  // the new value; FUTEX_WAIT itself rechecks *w under the kernel's lock
+  atomic_fetch_add(sleepers, 1);
+  while ((v = atomic_load(w)) == old) {
+    syscall(SYS_futex, (uint32_t*)w, FUTEX_WAIT_PRIVATE, old, NULL, NULL, 0);
+  }
+  atomic_fetch_sub(sleepers, 1);
+  return v;
+}
+
+static void post(_Atomic uint32_t *w, uint32_t v, _Atomic uint32_t *sleepers) {
+  atomic_store(w, v);
+  if (atomic_load(sleepers)) syscall(SYS_futex, (uint32_t*)w, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void *helper_main(void *arg) {
+  CRT_HELPER *h = (CRT_HELPER*)arg;
+  uint32_t seq = 0;
+  for (;;) {
+    seq = wait_change(&h->go, seq, &h->go_sleepers, h->pool->spin);
+    if (atomic_load(&h->pool->stop)) break;
+    RSA_PERF_BEGIN(RSA_PHASE_EXP, h->size);
+    mpz_powm(h->r, h->in, h->e, h->m);
+    RSA_PERF_END();
+    post(&h->done, seq, &h->done_sleepers);
+  }
+  return NULL;
+}
+
+// spin: polling rounds before a wait parks, 0 parks at once
+// With fewer than three cpus online a spinning waiter only takes the time
+// slice of the thread it is waiting for, so it parks at once there.
+RSA_CRT_POOL *rsa_crt_pool_new(int spin) {
+  RSA_CRT_POOL *pool = aligned_alloc(64, (sizeof(RSA_CRT_POOL) + 63) / 64 * 64);
+  if (!pool) return NULL;
+  pthread_mutex_init(&pool->busy, NULL);
+  pool->seq = 0;
+  pool->spin = spin < 0 || sysconf(_SC_NPROCESSORS_ONLN) < 3 ? 0 : spin;
+  atomic_init(&pool->stop, 0);
+  for (int i = 0; i < 2; ++i) {
+    CRT_HELPER *h = &pool->half[i];
+    atomic_init(&h->go, 0);
+    atomic_init(&h->done, 0);
+    atomic_init(&h->go_sleepers, 0);
+    atomic_init(&h->done_sleepers, 0);
+    mpz_init(h->r);
+    h->pool = pool;
+    h->started = pthread_create(&h->th, NULL, helper_main, h) == 0;
+  }
+  if (!pool->half[0].started || !pool->half[1].started) {
+    rsa_crt_pool_free(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+void rsa_crt_pool_free(RSA_CRT_POOL *pool) {
+  if (!pool) return;
+  atomic_store(&pool->stop, 1);
+  for (int i = 0; i < 2; ++i) {
+    CRT_HELPER *h = &pool->half[i];
+    if (!h->started) continue;
+    post(&h->go, pool->seq + 1, &h->go_sleepers);
+    pthread_join(h->th, NULL);
+  }
+  for (int i = 0; i < 2; ++i) mpz_clear(pool->half[i].r);
+  pthread_mutex_destroy(&pool->busy);
+  free(pool);
+}
+
+#ifndef NO_RSA_CRT
+// Same result as rsa_pri_exp, out may alias in
+void rsa_pri_exp_par(mpz_t out, const mpz_t in, const RSA_PRIKEY *pri, RSA_CRT_POOL *pool) {
+  CRT_HELPER *hp, *hq;
+  uint32_t seq;
+  RSA_STAT_START(t0);
+
+  if (!pool || pthread_mutex_trylock(&pool->busy) != 0) {
+    rsa_pri_exp(out, in, pri);
+    return;
+  }
+  hp = &pool->half[0];
+  hq = &pool->half[1];
+  seq = ++pool->seq;
+  hp->in = hq->in = in;
+  hp->e = pri->dp;
+  hp->m = pri->p;
+  hq->e = pri->dq;
+  hq->m = pri->q;
+  hp->size = hq->size = pri->RSA_SIZE;
+  post(&hp->go, seq, &hp->go_sleepers);
+  post(&hq->go, seq, &hq->go_sleepers);
+  wait_change(&hp->done, seq - 1, &hp->done_sleepers, pool->spin);
+  wait_change(&hq->done, seq - 1, &hq->done_sleepers, pool->spin);
+
+  // y = xq + q * ((xp - xq) qi mod p), in hp->r
+  RSA_PERF_BEGIN(RSA_PHASE_RECOMBINE, pri->RSA_SIZE);
+  mpz_sub(hp->r, hp->r, hq->r);
+  mpz_mul(hp->r, hp->r, pri->qi);
+  mpz_mod(hp->r, hp->r, pri->p);
+  mpz_mul(hp->r, hp->r, pri->q);
+  mpz_add(out, hp->r, hq->r);
+  RSA_PERF_END();
+  pthread_mutex_unlock(&pool->busy);
+  RSA_STAT_STOP(t0, RSA_STAT_PRI_EXP, pri->RSA_SIZE);
+}
+#else
+// Without dp, dq and qi there is nothing to split
+void rsa_pri_exp_par(mpz_t out, const mpz_t in, const RSA_PRIKEY *pri, RSA_CRT_POOL *pool) {
+  (void)pool;
+  rsa_pri_exp(out, in, pri);
+}
+#endif
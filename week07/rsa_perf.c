@@ -0,0 +1,251 @@
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rsa.h"
+
+// Hardware counters per phase
+//
+// Every thread opens one perf_event_open group on itself (pid 0, any
+// cpu, user space only): all events are scheduled together, so one read()
+// of the leader gives a consistent sample of all of them. Phase changes
+// read the group and charge the delta since the previous read to the
+// innermost open phase. Totals live in per-thread blocks on a list, like
+// rsa_stat.c: when the thread exits its block is folded into perf_dead
+// and freed, and the counter fds are closed. Without perf (no PMU,
+// perf_event_paranoid, seccomp) only calls and time are recorded.
+
+#define PERF_DEPTH 8
+
+typedef struct __RSA_PERF_TLS {
+  struct __RSA_PERF_TLS *next;
+  _Atomic uint64_t calls[RSA_PHASE_MAX][RSA_STAT_SIZES];
+  _Atomic uint64_t ns[RSA_PHASE_MAX][RSA_STAT_SIZES];
+  _Atomic uint64_t ev[RSA_PHASE_MAX][RSA_STAT_SIZES][RSA_EV_MAX];
+} RSA_PERF_TLS;
+
+// Counter state of the calling thread
+typedef struct __PERF_SELF {
+  RSA_PERF_TLS *b;
+  int fd[RSA_EV_MAX];      // -1: not opened
+  int slot[RSA_EV_MAX];    // position in the group read, -1: not counted
+  int nr;
+  int depth;
+  struct { int phase, size; } stack[PERF_DEPTH];
+  uint64_t last_ns;
+  uint64_t last[RSA_EV_MAX];
+} PERF_SELF;
+
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static RSA_PERF_TLS *perf_head;
+static RSA_PERF_TLS perf_dead; // exited threads
+static _Thread_local PERF_SELF *perf_self;
+static atomic_int perf_avail; // events some thread could open, bit per event
+static pthread_key_t perf_key;
+static pthread_once_t perf_once = PTHREAD_ONCE_INIT;
+
+static const char *PHASE_NAME[RSA_PHASE_MAX] = {
+  "sieve", "mr", "invert", "reduce", "exp", "recombine"
+};
+
+#define RELAXED memory_order_relaxed
+#define BUMP(x, v) atomic_store_explicit(&(x), atomic_load_explicit(&(x), RELAXED) + (v), RELAXED)
+
+// Adds a block's totals to dst, perf_lock held
+static void block_fold(RSA_PERF_TLS *dst, RSA_PERF_TLS *b) {
+  for (int p = 0; p < RSA_PHASE_MAX; ++p) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+      BUMP(dst->calls[p][s], atomic_load(&b->calls[p][s]));
+      BUMP(dst->ns[p][s], atomic_load(&b->ns[p][s]));
+      for (int i = 0; i < RSA_EV_MAX; ++i) BUMP(dst->ev[p][s][i], atomic_load(&b->ev[p][s][i]));
+    }
+  }
+}
+
+static void perf_close(void *arg) {
+  PERF_SELF *me = (PERF_SELF*)arg;
+  RSA_PERF_TLS **p;
+  pthread_mutex_lock(&perf_lock);
+  block_fold(&perf_dead, me->b);
+  for (p = &perf_head; *p != me->b; p = &(*p)->next);
+  *p = me->b->next;
+  pthread_mutex_unlock(&perf_lock);
+  for (int i = 0; i < RSA_EV_MAX; ++i) {
+    if (me->fd[i] >= 0) close(me->fd[i]);
+  }
+  free(me->b);
+  free(me);
+  perf_self = NULL;
+}
+
+static void perf_key_init(void) {
+  pthread_key_create(&perf_key, perf_close);
+}
+
+static int event_open(int ev, int group) {
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.size = sizeof(pe);
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  pe.read_format = PERF_FORMAT_GROUP;
+  pe.type = PERF_TYPE_HARDWARE;
+  switch (ev) {
+  case RSA_EV_CYCLES:        pe.config = PERF_COUNT_HW_CPU_CYCLES; break;
+  case RSA_EV_INSTRUCTIONS:  pe.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+  case RSA_EV_BRANCH_MISSES: pe.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+  case RSA_EV_L1D_MISSES:
+    pe.type = PERF_TYPE_HW_CACHE;
+    pe.config = PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8
+              | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    break;
+  default:                   pe.config = PERF_COUNT_HW_CACHE_MISSES; break;
+  }
+  return (int)syscall(SYS_perf_event_open, &pe, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+static PERF_SELF *perf_thread(void) {
+  PERF_SELF *me = perf_self;
+  int leader = -1;
+  if (me) return me;
+  me = calloc(1, sizeof(*me));
+  if (!me || !(me->b = calloc(1, sizeof(*me->b)))) abort();
+  pthread_mutex_lock(&perf_lock);
+  me->b->next = perf_head;
+  perf_head = me->b;
+  pthread_mutex_unlock(&perf_lock);
+  // The first event that opens leads, the rest join its group
+  for (int i = 0; i < RSA_EV_MAX; ++i) {
+    me->fd[i] = event_open(i, leader);
+    me->slot[i] = -1;
+    if (me->fd[i] < 0) continue;
+    if (leader < 0) leader = me->fd[i];
+    me->slot[i] = me->nr++;
+    atomic_fetch_or(&perf_avail, 1 << i);
+  }
+  pthread_once(&perf_once, perf_key_init);
+  pthread_setspecific(perf_key, me);
+  return perf_self = me;
+}
+
+// Current time and counter values
+// -1 if the group could not be read, v is then left alone
+static int sample(PERF_SELF *me, uint64_t *now, uint64_t *v) {
+  uint64_t buf[1 + RSA_EV_MAX];
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  *now = (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+  if (me->nr == 0) {
+    memset(v, 0, RSA_EV_MAX * sizeof(uint64_t));
+    return 0;
+  }
+  // { nr, value[nr] } in the order the events joined
+  for (int i = 0; i < RSA_EV_MAX; ++i) {
+    if (me->slot[i] == 0) {
+      if (read(me->fd[i], buf, sizeof(buf)) < (ssize_t)((1 + me->nr) * sizeof(uint64_t))) return -1;
+      break;
+    }
+  }
+  for (int i = 0; i < RSA_EV_MAX; ++i) {
+    v[i] = me->slot[i] >= 0 ? buf[1 + me->slot[i]] : 0;
+  }
+  return 0;
+}
+
+// Charges the time since the last sample to the innermost open phase
+// A failed read skips the charge and keeps the last sample, the interval
+// then goes to whichever phase is open at the next good read.
+static void charge(PERF_SELF *me) {
+  uint64_t now, v[RSA_EV_MAX];
+  if (sample(me, &now, v) != 0) return;
+  if (me->depth > 0 && me->depth <= PERF_DEPTH) {
+    const int phase = me->stack[me->depth - 1].phase, s = me->stack[me->depth - 1].size;
+    BUMP(me->b->ns[phase][s], now - me->last_ns);
+    for (int i = 0; i < RSA_EV_MAX; ++i) BUMP(me->b->ev[phase][s][i], v[i] - me->last[i]);
+  }
+  me->last_ns = now;
+  memcpy(me->last, v, sizeof(v));
+}
+
+void rsa_perf_begin(int phase, int size) {
+  PERF_SELF *me = perf_thread();
+  int s = size / 1024;
+  if (size % 1024 != 0 || s >= RSA_STAT_SIZES) s = 0;
+  charge(me);
+  if (me->depth < PERF_DEPTH) {
+    me->stack[me->depth].phase = phase;
+    me->stack[me->depth].size = s;
+    BUMP(me->b->calls[phase][s], 1);
+  }
+  ++me->depth;
+}
+
+void rsa_perf_end(void) {
+  PERF_SELF *me = perf_thread();
+  if (me->depth == 0) return;
+  charge(me);
+  --me->depth;
+}
+
+static void snapshot_add(RSA_PERF *st, RSA_PERF_TLS *b) {
+  for (int p = 0; p < RSA_PHASE_MAX; ++p) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+      st->calls[p][s] += atomic_load_explicit(&b->calls[p][s], RELAXED);
+      st->ns[p][s]    += atomic_load_explicit(&b->ns[p][s], RELAXED);
+      for (int i = 0; i < RSA_EV_MAX; ++i) {
+        st->ev[p][s][i] += atomic_load_explicit(&b->ev[p][s][i], RELAXED);
+      }
+    }
+  }
+}
+
+// Sum of exited threads and every live thread's block
+void rsa_perf_snapshot(RSA_PERF *st) {
+  const int avail = atomic_load(&perf_avail);
+  memset(st, 0, sizeof(*st));
+  pthread_mutex_lock(&perf_lock);
+  snapshot_add(st, &perf_dead);
+  for (RSA_PERF_TLS *b = perf_head; b; b = b->next) snapshot_add(st, b);
+  pthread_mutex_unlock(&perf_lock);
+  for (int p = 0; p < RSA_PHASE_MAX; ++p) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+      for (int i = 0; i < RSA_EV_MAX; ++i) {
+        if (!(avail & 1 << i)) st->ev[p][s][i] = -1;
+      }
+    }
+  }
+}
+
+// Per call, n/a for events nobody could count
+static void cell(char *buf, size_t len, int64_t v, uint64_t calls) {
+  if (v < 0) snprintf(buf, len, "n/a");
+  else snprintf(buf, len, "%.0f", (double)v / calls);
+}
+
+void rsa_perf_print(FILE *fp, const RSA_PERF *st) {
+  fprintf(fp, "%-10s %6s %10s %12s %12s %6s %10s %10s %10s\n",
+    "phase", "size", "calls", "us/call", "cycles/call", "IPC", "br-miss", "L1D-miss", "LLC-miss");
+  for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+    for (int p = 0; p < RSA_PHASE_MAX; ++p) {
+      const int64_t *ev = st->ev[p][s];
+      const uint64_t calls = st->calls[p][s];
+      char size[16] = "other", cyc[24], ipc[16] = "n/a", br[24], l1[24], llc[24];
+      if (calls == 0) continue;
+      if (s) snprintf(size, sizeof(size), "%d", s * 1024);
+      cell(cyc, sizeof(cyc), ev[RSA_EV_CYCLES], calls);
+      cell(br, sizeof(br), ev[RSA_EV_BRANCH_MISSES], calls);
+      cell(l1, sizeof(l1), ev[RSA_EV_L1D_MISSES], calls);
+      cell(llc, sizeof(llc), ev[RSA_EV_LLC_MISSES], calls);
+      if (ev[RSA_EV_CYCLES] > 0 && ev[RSA_EV_INSTRUCTIONS] >= 0) {
+        snprintf(ipc, sizeof(ipc), "%.2f", (double)ev[RSA_EV_INSTRUCTIONS] / ev[RSA_EV_CYCLES]);
+      }
+      fprintf(fp, "%-10s %6s %10lu %12.1f %12s %6s %10s %10s %10s\n",
+        PHASE_NAME[p], size, (unsigned long)calls, st->ns[p][s] / 1e3 / calls,
+        cyc, ipc, br, l1, llc);
+    }
+  }
+}
@@ -0,0 +1,134 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// Exponentiation plans
+//
+// For an exponent that is used over and over (e, dp, dq) the multiply /
+// square schedule is worked out once and replayed. The schedule is a left-
+// to-right sliding window: every window starts and ends with a 1 bit, so the
+// table only needs odd powers, and only up to the largest digit this
+// exponent actually uses. The width is chosen per exponent by counting the
+// exact cost of every candidate, which gives w = 1 (plain square and
+// multiply, 16 squarings + 1 multiplication) for e = 65537 and w = 5 or 6
+// for 1024-bit CRT exponents.
+//
+// op[i] = (squarings << 8) | digit index + 1, index 0 = only square.
+// op[0] holds no squarings, it loads the first window from the table.
+
+#define PLAN_MAX_WINDOW 7
+
+// A squaring costs about 3/4 of a multiplication (mpn_sqr vs mpn_mul_n)
+#define SQR_COST 3
+#define MUL_COST 4
+
+#define OP(sqr, idx) ((uint32_t)(sqr) << 8 | (uint32_t)(idx))
+
+// Windows of width w, emitted into op if it is not NULL
+// Returns the number of ops, *maxd is the largest digit
+static int plan_scan(uint32_t *op, const mpz_t e, int w, int *maxd, int *sqr, int *mul) {
+  long i = (long)mpz_sizeinbase(e, 2) - 1;
+  int nops = 0, pending = 0;
+  *maxd = 1;
+  *sqr = *mul = 0;
+  while (i >= 0) {
+    long j;
+    int d = 0;
+    if (!mpz_tstbit(e, i)) {
+      ++pending;
+      --i;
+      continue;
+    }
+    // Longest window ending in a 1 bit
+    j = i - w + 1 > 0 ? i - w + 1 : 0;
+    while (!mpz_tstbit(e, j)) ++j;
+    for (long k = i; k >= j; --k) d = d << 1 | mpz_tstbit(e, k);
+    if (d > *maxd) *maxd = d;
+    if (nops == 0) {
+      if (op) op[nops] = OP(0, d / 2 + 1);
+    } else {
+      pending += (int)(i - j + 1);
+      if (op) op[nops] = OP(pending, d / 2 + 1);
+      *sqr += pending;
+      *mul += 1;
+    }
+    ++nops;
+    pending = 0;
+    i = j - 1;
+  }
+  if (pending) {
+    if (op) op[nops] = OP(pending, 0);
+    *sqr += pending;
+    ++nops;
+  }
+  // Table: base ^ 2 once, then one multiplication per extra odd power
+  if (*maxd > 1) {
+    *sqr += 1;
+    *mul += *maxd / 2;
+  }
+  return nops;
+}
+
+// -1 if e <= 0
+int rsa_plan_init(RSA_EXP_PLAN *pl, const mpz_t e) {
+  int best = 0, best_cost = 0, maxd, sqr, mul, nops;
+  pl->op = NULL;
+  pl->nops = 0;
+  if (mpz_sgn(e) <= 0) return -1;
+
+  for (int w = 1; w <= PLAN_MAX_WINDOW; ++w) {
+    plan_scan(NULL, e, w, &maxd, &sqr, &mul);
+    const int cost = SQR_COST * sqr + MUL_COST * mul;
+    if (best == 0 || cost < best_cost) {
+      best = w;
+      best_cost = cost;
+    }
+  }
+
+  nops = plan_scan(NULL, e, best, &maxd, &sqr, &mul);
+  pl->op = malloc(nops * sizeof(uint32_t));
+  if (!pl->op) return -1;
+  plan_scan(pl->op, e, best, &maxd, &sqr, &mul);
+  pl->nops = nops;
+  pl->w = best;
+  pl->tab = maxd / 2 + 1;
+  pl->sqr = sqr;
+  pl->mul = mul;
+  return 0;
+}
+
+void rsa_plan_clear(RSA_EXP_PLAN *pl) {
+  free(pl->op);
+  pl->op = NULL;
+  pl->nops = 0;
+}
+
+// rp = a ^ e for the e the plan was built from, both in Montgomery form
+// rp may alias ap
+void rsa_mont_powm_plan_n(mp_limb_t *rp, const mp_limb_t *ap, const RSA_EXP_PLAN *pl,
+                          const RSA_MONT *m) {
+  const mp_size_t s = m->size;
+  mp_limb_t tab[pl->tab * s]; // only the powers this exponent uses
+
+  // tab[i] = a ^ (2i + 1), rp = a ^ 2 while it is built
+  memcpy(tab, ap, s * sizeof(mp_limb_t));
+  if (pl->tab > 1) {
+    rsa_mont_sqr(rp, tab, m);
+    for (int i = 1; i < pl->tab; ++i) rsa_mont_mul(tab + i * s, tab + (i - 1) * s, rp, m);
+  }
+
+  memcpy(rp, tab + ((pl->op[0] & 0xff) - 1) * s, s * sizeof(mp_limb_t));
+  for (int i = 1; i < pl->nops; ++i) {
+    const uint32_t op = pl->op[i];
+    for (uint32_t k = op >> 8; k > 0; --k) rsa_mont_sqr(rp, rp, m);
+    if (op & 0xff) rsa_mont_mul(rp, rp, tab + ((op & 0xff) - 1) * s, m);
+  }
+}
+
+// rop = base ^ e mod n for the e the plan was built from
+void rsa_mont_powm_plan(mpz_t rop, const mpz_t base, const RSA_EXP_PLAN *pl, const RSA_MONT *m) {
+  mp_limb_t acc[RSA_MAX_LIMBS];
+  rsa_mont_to(acc, base, m);
+  rsa_mont_powm_plan_n(acc, acc, pl, m);
+  rsa_mont_from(rop, acc, m);
+}
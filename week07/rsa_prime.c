@@ -0,0 +1,322 @@
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "rsa.h"
+
+// Safe and strong primes
+//
+// Both searches walk an arithmetic progression x_k = a + k * m and need one
+// or more linear forms c * x_k + d to be prime at the same time:
+//   safe   p = 2q + 1: q = a + 6k (q = 5 mod 6), forms q and 2q + 1
+//   strong (Gordon): t, s random, r = 2it + 1, p = p0 + 2jrs, one form each
+// A window of SIEVE_LEN positions is crossed off against the first
+// SIEVE_PRIMES odd primes for every form at once, so a position reaches
+// Miller-Rabin only when all of its forms survived trial division. The
+// forms are then tested one round each before the full rounds, cheapest
+// rejection first.
+//
+// Threads race on independent random progressions (forked DRBGs) and the
+// first prime found wins. Since the search is memoryless, the total work
+// until then has the same expectation as a single thread.
+
+#define SIEVE_LEN    (1 << 14)
+#define SIEVE_PRIMES 2048
+#define PRIME_MR_ITER 50
+
+// Safe prime q / p density: 2 * C2 / (ln q ln p) (Hardy-Littlewood)
+#define TWIN_CONST 0.6601618158
+#define LN2        0.6931471805599453
+
+static uint32_t small_primes[SIEVE_PRIMES]; // 3, 5, 7, ...
+static pthread_once_t small_once = PTHREAD_ONCE_INIT;
+
+static void small_init(void) {
+  int n = 0;
+  for (uint32_t c = 3; n < SIEVE_PRIMES; c += 2) {
+    int prime = 1;
+    for (int i = 0; i < n && small_primes[i] * small_primes[i] <= c; ++i) {
+      if (c % small_primes[i] == 0) {
+        prime = 0;
+        break;
+      }
+    }
+    if (prime) small_primes[n++] = c;
+  }
+}
+
+// x ^ -1 mod p, p prime and x != 0 mod p
+static uint32_t inv_mod(uint32_t x, uint32_t p) {
+  uint64_t r = 1, b = x % p;
+  for (uint32_t e = p - 2; e; e >>= 1) {
+    if (e & 1) r = r * b % p;
+    b = b * b % p;
+  }
+  return (uint32_t)r;
+}
+
+typedef struct __PRIME_FORM {
+  unsigned long c, d; // c * x + d
+} PRIME_FORM;
+
+typedef struct __PRIME_JOB {
+  RSA_DRBG rnd;
+  uint64_t positions, survivors, mr_rounds;
+} PRIME_JOB;
+
+typedef struct __PRIME_RACE {
+  int kind, bits;
+  atomic_int found;
+  pthread_mutex_t lock;
+  mpz_t result;
+  PRIME_JOB *job;
+} PRIME_RACE;
+
+// Every form prime, one round each before the full rounds
+static int forms_prime(mpz_t v, const mpz_t x, const PRIME_FORM *f, int nf, PRIME_JOB *job) {
+  for (int rounds = 1; rounds <= PRIME_MR_ITER; rounds += PRIME_MR_ITER - 1) {
+    for (int i = 0; i < nf; ++i) {
+      mpz_mul_ui(v, x, f[i].c);
+      mpz_add_ui(v, v, f[i].d);
+      job->mr_rounds += rounds;
+      if (!mpz_millerrabin(v, rounds)) return 0;
+    }
+  }
+  return 1;
+}
+
+// First x = a + k * m, k >= 0, with every form prime and x < 2 ^ limit
+// 0 if the progression passed the limit or another thread won
+static int sieve_search(mpz_t x, const mpz_t a, const mpz_t m, const PRIME_FORM *f, int nf,
+                        mp_bitcnt_t limit, PRIME_RACE *race, PRIME_JOB *job) {
+  static _Thread_local uint8_t dead[SIEVE_LEN];
+  mpz_t base, v;
+  int ret = 0;
+  mpz_init_set(base, a);
+  mpz_init(v);
+  while (!atomic_load_explicit(&race->found, memory_order_relaxed)) {
+    memset(dead, 0, sizeof(dead));
+    for (int i = 0; i < SIEVE_PRIMES; ++i) {
+      const uint32_t p = small_primes[i];
+      const uint32_t ar = mpz_fdiv_ui(base, p), mr = mpz_fdiv_ui(m, p);
+      for (int j = 0; j < nf; ++j) {
+        // c * (a + k * m) + d == 0 mod p  <=>  k == -(c * a + d) / (c * m)
+        const uint32_t cm = (uint32_t)((uint64_t)(f[j].c % p) * mr % p);
+        uint64_t k;
+        if (cm == 0) continue; // p divides the step, no information
+        k = (uint64_t)(f[j].c % p) * ar % p + f[j].d % p;
+        k = (p - k % p) % p * inv_mod(cm, p) % p;
+        for (; k < SIEVE_LEN; k += p) dead[k] = 1;
+      }
+    }
+    for (int k = 0; k < SIEVE_LEN; ++k) {
+      ++job->positions;
+      if (dead[k]) continue;
+      ++job->survivors;
+      mpz_set(x, m);
+      mpz_mul_ui(x, x, k);
+      mpz_add(x, x, base);
+      if (mpz_sizeinbase(x, 2) > limit) goto out;
+      if (forms_prime(v, x, f, nf, job)) {
+        ret = 1;
+        goto out;
+      }
+      if (atomic_load_explicit(&race->found, memory_order_relaxed)) goto out;
+    }
+    mpz_addmul_ui(base, m, SIEVE_LEN);
+  }
+out:
+  mpz_clears(base, v, NULL);
+  return ret;
+}
+
+// Random prime of exactly `bits` bits
+static int random_prime(mpz_t x, int bits, PRIME_RACE *race, PRIME_JOB *job) {
+  static const PRIME_FORM one = {1, 0};
+  mpz_t a, m;
+  int ret;
+  mpz_inits(a, m, NULL);
+  mpz_set_ui(m, 2);
+  do {
+    rsa_drbg_urandomb(a, &job->rnd, bits);
+    mpz_setbit(a, bits - 1);
+    mpz_setbit(a, 0);
+    ret = sieve_search(x, a, m, &one, 1, bits, race, job);
+  } while (!ret && !atomic_load(&race->found));
+  mpz_clears(a, m, NULL);
+  return ret;
+}
+
+// p = 2q + 1, q = 5 mod 6 so that neither q nor p is a multiple of 2 or 3
+static int safe_search(mpz_t p, int bits, PRIME_RACE *race, PRIME_JOB *job) {
+  static const PRIME_FORM forms[2] = {{1, 0}, {2, 1}};
+  mpz_t a, m, q;
+  int ret;
+  mpz_inits(a, m, q, NULL);
+  mpz_set_ui(m, 6);
+  do {
+    rsa_drbg_urandomb(a, &job->rnd, bits - 1);
+    mpz_setbit(a, bits - 2);
+    mpz_add_ui(a, a, 5 - mpz_fdiv_ui(a, 6) + 6);
+    ret = sieve_search(q, a, m, forms, 2, bits - 1, race, job);
+  } while (!ret && !atomic_load(&race->found));
+  if (ret) {
+    mpz_mul_2exp(p, q, 1);
+    mpz_add_ui(p, p, 1);
+  }
+  mpz_clears(a, m, q, NULL);
+  return ret;
+}
+
+// Gordon's algorithm: r | p - 1, s | p + 1, t | r - 1, all about bits / 2
+static int strong_search(mpz_t p, int bits, PRIME_RACE *race, PRIME_JOB *job) {
+  static const PRIME_FORM one = {1, 0};
+  const int rbits = bits / 2 - 8, tbits = rbits - 16;
+  mpz_t s, t, r, a, m;
+  int ret = 0;
+  mpz_inits(s, t, r, a, m, NULL);
+  for (;;) {
+    if (!random_prime(t, tbits, race, job) || !random_prime(s, rbits, race, job)) break;
+    // r = 2it + 1 from i = 2 ^ (rbits - tbits - 2) + random, so |r| = rbits
+    rsa_drbg_urandomb(a, &job->rnd, rbits - tbits - 2);
+    mpz_setbit(a, rbits - tbits - 2);
+    mpz_mul(a, a, t);
+    mpz_mul_2exp(a, a, 1);
+    mpz_add_ui(a, a, 1);
+    mpz_mul_2exp(m, t, 1);
+    if (!sieve_search(r, a, m, &one, 1, rbits, race, job)) {
+      if (atomic_load(&race->found)) break;
+      continue;
+    }
+    // p0 = 2 (s ^ (r - 2) mod r) s - 1, then p = p0 + 2jrs >= 2 ^ (bits - 1)
+    mpz_sub_ui(a, r, 2);
+    mpz_powm(a, s, a, r);
+    mpz_mul(a, a, s);
+    mpz_mul_2exp(a, a, 1);
+    mpz_sub_ui(a, a, 1);
+    mpz_mul(m, r, s);
+    mpz_mul_2exp(m, m, 1);
+    mpz_set_ui(p, 0);
+    mpz_setbit(p, bits - 1);
+    if (mpz_cmp(a, p) < 0) {
+      // a += ceil((2 ^ (bits - 1) - a) / m) * m
+      mpz_sub(p, p, a);
+      mpz_cdiv_q(p, p, m);
+      mpz_addmul(a, p, m);
+    }
+    if (sieve_search(p, a, m, &one, 1, bits, race, job)) {
+      ret = 1;
+      break;
+    }
+    if (atomic_load(&race->found)) break;
+  }
+  mpz_clears(s, t, r, a, m, NULL);
+  return ret;
+}
+
+static void *prime_worker(void *arg) {
+  PRIME_RACE *race = ((void**)arg)[0];
+  PRIME_JOB *job = ((void**)arg)[1];
+  mpz_t p;
+  int ok;
+  mpz_init(p);
+  if (race->kind == RSA_PRIME_SAFE) ok = safe_search(p, race->bits, race, job);
+  else ok = strong_search(p, race->bits, race, job);
+  if (ok) {
+    pthread_mutex_lock(&race->lock);
+    if (!atomic_load(&race->found)) {
+      mpz_swap(race->result, p);
+      atomic_store(&race->found, 1);
+    }
+    pthread_mutex_unlock(&race->lock);
+  }
+  mpz_clear(p);
+  return NULL;
+}
+
+// Mertens-style product over the sieve primes from `from` on: share of
+// positions where `forms` residues are all nonzero
+static double sieve_survival(uint32_t from, int forms) {
+  double r = 1.0;
+  for (int i = 0; i < SIEVE_PRIMES; ++i) {
+    if (small_primes[i] >= from) r *= 1.0 - (double)forms / small_primes[i];
+  }
+  return r;
+}
+
+// Heuristic cost of one prime: positions and sieve survivors
+static void prime_expect(RSA_PRIME_STATS *st, int kind, int bits) {
+  if (kind == RSA_PRIME_SAFE) {
+    // 1 in 6 integers is 5 mod 6
+    const double lq = (bits - 1) * LN2, lp = bits * LN2;
+    st->exp_positions = lq * lp / (6 * 2 * TWIN_CONST);
+    st->exp_survivors = st->exp_positions * sieve_survival(5, 2);
+  } else {
+    // Four odd progressions (t, s, r, p); a prime step m scales the
+    // density by m / phi(m), which is 1 here up to the small factors of i
+    const int rbits = bits / 2 - 8, tbits = rbits - 16;
+    const double sizes[4] = {tbits, rbits, rbits, bits};
+    st->exp_positions = st->exp_survivors = 0;
+    for (int i = 0; i < 4; ++i) {
+      const double n = sizes[i] * LN2 / 2;
+      st->exp_positions += n;
+      st->exp_survivors += n * sieve_survival(3, 1);
+    }
+  }
+}
+
+// p = safe or strong prime of exactly `bits` bits, -1 on bad arguments
+// Threads draw from children of `rnd`, st may be NULL
+int rsa_prime_gen(mpz_t p, int bits, int kind, int threads, RSA_DRBG *rnd, RSA_PRIME_STATS *st) {
+  PRIME_RACE race;
+  pthread_t *tid;
+  void *(*args)[2];
+  uint64_t id;
+  int started = 0;
+
+  if (bits < 128 || threads < 1 || (kind != RSA_PRIME_SAFE && kind != RSA_PRIME_STRONG)) {
+    return -1;
+  }
+  pthread_once(&small_once, small_init);
+
+  race.kind = kind;
+  race.bits = bits;
+  atomic_init(&race.found, 0);
+  pthread_mutex_init(&race.lock, NULL);
+  mpz_init(race.result);
+  race.job = calloc(threads, sizeof(PRIME_JOB));
+  tid = malloc(threads * sizeof(pthread_t));
+  args = malloc(threads * sizeof(*args));
+  if (!race.job || !tid || !args) goto out;
+
+  // A fresh id base keeps successive calls on different children
+  rsa_drbg_bytes(rnd, &id, sizeof(id));
+  for (int i = 0; i < threads; ++i) {
+    rsa_drbg_fork(&race.job[i].rnd, rnd, id + i);
+    args[i][0] = &race;
+    args[i][1] = &race.job[i];
+    if (pthread_create(&tid[i], NULL, prime_worker, args[i]) != 0) break;
+    ++started;
+  }
+  for (int i = 0; i < started; ++i) pthread_join(tid[i], NULL);
+
+  if (atomic_load(&race.found)) mpz_swap(p, race.result);
+  if (st) {
+    memset(st, 0, sizeof(*st));
+    for (int i = 0; i < started; ++i) {
+      st->positions += race.job[i].positions;
+      st->survivors += race.job[i].survivors;
+      st->mr_rounds += race.job[i].mr_rounds;
+    }
+    prime_expect(st, kind, bits);
+  }
+  for (int i = 0; i < threads; ++i) rsa_drbg_clear(&race.job[i].rnd);
+
+out:
+  free(race.job);
+  free(tid);
+  free(args);
+  mpz_clear(race.result);
+  pthread_mutex_destroy(&race.lock);
+  return started > 0 && atomic_load(&race.found) ? 0 : -1;
+}
@@ -0,0 +1,102 @@
+#include <string.h>
+
+#include "rsa.h"
+
+// SHA-256 (FIPS 180-4)
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t h[8], const uint8_t *p) {
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, hh, t1, t2;
+
+  for (int i = 0; i < 16; ++i) {
+    w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16
+         | (uint32_t)p[4 * i + 2] << 8 | (uint32_t)p[4 * i + 3];
+  }
+  for (int i = 16; i < 64; ++i) {
+    uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  a = h[0]; b = h[1]; c = h[2]; d = h[3];
+  e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+  for (int i = 0; i < 64; ++i) {
+    t1 = hh + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    hh = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+  h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+void rsa_sha256_init(RSA_SHA256 *ctx) {
+  ctx->h[0] = 0x6a09e667; ctx->h[1] = 0xbb67ae85;
+  ctx->h[2] = 0x3c6ef372; ctx->h[3] = 0xa54ff53a;
+  ctx->h[4] = 0x510e527f; ctx->h[5] = 0x9b05688c;
+  ctx->h[6] = 0x1f83d9ab; ctx->h[7] = 0x5be0cd19;
+  ctx->len = 0;
+}
+
+void rsa_sha256_update(RSA_SHA256 *ctx, const void *data, size_t len) {
+  const uint8_t *p = data;
+  size_t fill = ctx->len % 64;
+
+  if (len == 0) return; // data may be NULL then (empty OAEP label)
+  ctx->len += len;
+  // 1. Complete the pending block
+  if (fill) {
+    size_t n = 64 - fill < len ? 64 - fill : len;
+    memcpy(ctx->buf + fill, p, n);
+    p += n;
+    len -= n;
+    if (fill + n < 64) return;
+    sha256_block(ctx->h, ctx->buf);
+  }
+  // 2. Hash full blocks straight from the input
+  for (; len >= 64; p += 64, len -= 64) sha256_block(ctx->h, p);
+  // 3. Keep the tail
+  memcpy(ctx->buf, p, len);
+}
+
+void rsa_sha256_final(RSA_SHA256 *ctx, uint8_t *out) {
+  uint64_t bits = ctx->len * 8;
+  size_t fill = ctx->len % 64;
+
+  ctx->buf[fill++] = 0x80;
+  if (fill > 56) {
+    memset(ctx->buf + fill, 0, 64 - fill);
+    sha256_block(ctx->h, ctx->buf);
+    fill = 0;
+  }
+  memset(ctx->buf + fill, 0, 56 - fill);
+  for (int i = 0; i < 8; ++i) ctx->buf[63 - i] = (uint8_t)(bits >> (8 * i));
+  sha256_block(ctx->h, ctx->buf);
+
+  for (int i = 0; i < 8; ++i) {
+    out[4 * i]     = (uint8_t)(ctx->h[i] >> 24);
+    out[4 * i + 1] = (uint8_t)(ctx->h[i] >> 16);
+    out[4 * i + 2] = (uint8_t)(ctx->h[i] >> 8);
+    out[4 * i + 3] = (uint8_t)(ctx->h[i]);
+  }
+}
+
+void rsa_sha256(uint8_t *out, const void *data, size_t len) {
+  RSA_SHA256 ctx;
+  rsa_sha256_init(&ctx);
+  rsa_sha256_update(&ctx, data, len);
+  rsa_sha256_final(&ctx, out);
+}
@@ -0,0 +1,290 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "rsa.h"
+
+// Batched public exponentiation, one modulus per vector lane
+//
+// Every lane runs the same Montgomery multiplication on its own modulus.
+// Values are split into radix 2 ^ r digits and stored interleaved, digit j
+// of lane l at v[j * lanes + l], so one vector load brings digit j of every
+// lane.
+//   IFMA: 8 lanes, r = 52, vpmadd52luq / vpmadd52huq
+//   AVX2: 4 lanes, r = 26, vpmuludq (32 x 32 -> 64)
+//   otherwise rsa_pub_exp, one key at a time
+// R = 2 ^ (r * d) > 4n, so the products stay below 2n without a final
+// subtraction (lazy reduction) and only the result is fixed up.
+// The kernels accumulate a column of partial products per 64-bit word
+// without carrying, 4d * 2 ^ 52 < 2 ^ 63 bounds it for every MAX_RSA_SIZE
+// up to 16384. Work buffers are sized from d, not from MAX_RSA_SIZE.
+
+typedef void (*SIMD_MUL)(uint64_t*, const uint64_t*, const uint64_t*,
+                         const uint64_t*, const uint64_t*, int);
+
+typedef struct __SIMD_KERNEL {
+  int lanes;
+  int radix;
+  SIMD_MUL mul;
+} SIMD_KERNEL;
+
+#define DIGIT_MASK(r) (((uint64_t)1 << (r)) - 1)
+
+#ifdef __x86_64__
+// rp = a * b * R ^ -1 mod n in every lane, rp may alias a or b
+// t[i + j] collects a_j * b_i and n_j * q_i, digit i is zero after row i
+__attribute__((target("avx512f,avx512ifma")))
+static void mul_ifma(uint64_t *rp, const uint64_t *ap, const uint64_t *bp,
+                     const uint64_t *np, const uint64_t *k0p, int d) {
+  __m512i t[2 * d + 1];
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i mask = _mm512_set1_epi64(DIGIT_MASK(52));
+  const __m512i k0 = _mm512_loadu_si512(k0p);
+
+  for (int j = 0; j <= 2 * d; ++j) t[j] = zero;
+  for (int i = 0; i < d; ++i) {
+    const __m512i b = _mm512_loadu_si512(bp + 8 * i);
+    // q only needs the low digit, so both rows go in one pass
+    const __m512i q = _mm512_and_si512(_mm512_madd52lo_epu64(zero,
+        _mm512_madd52lo_epu64(t[i], _mm512_loadu_si512(ap), b), k0), mask);
+    for (int j = 0; j < d; ++j) {
+      const __m512i a = _mm512_loadu_si512(ap + 8 * j);
+      const __m512i n = _mm512_loadu_si512(np + 8 * j);
+      t[i + j]     = _mm512_madd52lo_epu64(_mm512_madd52lo_epu64(t[i + j], a, b), n, q);
+      t[i + j + 1] = _mm512_madd52hi_epu64(_mm512_madd52hi_epu64(t[i + j + 1], a, b), n, q);
+    }
+    t[i + 1] = _mm512_add_epi64(t[i + 1], _mm512_srli_epi64(t[i], 52));
+  }
+  for (int j = d; j < 2 * d; ++j) {
+    t[j + 1] = _mm512_add_epi64(t[j + 1], _mm512_srli_epi64(t[j], 52));
+    _mm512_storeu_si512(rp + 8 * (j - d), _mm512_and_si512(t[j], mask));
+  }
+}
+
+__attribute__((target("avx2")))
+static void mul_avx2(uint64_t *rp, const uint64_t *ap, const uint64_t *bp,
+                     const uint64_t *np, const uint64_t *k0p, int d) {
+  __m256i t[2 * d + 1];
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i mask = _mm256_set1_epi64x(DIGIT_MASK(26));
+  const __m256i k0 = _mm256_loadu_si256((const __m256i*)k0p);
+
+  for (int j = 0; j <= 2 * d; ++j) t[j] = zero;
+  for (int i = 0; i < d; ++i) {
+    const __m256i b = _mm256_loadu_si256((const __m256i*)(bp + 4 * i));
+    const __m256i a0 = _mm256_loadu_si256((const __m256i*)ap);
+    const __m256i q = _mm256_and_si256(_mm256_mul_epu32(
+        _mm256_add_epi64(t[i], _mm256_mul_epu32(a0, b)), k0), mask);
+    for (int j = 0; j < d; ++j) {
+      const __m256i a = _mm256_loadu_si256((const __m256i*)(ap + 4 * j));
+      const __m256i n = _mm256_loadu_si256((const __m256i*)(np + 4 * j));
+      t[i + j] = _mm256_add_epi64(t[i + j],
+          _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_mul_epu32(n, q)));
+    }
+    t[i + 1] = _mm256_add_epi64(t[i + 1], _mm256_srli_epi64(t[i], 26));
+  }
+  for (int j = d; j < 2 * d; ++j) {
+    t[j + 1] = _mm256_add_epi64(t[j + 1], _mm256_srli_epi64(t[j], 26));
+    _mm256_storeu_si256((__m256i*)(rp + 4 * (j - d)), _mm256_and_si256(t[j], mask));
+  }
+}
+#endif
+
+static const SIMD_KERNEL KERNELS[] = {
+  {0, 0, NULL},
+#ifdef __x86_64__
+  {4, 26, mul_avx2},
+  {8, 52, mul_ifma},
+#endif
+};
+
+static const char *LEVEL_NAME[] = {"scalar", "avx2", "ifma"};
+
+// Detection runs once (first callers may be on several threads), the
+// level in use is an atomic that rsa_simd_select can lower at any time
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+static int simd_detected;      // what the CPU (and RSA_SIMD) allows
+static atomic_int simd_level;  // in use
+
+static int simd_detect(void) {
+  const char *env = getenv("RSA_SIMD");
+  int level = RSA_SIMD_SCALAR;
+#ifdef __x86_64__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) level = RSA_SIMD_AVX2;
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma")) {
+    level = RSA_SIMD_IFMA;
+  }
+#endif
+  // RSA_SIMD=scalar|avx2|ifma caps the level
+  for (int i = 0; env && i < level; ++i) {
+    if (strcasecmp(env, LEVEL_NAME[i]) == 0) level = i;
+  }
+  return level;
+}
+
+static void simd_init(void) {
+  simd_detected = simd_detect();
+  atomic_store_explicit(&simd_level, simd_detected, memory_order_relaxed);
+}
+
+int rsa_simd_level(void) {
+  pthread_once(&simd_once, simd_init);
+  return atomic_load_explicit(&simd_level, memory_order_relaxed);
+}
+
+// Use at most `level`, returns the level in use
+int rsa_simd_select(int level) {
+  pthread_once(&simd_once, simd_init);
+  level = level < simd_detected ? (level < 0 ? 0 : level) : simd_detected;
+  atomic_store_explicit(&simd_level, level, memory_order_relaxed);
+  return level;
+}
+
+const char *rsa_simd_name(int level) {
+  return level >= 0 && level <= RSA_SIMD_IFMA ? LEVEL_NAME[level] : "?";
+}
+
+// Lane l of v = radix 2 ^ r digits of x
+static void to_digits(uint64_t *v, int lanes, int l, const mpz_t x, int d, int r) {
+  const mp_limb_t *xp = mpz_limbs_read(x);
+  const mp_size_t xn = mpz_size(x);
+  for (int j = 0; j < d; ++j) {
+    const mp_bitcnt_t bit = (mp_bitcnt_t)j * r;
+    const mp_size_t w = bit / GMP_NUMB_BITS;
+    const int s = bit % GMP_NUMB_BITS;
+    uint64_t digit = w < xn ? xp[w] >> s : 0;
+    if (s + r > GMP_NUMB_BITS && w + 1 < xn) digit |= xp[w + 1] << (GMP_NUMB_BITS - s);
+    v[j * lanes + l] = digit & DIGIT_MASK(r);
+  }
+}
+
+static void from_digits(mpz_t x, const uint64_t *v, int lanes, int l, int d, int r) {
+  mp_size_t n = ((mp_bitcnt_t)d * r + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+  mp_limb_t *xp = mpz_limbs_write(x, n);
+  memset(xp, 0, n * sizeof(mp_limb_t));
+  for (int j = 0; j < d; ++j) {
+    const mp_bitcnt_t bit = (mp_bitcnt_t)j * r;
+    const mp_size_t w = bit / GMP_NUMB_BITS;
+    const int s = bit % GMP_NUMB_BITS;
+    const uint64_t digit = v[j * lanes + l];
+    xp[w] |= digit << s;
+    if (s + r > GMP_NUMB_BITS) xp[w + 1] |= digit >> (GMP_NUMB_BITS - s);
+  }
+  while (n > 0 && xp[n - 1] == 0) --n;
+  mpz_limbs_finish(x, n);
+}
+
+// -n ^ -1 mod 2 ^ 64
+static uint64_t neg_inverse(uint64_t n0) {
+  uint64_t x = n0;
+  for (int i = 0; i < 6; ++i) x *= 2 - n0 * x;
+  return -x;
+}
+
+// Up to k->lanes operations, unused lanes repeat lane 0
+static void simd_chunk(const SIMD_KERNEL *k, mpz_ptr *out, mpz_srcptr *in,
+                       const RSA_PUBKEY **pub, int m) {
+  const int L = k->lanes, r = k->radix;
+  uint64_t k0[8];
+  int bits = 0, ebits = 0, same = 1, d;
+  mpz_t t;
+
+  for (int l = 0; l < m; ++l) {
+    const int nb = (int)mpz_sizeinbase(pub[l]->n, 2), eb = (int)mpz_sizeinbase(pub[l]->e, 2);
+    if (nb > bits) bits = nb;
+    if (eb > ebits) ebits = eb;
+    same = same && mpz_cmp(pub[l]->e, pub[0]->e) == 0;
+  }
+  if (mpz_sgn(pub[0]->e) == 0) same = 0; // x ^ 0 = 1, needs one
+  d = (bits + 2 + r - 1) / r; // R > 4n
+  uint64_t n[d * L], base[d * L], one[d * L], acc[d * L], op[d * L];
+
+  // n, k0 = -n ^ -1 mod 2 ^ r, base = in * R mod n, one = R mod n
+  mpz_init(t);
+  for (int l = 0; l < L; ++l) {
+    const int s = l < m ? l : 0;
+    const mpz_srcptr mod = pub[s]->n;
+    to_digits(n, L, l, mod, d, r);
+    k0[l] = neg_inverse(mpz_getlimbn(mod, 0)) & DIGIT_MASK(r);
+    mpz_mul_2exp(t, in[s], (mp_bitcnt_t)r * d);
+    mpz_mod(t, t, mod);
+    to_digits(base, L, l, t, d, r);
+    if (!same) {
+      mpz_set_ui(t, 0);
+      mpz_setbit(t, (mp_bitcnt_t)r * d);
+      mpz_mod(t, t, mod);
+      to_digits(one, L, l, t, d, r);
+    }
+  }
+
+  // Left to right over the longest e; a shorter e keeps one until its top
+  // bit, e = 0 (sizeinbase 1 all the same) keeps it throughout
+  for (int l = 0; l < L; ++l) {
+    const mpz_srcptr e = pub[l < m ? l : 0]->e;
+    const int top = mpz_sgn(e) != 0 && (same || (int)mpz_sizeinbase(e, 2) == ebits);
+    for (int j = 0; j < d; ++j) acc[j * L + l] = (top ? base : one)[j * L + l];
+  }
+  for (int i = ebits - 2; i >= 0; --i) {
+    int any = 0;
+    k->mul(acc, acc, acc, n, k0, d);
+    if (same) {
+      if (mpz_tstbit(pub[0]->e, i)) k->mul(acc, acc, base, n, k0, d);
+      continue;
+    }
+    for (int l = 0; l < L; ++l) {
+      const int bit = mpz_tstbit(pub[l < m ? l : 0]->e, i);
+      for (int j = 0; j < d; ++j) op[j * L + l] = (bit ? base : one)[j * L + l];
+      any |= bit;
+    }
+    if (any) k->mul(acc, acc, op, n, k0, d);
+  }
+
+  // Leave Montgomery form, a * 1 * R ^ -1 <= n
+  memset(op, 0, d * L * sizeof(uint64_t));
+  for (int l = 0; l < L; ++l) op[l] = 1;
+  k->mul(acc, acc, op, n, k0, d);
+  for (int l = 0; l < m; ++l) {
+    from_digits(t, acc, L, l, d, r);
+    if (mpz_cmp(t, pub[l]->n) >= 0) mpz_sub(t, t, pub[l]->n);
+    mpz_swap(out[l], t);
+  }
+  mpz_clear(t);
+}
+
+static void simd_flush(const SIMD_KERNEL *k, mpz_ptr *out, mpz_srcptr *in,
+                       const RSA_PUBKEY **pub, int m) {
+  RSA_STAT_START(t0);
+  simd_chunk(k, out, in, pub, m);
+  // One sample per lane, each at the chunk's latency
+  for (int l = 0; l < m; ++l) RSA_STAT_STOP(t0, RSA_STAT_PUB_EXP, pub[l]->RSA_SIZE);
+}
+
+// out[i] = in[i] ^ e_i mod n_i, out[i] may alias in[i]
+// Montgomery needs an odd n and the kernels a non-negative e, any other
+// lane takes the scalar rsa_pub_exp.
+void rsa_pub_exp_batch(mpz_ptr *out, mpz_srcptr *in, const RSA_PUBKEY **pub, int count) {
+  const SIMD_KERNEL *k = &KERNELS[rsa_simd_level()];
+  mpz_ptr lo[8];
+  mpz_srcptr li[8];
+  const RSA_PUBKEY *lp[8];
+  int m = 0;
+  for (int i = 0; i < count; ++i) {
+    if (!k->mul || !mpz_odd_p(pub[i]->n) || mpz_sgn(pub[i]->e) < 0) {
+      rsa_pub_exp(out[i], in[i], pub[i]);
+      continue;
+    }
+    lo[m] = out[i];
+    li[m] = in[i];
+    lp[m] = pub[i];
+    if (++m == k->lanes) {
+      simd_flush(k, lo, li, lp, m);
+      m = 0;
+    }
+  }
+  if (m) simd_flush(k, lo, li, lp, m);
+}
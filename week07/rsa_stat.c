@@ -0,0 +1,219 @@
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "rsa.h"
+
+// Per-thread counters and latency histograms
+//
+// Each thread owns one block and is its only writer, so recording is a
+// relaxed load/add/store with no lock and no shared cache line. A block
+// joins the list the first time its thread records something, and a
+// histogram (about 9 KB) is allocated the first time its (op, size) is
+// recorded, so a thread pays for the key sizes it uses, not MAX_RSA_SIZE.
+// When the thread exits its block is folded into stat_dead and freed, like
+// rsa_cache.c's reader slots, which keeps the totals monotonic. The lock
+// only guards the list: thread start and exit, and snapshots.
+
+typedef struct __STAT_HIST {
+  _Atomic uint64_t count, sum, max;
+  _Atomic uint64_t bucket[RSA_HIST_BUCKETS];
+} STAT_HIST;
+
+typedef struct __RSA_STAT_TLS {
+  struct __RSA_STAT_TLS *next;
+  _Atomic uint64_t counter[RSA_CNT_MAX];
+  _Atomic(STAT_HIST*) hist[RSA_STAT_OPS][RSA_STAT_SIZES];
+} RSA_STAT_TLS;
+
+static pthread_mutex_t stat_lock = PTHREAD_MUTEX_INITIALIZER;
+static RSA_STAT_TLS *stat_head;
+static RSA_STAT_TLS stat_dead; // exited threads
+static _Thread_local RSA_STAT_TLS *stat_self;
+static pthread_key_t stat_key;
+static pthread_once_t stat_once = PTHREAD_ONCE_INIT;
+
+static const char *OP_NAME[RSA_STAT_OPS] = {"keygen", "pri_exp", "pub_exp"};
+static const char *CNT_NAME[RSA_CNT_MAX] = {
+  "prime candidates", "MR rejected", "gcd rejected",
+  "MR rounds", "keygen size retries", "sieve rejected",
+};
+
+#define RELAXED memory_order_relaxed
+#define BUMP(x, v) atomic_store_explicit(&(x), atomic_load_explicit(&(x), RELAXED) + (v), RELAXED)
+
+static STAT_HIST *hist_get(RSA_STAT_TLS *b, int op, int s) {
+  STAT_HIST *h = atomic_load_explicit(&b->hist[op][s], memory_order_acquire);
+  if (h) return h;
+  h = calloc(1, sizeof(*h));
+  if (!h) abort();
+  atomic_store_explicit(&b->hist[op][s], h, memory_order_release);
+  return h;
+}
+
+// Adds a block's totals to dst, stat_lock held
+static void block_fold(RSA_STAT_TLS *dst, RSA_STAT_TLS *b) {
+  for (int i = 0; i < RSA_CNT_MAX; ++i) BUMP(dst->counter[i], atomic_load(&b->counter[i]));
+  for (int op = 0; op < RSA_STAT_OPS; ++op) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+      STAT_HIST *h = atomic_load(&b->hist[op][s]), *d;
+      if (!h) continue;
+      d = hist_get(dst, op, s);
+      BUMP(d->count, atomic_load(&h->count));
+      BUMP(d->sum, atomic_load(&h->sum));
+      if (atomic_load(&h->max) > atomic_load(&d->max)) atomic_store(&d->max, atomic_load(&h->max));
+      for (int i = 0; i < RSA_HIST_BUCKETS; ++i) BUMP(d->bucket[i], atomic_load(&h->bucket[i]));
+    }
+  }
+}
+
+static void stat_exit(void *arg) {
+  RSA_STAT_TLS *b = (RSA_STAT_TLS*)arg, **p;
+  pthread_mutex_lock(&stat_lock);
+  block_fold(&stat_dead, b);
+  for (p = &stat_head; *p != b; p = &(*p)->next);
+  *p = b->next;
+  pthread_mutex_unlock(&stat_lock);
+  for (int op = 0; op < RSA_STAT_OPS; ++op) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) free(atomic_load(&b->hist[op][s]));
+  }
+  free(b);
+  stat_self = NULL;
+}
+
+static void stat_key_init(void) {
+  pthread_key_create(&stat_key, stat_exit);
+}
+
+static RSA_STAT_TLS *stat_block(void) {
+  RSA_STAT_TLS *b = stat_self;
+  if (b) return b;
+  b = calloc(1, sizeof(*b));
+  if (!b) abort();
+  pthread_once(&stat_once, stat_key_init);
+  pthread_mutex_lock(&stat_lock);
+  b->next = stat_head;
+  stat_head = b;
+  pthread_mutex_unlock(&stat_lock);
+  pthread_setspecific(stat_key, b);
+  return stat_self = b;
+}
+
+// Log-linear bucket: exact below 2 ^ SUB, then 2 ^ SUB buckets per power of two
+static int hist_index(uint64_t v) {
+  int e, idx;
+  if (v < (1UL << RSA_HIST_SUB)) return (int)v;
+  e = 63 - __builtin_clzl(v);
+  idx = (e - RSA_HIST_SUB + 1) * (1 << RSA_HIST_SUB)
+      + (int)(v >> (e - RSA_HIST_SUB)) - (1 << RSA_HIST_SUB);
+  return idx < RSA_HIST_BUCKETS ? idx : RSA_HIST_BUCKETS - 1;
+}
+
+// Lower bound of a bucket
+static uint64_t hist_value(int idx) {
+  int e;
+  if (idx < (1 << RSA_HIST_SUB)) return idx;
+  e = idx / (1 << RSA_HIST_SUB) + RSA_HIST_SUB - 1;
+  return (uint64_t)(idx % (1 << RSA_HIST_SUB) + (1 << RSA_HIST_SUB)) << (e - RSA_HIST_SUB);
+}
+
+uint64_t rsa_stat_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+void rsa_stat_add(int cnt, uint64_t v) {
+  RSA_STAT_TLS *b = stat_block();
+  BUMP(b->counter[cnt], v);
+}
+
+void rsa_stat_record(int op, int size, uint64_t ns) {
+  RSA_STAT_TLS *b = stat_block();
+  STAT_HIST *h;
+  int s = size / 1024;
+  if (size % 1024 != 0 || s >= RSA_STAT_SIZES) s = 0;
+  h = hist_get(b, op, s);
+  BUMP(h->count, 1);
+  BUMP(h->sum, ns);
+  BUMP(h->bucket[hist_index(ns)], 1);
+  if (ns > atomic_load_explicit(&h->max, RELAXED)) atomic_store_explicit(&h->max, ns, RELAXED);
+}
+
+static void snapshot_add(RSA_STATS *st, RSA_STAT_TLS *b) {
+  for (int i = 0; i < RSA_CNT_MAX; ++i) {
+    st->counter[i] += atomic_load_explicit(&b->counter[i], RELAXED);
+  }
+  for (int op = 0; op < RSA_STAT_OPS; ++op) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+      STAT_HIST *src = atomic_load_explicit(&b->hist[op][s], memory_order_acquire);
+      RSA_HIST *h = st->latency[op][s];
+      uint64_t max;
+      if (!src) continue;
+      if (!h && !(h = st->latency[op][s] = calloc(1, sizeof(*h)))) abort();
+      max = atomic_load_explicit(&src->max, RELAXED);
+      h->count += atomic_load_explicit(&src->count, RELAXED);
+      h->sum   += atomic_load_explicit(&src->sum, RELAXED);
+      if (max > h->max) h->max = max;
+      for (int i = 0; i < RSA_HIST_BUCKETS; ++i) {
+        h->bucket[i] += atomic_load_explicit(&src->bucket[i], RELAXED);
+      }
+    }
+  }
+}
+
+// Sum every thread's block, live and exited
+void rsa_stats_snapshot(RSA_STATS *st) {
+  memset(st, 0, sizeof(*st));
+  pthread_mutex_lock(&stat_lock);
+  snapshot_add(st, &stat_dead);
+  for (RSA_STAT_TLS *b = stat_head; b; b = b->next) snapshot_add(st, b);
+  pthread_mutex_unlock(&stat_lock);
+}
+
+void rsa_stats_clear(RSA_STATS *st) {
+  for (int op = 0; op < RSA_STAT_OPS; ++op) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+      free(st->latency[op][s]);
+      st->latency[op][s] = NULL;
+    }
+  }
+}
+
+// q in [0, 100]
+// Nearest rank, ceil(q / 100 * count) in [1, count], reported as the upper
+// bound of its bucket (never above max) so the tail is not biased low
+uint64_t rsa_hist_percentile(const RSA_HIST *h, double q) {
+  const double r = q / 100.0 * h->count;
+  uint64_t rank, seen = 0;
+  if (h->count == 0) return 0;
+  rank = r > 0 ? (uint64_t)r : 0;
+  if (rank < r) ++rank; // ceil without libm
+  if (rank < 1) rank = 1;
+  if (rank > h->count) rank = h->count;
+  for (int i = 0; i + 1 < RSA_HIST_BUCKETS; ++i) {
+    seen += h->bucket[i];
+    if (seen >= rank) return hist_value(i + 1) - 1 < h->max ? hist_value(i + 1) - 1 : h->max;
+  }
+  return h->max;
+}
+
+void rsa_stats_print(FILE *fp, const RSA_STATS *st) {
+  for (int i = 0; i < RSA_CNT_MAX; ++i) {
+    fprintf(fp, "%-22s %12lu\n", CNT_NAME[i], (unsigned long)st->counter[i]);
+  }
+  fprintf(fp, "%-8s %6s %10s %12s %12s %12s %12s\n",
+    "op", "size", "count", "mean(us)", "p50(us)", "p99(us)", "max(us)");
+  for (int op = 0; op < RSA_STAT_OPS; ++op) {
+    for (int s = 0; s < RSA_STAT_SIZES; ++s) {
+      const RSA_HIST *h = st->latency[op][s];
+      if (!h || h->count == 0) continue;
+      char size[16] = "other";
+      if (s) snprintf(size, sizeof(size), "%d", s * 1024);
+      fprintf(fp, "%-8s %6s %10lu %12.1f %12.1f %12.1f %12.1f\n",
+        OP_NAME[op], size, (unsigned long)h->count, h->sum / 1e3 / h->count,
+        rsa_hist_percentile(h, 50) / 1e3, rsa_hist_percentile(h, 99) / 1e3, h->max / 1e3);
+    }
+  }
+}
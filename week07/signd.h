@@ -0,0 +1,40 @@
+#ifndef __SIGND_H__
+#define __SIGND_H__
+
+#include <stdint.h>
+
+// Local signing daemon protocol (host byte order, Unix domain socket)
+//
+// Request : SIGND_HDR + len bytes
+//   SIGND_OP_SIGN      : payload is the message, hashed with SHA-256, at
+//                        most SIGND_MAX_MSG bytes (hash longer ones first)
+//   SIGND_OP_SIGN_HASH : payload is the SHA-256 digest, RSA_HASH_SIZE bytes
+//   SIGND_OP_PUBKEY    : no payload
+// Response: SIGND_HDR (id echoed back, op holds the status) + len bytes
+//   SIGN, SIGN_HASH -> RSASSA-PSS signature (SHA-256, MGF1, 32-byte salt),
+//                      k bytes
+//   PUBKEY          -> n, k bytes (e is always 0x10001)
+// k is the byte length of the key's n. Responses on one connection may come
+// back out of order, match them by id.
+
+#define SIGND_SOCKET  "/tmp/rsa_signd.sock"
+#define SIGND_MAX_MSG 4096
+
+#define SIGND_OP_SIGN      1
+#define SIGND_OP_PUBKEY    2
+#define SIGND_OP_SIGN_HASH 3
+
+#define SIGND_OK        0
+#define SIGND_ERR_KEY   1
+#define SIGND_ERR_LEN   2
+#define SIGND_ERR_OP    3
+#define SIGND_ERR_SIGN  4
+
+typedef struct __SIGND_HDR {
+  uint32_t id;
+  uint16_t op;
+  uint16_t key;
+  uint32_t len;
+} SIGND_HDR;
+
+#endif
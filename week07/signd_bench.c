@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "rsa.h"
+#include "signd.h"
+
+// Load generator for signd
+// Each thread keeps `depth` SIGN requests in flight on its own connection
+// and records the latency of every response. Every 64th signature of key 0
+// is checked with rsa_pss_verify.
+
+#define DEFAULT_CONNS    4
+#define DEFAULT_REQUESTS 1000
+#define DEFAULT_DEPTH    8
+#define MAX_DEPTH        256
+#define MSG_BYTES        64
+
+static const char *sock_path = SIGND_SOCKET;
+static int nconns = DEFAULT_CONNS, nreq = DEFAULT_REQUESTS, depth = DEFAULT_DEPTH, nkeys = 1;
+
+typedef struct __CLIENT {
+  pthread_t tid;
+  int id;
+  int errors;
+  uint64_t *lat;
+} CLIENT;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int connect_daemon(void) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+  uint8_t *p = buf;
+  while (len) {
+    ssize_t n = read(fd, p, len);
+    if (n <= 0) return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+  const uint8_t *p = buf;
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0) return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int send_sign(int fd, uint32_t id, int key, const uint8_t *msg) {
+  SIGND_HDR hdr = {id, SIGND_OP_SIGN, (uint16_t)key, MSG_BYTES};
+  uint8_t frame[sizeof(SIGND_HDR) + MSG_BYTES];
+  memcpy(frame, &hdr, sizeof(hdr));
+  memcpy(frame + sizeof(hdr), msg, MSG_BYTES);
+  return write_full(fd, frame, sizeof(hdr) + MSG_BYTES);
+}
+
+static void *client_main(void *arg) {
+  CLIENT *cl = arg;
+  uint8_t msg[MSG_BYTES], res[RSA_MAX_BYTES];
+  uint64_t *sent_at = malloc(nreq * sizeof(*sent_at));
+  SIGND_HDR hdr = {0, SIGND_OP_PUBKEY, 0, 0};
+  RSA_PUBKEY pub;
+  size_t kbytes;
+  int fd, sent = 0, recv = 0;
+
+  fd = connect_daemon();
+  if (fd < 0 || !sent_at) {
+    perror("connect");
+    cl->errors = nreq;
+    free(sent_at);
+    return NULL;
+  }
+
+  // 1. Fetch key 0 so that a sample of the signatures can be checked
+  rsa_key_init(&pub, NULL);
+  mpz_set_ui(pub.e, 0x10001);
+  if (write_full(fd, &hdr, sizeof(hdr)) < 0 || read_full(fd, &hdr, sizeof(hdr)) < 0
+      || hdr.op != SIGND_OK || read_full(fd, res, hdr.len) < 0) {
+    fprintf(stderr, "PUBKEY failed\n");
+    cl->errors = nreq;
+    goto out;
+  }
+  kbytes = hdr.len;
+  rsa_os2ip(pub.n, res, kbytes);
+  pub.RSA_SIZE = (int)mpz_sizeinbase(pub.n, 2);
+  if (rsa_key_plan(&pub) != 0) {
+    fprintf(stderr, "bad public key\n");
+    cl->errors = nreq;
+    goto out;
+  }
+
+  for (size_t i = 0; i < MSG_BYTES; ++i) msg[i] = (uint8_t)(i * 131 + cl->id);
+
+  // 2. Closed loop with `depth` requests in flight
+  while (recv < nreq) {
+    while (sent < nreq && sent - recv < depth) {
+      msg[1] = (uint8_t)sent;
+      sent_at[sent] = now_ns();
+      if (send_sign(fd, sent, sent % nkeys, msg) < 0) goto out;
+      ++sent;
+    }
+    if (read_full(fd, &hdr, sizeof(hdr)) < 0 || hdr.id >= (uint32_t)sent
+        || hdr.len > RSA_MAX_BYTES || read_full(fd, res, hdr.len) < 0) goto out;
+    cl->lat[recv++] = now_ns() - sent_at[hdr.id];
+    if (hdr.op != SIGND_OK) {
+      ++cl->errors;
+    } else if (hdr.id % nkeys == 0 && hdr.id % 64 == 0) {
+      msg[1] = (uint8_t)hdr.id;
+      if (hdr.len != kbytes || rsa_pss_verify(res, msg, MSG_BYTES, &pub) != 0) ++cl->errors;
+    }
+  }
+
+out:
+  cl->errors += nreq - recv;
+  rsa_key_clear(&pub, NULL);
+  close(fd);
+  free(sent_at);
+  return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+static void usage(void) {
+  puts("Usage: signd_bench [-s socket] [-c connections] [-n requests] [-p depth] [-k keys]");
+  exit(0);
+}
+
+int main(int argc, char *argv[]) {
+  static const double pct[] = {50, 90, 99, 99.9};
+  CLIENT *cl;
+  uint64_t *all, start, elapsed;
+  int opt, errors = 0;
+  size_t total;
+
+  while ((opt = getopt(argc, argv, "s:c:n:p:k:h")) != -1) {
+    switch (opt) {
+    case 's': sock_path = optarg; break;
+    case 'c': nconns    = atoi(optarg); break;
+    case 'n': nreq      = atoi(optarg); break;
+    case 'p': depth     = atoi(optarg); break;
+    case 'k': nkeys     = atoi(optarg); break;
+    default: usage();
+    }
+  }
+  if (nconns <= 0 || nreq <= 0 || nkeys <= 0) usage();
+  if (depth <= 0 || depth > MAX_DEPTH) usage();
+
+  total = (size_t)nconns * nreq;
+  cl = calloc(nconns, sizeof(*cl));
+  all = malloc(total * sizeof(*all));
+  if (!cl || !all) return 1;
+
+  start = now_ns();
+  for (int i = 0; i < nconns; ++i) {
+    cl[i].id = i;
+    cl[i].lat = all + (size_t)i * nreq;
+    pthread_create(&cl[i].tid, NULL, client_main, &cl[i]);
+  }
+  for (int i = 0; i < nconns; ++i) {
+    pthread_join(cl[i].tid, NULL);
+    errors += cl[i].errors;
+  }
+  elapsed = now_ns() - start;
+
+  qsort(all, total, sizeof(*all), cmp_u64);
+  printf("Requests  : %zu (%d errors)\n", total, errors);
+  printf("Throughput: %.1f sign/s\n", total / (elapsed / 1e9));
+  for (size_t i = 0; i < sizeof(pct) / sizeof(pct[0]); ++i) {
+    size_t idx = (size_t)(pct[i] / 100.0 * (total - 1));
+    printf("p%-5g    : %.1f us\n", pct[i], all[idx] / 1e3);
+  }
+
+  free(all);
+  free(cl);
+  return errors != 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "rsa.h"
+
+// rsa_pub_exp one at a time vs rsa_pub_exp_batch on every kernel
+// The batch cycles through KEY_COUNT different moduli, so no two
+// neighbouring lanes share a key.
+
+#define KEY_SIZE 2048
+#define KEY_COUNT 8
+#define BATCH 64
+#define REPEAT_SIZE 100
+
+RSA_PUBKEY pub[KEY_COUNT];
+RSA_PRIKEY pri[KEY_COUNT];
+
+int main(int argc, char *argv[]) {
+  const RSA_PUBKEY *kp[BATCH];
+  mpz_t x[BATCH], y[BATCH], want[BATCH];
+  mpz_ptr yp[BATCH];
+  mpz_srcptr xp[BATCH];
+  gmp_randstate_t rnd;
+  const int top = rsa_simd_level();
+  double base;
+  clock_t start;
+
+  gmp_randinit_default(rnd);
+  for (int i = 0; i < KEY_COUNT; ++i) {
+    rsa_key_init(&pub[i], &pri[i]);
+    rsa_key_gen(&pub[i], &pri[i], KEY_SIZE, rnd);
+  }
+  for (int i = 0; i < BATCH; ++i) {
+    mpz_inits(x[i], y[i], want[i], NULL);
+    kp[i] = &pub[i % KEY_COUNT];
+    mpz_urandomm(x[i], rnd, kp[i]->n);
+    xp[i] = x[i];
+    yp[i] = y[i];
+  }
+
+  // (1) One at a time
+  start = clock();
+  for (int k = 0; k < REPEAT_SIZE; ++k) {
+    for (int i = 0; i < BATCH; ++i) rsa_pub_exp(want[i], x[i], kp[i]);
+  }
+  base = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("[rsa_pub_exp      ]: %f s, %.0f op/s\n", base, BATCH * REPEAT_SIZE / base);
+
+  // (2) Batched, best kernel first
+  for (int level = top; level >= RSA_SIMD_SCALAR; --level) {
+    double t;
+    int bad = 0;
+    rsa_simd_select(level);
+    start = clock();
+    for (int k = 0; k < REPEAT_SIZE; ++k) rsa_pub_exp_batch(yp, xp, kp, BATCH);
+    t = (double)(clock() - start) / CLOCKS_PER_SEC;
+    for (int i = 0; i < BATCH; ++i) bad += mpz_cmp(y[i], want[i]) != 0;
+    printf("[batch %-6s      ]: %f s, %.0f op/s, x%.2f%s\n", rsa_simd_name(level),
+           t, BATCH * REPEAT_SIZE / t, base / t, bad ? " MISMATCH" : "");
+  }
+
+  for (int i = 0; i < BATCH; ++i) mpz_clears(x[i], y[i], want[i], NULL);
+  for (int i = 0; i < KEY_COUNT; ++i) rsa_key_clear(&pub[i], &pri[i]);
+  gmp_randclear(rnd);
+  return 0;
+}
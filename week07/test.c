@@ -1,13 +1,51 @@
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "rsa.h"
 
 RSA_PUBKEY pub;
 RSA_PRIKEY pri;
 
+static int cache_loader(RSA_PRIKEY *k, uint64_t id, void *arg) {
+  if (id >= 8) return -1;
+  mpz_set(k->p, pri.p);
+  mpz_set(k->q, pri.q);
+  mpz_set(k->d, pri.d);
+  mpz_set(k->n, pri.n);
+  mpz_set(k->e, pri.e);
+  k->RSA_SIZE = pri.RSA_SIZE;
+  return 0;
+}
+
+// Exits holding a cached key
+static void *cache_thread(void *c) {
+  return (void*)rsa_cache_get((RSA_CACHE*)c, 0);
+}
+
+// Exits with one phase charged to its perf block
+static void *perf_thread(void *arg) {
+  rsa_perf_begin(RSA_PHASE_EXP, 3072);
+  rsa_perf_end();
+  return arg;
+}
+
+#ifdef WITH_RSA_STATS
+static void *stats_thread(void *arg) {
+  mpz_t x;
+  mpz_init_set_ui(x, 12345678);
+  rsa_pub_exp(x, x, &pub);
+  mpz_clear(x);
+  return arg;
+}
+#endif
+
 int main() {
+  static const uint8_t pad_seed[32] = {4, 5, 6};
   gmp_randstate_t rnd;
+  RSA_DRBG pad_rnd; // OAEP seeds and PSS salts
   gmp_randinit_default(rnd);
+  rsa_drbg_init(&pad_rnd, pad_seed, 0);
 
   rsa_key_init(&pub, &pri);
   rsa_key_gen(&pub, &pri, 2048, rnd);
@@ -22,7 +60,522 @@ int main() {
 
   gmp_printf("Original MSG: %Zx\nFinal MSG   : %Zx\n", testmsg, tmp2);
 
+  // (3) Test SHA-256
+  static const uint8_t abc_hash[RSA_HASH_SIZE] = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+  };
+  uint8_t hash[RSA_HASH_SIZE];
+  rsa_sha256(hash, "abc", 3);
+  printf("SHA-256     : %s\n", memcmp(hash, abc_hash, RSA_HASH_SIZE) ? "FAIL" : "OK");
+
+  // (4) Test RSAES-OAEP
+  uint8_t ct[RSA_MAX_BYTES], pt[RSA_MAX_BYTES], sig[RSA_MAX_BYTES];
+  const char *plain = "Attack at dawn";
+  size_t ptlen = 0;
+  int ok = rsa_oaep_encrypt(ct, (const uint8_t*)plain, strlen(plain), NULL, 0, &pub, &pad_rnd) == 0
+        && rsa_oaep_decrypt(pt, &ptlen, ct, NULL, 0, &pri) == 0
+        && ptlen == strlen(plain) && memcmp(pt, plain, ptlen) == 0;
+  ct[10] ^= 1;
+  ok = ok && rsa_oaep_decrypt(pt, &ptlen, ct, NULL, 0, &pri) != 0;
+  printf("RSAES-OAEP  : %s\n", ok ? "OK" : "FAIL");
+
+  // (5) Test RSASSA-PSS
+  ok = rsa_pss_sign(sig, (const uint8_t*)plain, strlen(plain), &pri, &pad_rnd) == 0
+    && rsa_pss_verify(sig, (const uint8_t*)plain, strlen(plain), &pub) == 0
+    && rsa_pss_verify(sig, (const uint8_t*)plain, strlen(plain) - 1, &pub) != 0;
+  // From the digest, in place
+  rsa_sha256(sig, plain, strlen(plain));
+  ok = ok && rsa_pss_sign_hash(sig, sig, &pri, &pad_rnd) == 0
+    && rsa_pss_verify(sig, (const uint8_t*)plain, strlen(plain), &pub) == 0;
+  printf("RSASSA-PSS  : %s\n", ok ? "OK" : "FAIL");
+
+  // (6) Test DRBG: same seed, same stream; forks differ
+  {
+    static const uint8_t seed[32] = {1, 2, 3};
+    RSA_DRBG g1, g2, c1, c2;
+    uint8_t b1[100], b2[100];
+    rsa_drbg_init(&g1, seed, 0);
+    rsa_drbg_init(&g2, seed, 0);
+    rsa_drbg_fork(&c1, &g1, 1);
+    rsa_drbg_fork(&c2, &g1, 2);
+    rsa_drbg_bytes(&g1, b1, sizeof(b1));
+    rsa_drbg_bytes(&g2, b2, sizeof(b2));
+    ok = memcmp(b1, b2, sizeof(b1)) == 0;
+    rsa_drbg_bytes(&c1, b1, sizeof(b1));
+    rsa_drbg_bytes(&c2, b2, sizeof(b2));
+    ok = ok && memcmp(b1, b2, sizeof(b1)) != 0;
+
+    RSA_PUBKEY pub2;
+    RSA_PRIKEY pri2;
+    rsa_key_init(&pub2, &pri2);
+    ok = ok && rsa_key_gen_drbg(&pub2, &pri2, 2048, &c1) == 0
+      && mpz_sizeinbase(pub2.n, 2) == 2048;
+    rsa_pub_exp(tmp, testmsg, &pub2);
+    rsa_pri_exp(tmp2, tmp, &pri2);
+    ok = ok && mpz_cmp(tmp2, testmsg) == 0;
+    rsa_key_clear(&pub2, &pri2);
+    printf("DRBG keygen : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (7) Exponent plans against mpz_powm, e = 1, 2, 3, 0x10001, dp
+  {
+    const unsigned long small[] = {1, 2, 3, 0x10001};
+    int ok = 1;
+    mpz_t e;
+    mpz_init(e);
+    for (int i = 0; i < 5; ++i) {
+      RSA_EXP_PLAN pl;
+      if (i < 4) mpz_set_ui(e, small[i]);
+      else mpz_set(e, pri.d);
+      rsa_plan_init(&pl, e);
+      rsa_mont_powm_plan(tmp, testmsg, &pl, &pub.mont);
+      mpz_powm(tmp2, testmsg, e, pub.n);
+      ok = ok && mpz_cmp(tmp, tmp2) == 0;
+      rsa_plan_clear(&pl);
+    }
+    mpz_clear(e);
+    printf("Exp plan    : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (8) Batched public operations on every available kernel
+  //     Mixed moduli and exponents, 11 lanes cross a chunk boundary, the
+  //     last chunk has only e = 0 and e = 1, lane 5 has an even modulus
+  {
+    enum { BATCH = 11 };
+    RSA_PUBKEY keys[BATCH];
+    const RSA_PUBKEY *kp[BATCH];
+    mpz_t x[BATCH], y[BATCH], want;
+    mpz_ptr yp[BATCH];
+    mpz_srcptr xp[BATCH];
+    const int top = rsa_simd_level();
+    int ok = 1;
+    mpz_init(want);
+    for (int i = 0; i < BATCH; ++i) {
+      rsa_key_init(&keys[i], NULL);
+      mpz_urandomb(keys[i].n, rnd, 1024 + 96 * i);
+      mpz_setbit(keys[i].n, 1024 + 96 * i - 1);
+      if (i != 5) mpz_setbit(keys[i].n, 0);
+      else mpz_clrbit(keys[i].n, 0);
+      if (i >= 8) mpz_set_ui(keys[i].e, i == 10);
+      else if (i % 3 == 0) mpz_set_ui(keys[i].e, 0x10001);
+      else if (i % 3 == 1) mpz_set_ui(keys[i].e, 3);
+      else mpz_urandomb(keys[i].e, rnd, 100);
+      keys[i].RSA_SIZE = 1024 + 96 * i;
+      mpz_inits(x[i], y[i], NULL);
+      mpz_urandomb(x[i], rnd, 1024 + 96 * i);
+      kp[i] = &keys[i];
+      xp[i] = x[i];
+      yp[i] = y[i];
+    }
+    for (int level = top; level >= RSA_SIMD_SCALAR; --level) {
+      int ok1 = 1;
+      rsa_simd_select(level);
+      rsa_pub_exp_batch(yp, xp, kp, BATCH);
+      for (int i = 0; i < BATCH; ++i) {
+        mpz_powm(want, x[i], keys[i].e, keys[i].n);
+        ok1 = ok1 && mpz_cmp(want, y[i]) == 0;
+      }
+      printf("Batch %-6s: %s\n", rsa_simd_name(level), ok1 ? "OK" : "FAIL");
+      ok = ok && ok1;
+    }
+    rsa_simd_select(top);
+    for (int i = 0; i < BATCH; ++i) {
+      rsa_key_clear(&keys[i], NULL);
+      mpz_clears(x[i], y[i], NULL);
+    }
+    mpz_clear(want);
+  }
+
+  // (9) Safe and strong primes
+  {
+    RSA_DRBG g;
+    uint8_t seed[32] = {9};
+    int ok;
+    mpz_t p, q;
+    mpz_inits(p, q, NULL);
+    rsa_drbg_init(&g, seed, 0);
+    ok = rsa_prime_gen(p, 256, RSA_PRIME_SAFE, 2, &g, NULL) == 0
+      && mpz_sizeinbase(p, 2) == 256 && mpz_probab_prime_p(p, 30);
+    mpz_fdiv_q_2exp(q, p, 1);
+    ok = ok && mpz_probab_prime_p(q, 30);
+    ok = ok && rsa_prime_gen(p, 256, RSA_PRIME_STRONG, 2, &g, NULL) == 0
+      && mpz_sizeinbase(p, 2) == 256 && mpz_probab_prime_p(p, 30);
+    mpz_clears(p, q, NULL);
+    printf("Safe/strong : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (10) Multi-exponentiation against a product of mpz_powm, k = 1 .. 5,
+  //      short exponents (joint table) and long ones (interleaved), e = 0
+  {
+    enum { K = 5 };
+    const int ebits[] = {0, 6, 128, 700, 2048};
+    mpz_t b[K], e[K];
+    mpz_srcptr bp[K], ep[K];
+    int ok = 1;
+    for (int i = 0; i < K; ++i) {
+      mpz_inits(b[i], e[i], NULL);
+      bp[i] = b[i];
+      ep[i] = e[i];
+    }
+    for (int t = 0; t < 6; ++t) {
+      for (int k = 1; k <= K; ++k) {
+        mpz_set_ui(tmp2, 1);
+        for (int i = 0; i < k; ++i) {
+          mpz_urandomb(b[i], rnd, 2100); // not reduced
+          mpz_urandomb(e[i], rnd, ebits[t < 5 ? (t + i) % 5 : 1]);
+          mpz_powm(tmp, b[i], e[i], pub.n);
+          mpz_mul(tmp2, tmp2, tmp);
+          mpz_mod(tmp2, tmp2, pub.n);
+        }
+        ok = ok && rsa_mont_multi_powm(tmp, bp, ep, k, &pub.mont) == 0
+          && mpz_cmp(tmp, tmp2) == 0;
+      }
+    }
+    for (int i = 0; i < K; ++i) mpz_clears(b[i], e[i], NULL);
+    printf("Multi-exp   : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (11) Inversion: binary GCD against mpz_invert, batches in place, and a
+  //      batch with one non-invertible value must fail and change nothing
+  {
+    enum { BATCH = 9 };
+    mpz_t x[BATCH], want[BATCH];
+    mpz_ptr xp[BATCH];
+    RSA_ARENA ar;
+    int ok = 1;
+    rsa_arena_init(&ar);
+    for (int i = 0; i < BATCH; ++i) {
+      mpz_inits(x[i], want[i], NULL);
+      mpz_urandomb(x[i], rnd, 64 * i + 1);
+      mpz_setbit(x[i], 64 * i);
+      ok = ok && rsa_invert(tmp, x[i], pri.p) == 0 && mpz_invert(tmp2, x[i], pri.p)
+        && mpz_cmp(tmp, tmp2) == 0;
+      mpz_urandomm(x[i], rnd, pub.n);
+      mpz_invert(want[i], x[i], pub.n);
+      xp[i] = x[i];
+    }
+    mpz_mul_ui(tmp, pri.p, 3);
+    ok = ok && rsa_invert(tmp2, tmp, pub.n) == -1;
+    ok = ok && rsa_inv_batch(xp, (mpz_srcptr*)xp, BATCH, &pub.mont, &ar) == 0;
+    for (int i = 0; i < BATCH; ++i) ok = ok && mpz_cmp(x[i], want[i]) == 0;
+    mpz_set(x[BATCH / 2], pri.q);
+    ok = ok && rsa_inv_batch(xp, (mpz_srcptr*)xp, BATCH, &pub.mont, NULL) == -1
+      && mpz_cmp(x[0], want[0]) == 0;
+    for (int i = 0; i < BATCH; ++i) mpz_clears(x[i], want[i], NULL);
+    rsa_arena_clear(&ar);
+    printf("Inversion   : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (12) Packed private key against rsa_pri_exp, 0, 1, p, n - 1 and random
+  {
+    RSA_HOTKEY hk;
+    int ok = rsa_hotkey_init(&hk, &pri) == 0 && (uintptr_t)hk.blob % 64 == 0;
+    for (int i = 0; i < 8 && ok; ++i) {
+      if (i < 2) mpz_set_ui(tmp, i);
+      else if (i == 2) mpz_set(tmp, pri.p);
+      else if (i == 3) mpz_sub_ui(tmp, pub.n, 1);
+      else mpz_urandomm(tmp, rnd, pub.n);
+      rsa_pri_exp(tmp2, tmp, &pri);
+      rsa_pri_exp_hot(tmp, tmp, &hk);
+      ok = mpz_cmp(tmp, tmp2) == 0;
+    }
+    rsa_hotkey_clear(&hk);
+    printf("Hot key     : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (13) Key cache: ids 0 .. 7 all load the test key, a budget of about
+  //      three entries forces evictions, id 99 fails to load (put is then
+  //      a no-op), a thread that exits inside the cache does not stop
+  //      reclamation, hits alone drain retired entries
+  {
+    RSA_CACHE *c = rsa_cache_new(3 * 2600, 1, cache_loader, NULL);
+    RSA_CACHE_STATS st;
+    int ok = c != NULL;
+    mpz_urandomm(tmp, rnd, pub.n);
+    rsa_pri_exp(tmp2, tmp, &pri);
+    for (int i = 0; i < 40 && ok; ++i) {
+      const RSA_HOTKEY *hk = rsa_cache_get(c, (uint64_t)(i * 5 % 8));
+      mpz_t y;
+      ok = hk != NULL;
+      if (!ok) break;
+      mpz_init(y);
+      rsa_pri_exp_hot(y, tmp, hk);
+      ok = mpz_cmp(y, tmp2) == 0;
+      mpz_clear(y);
+      rsa_cache_put(c);
+    }
+    ok = ok && rsa_cache_get(c, 99) == NULL;
+    if (c) {
+      pthread_t tid;
+      rsa_cache_put(c);
+      rsa_cache_stats(c, &st);
+      ok = ok && st.hits + st.misses == 41 && st.evictions > 0 && st.entries <= 3
+        && st.entries + st.evictions == st.misses - 1;
+      pthread_create(&tid, NULL, cache_thread, c);
+      pthread_join(tid, NULL);
+      for (int i = 0; i < 24 && ok; ++i) {
+        ok = rsa_cache_get(c, (uint64_t)(i % 8)) != NULL;
+        rsa_cache_put(c);
+      }
+      rsa_cache_stats(c, &st);
+      ok = ok && st.retired <= 2;
+      // Hits only: the periodic sweep drains what is left
+      for (int i = 0; i < 4 * 64 && ok; ++i) {
+        ok = rsa_cache_get(c, 7) != NULL;
+        rsa_cache_put(c);
+      }
+      rsa_cache_stats(c, &st);
+      ok = ok && st.retired == 0;
+      rsa_cache_free(c);
+    }
+    printf("Key cache   : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (14) Parallel CRT halves, parked (spin 0) and spinning helpers, out
+  //      aliasing in on the last round
+  {
+    mpz_t y;
+    int ok = 1;
+    mpz_init(y);
+    for (int spin = 0; spin <= 1000 && ok; spin += 1000) {
+      RSA_CRT_POOL *pool = rsa_crt_pool_new(spin);
+      ok = pool != NULL;
+      for (int i = 0; i < 8 && ok; ++i) {
+        mpz_urandomm(tmp, rnd, pub.n);
+        rsa_pri_exp(tmp2, tmp, &pri);
+        if (i == 7) {
+          rsa_pri_exp_par(tmp, tmp, &pri, pool);
+          ok = mpz_cmp(tmp, tmp2) == 0;
+        } else {
+          rsa_pri_exp_par(y, tmp, &pri, pool);
+          ok = mpz_cmp(y, tmp2) == 0;
+        }
+      }
+      rsa_crt_pool_free(pool);
+    }
+    mpz_clear(y);
+    printf("Parallel CRT: %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (15) NTT exponentiation: 3, the test key, limb-pattern and random
+  //      moduli up to MAX_RSA_SIZE, short exponents past 2048 bits
+  {
+    static const int bits[] = {2, 2048, 4095, 8192, MAX_RSA_SIZE};
+    mpz_t n, e, y;
+    int ok = 1;
+    mpz_inits(n, e, y, NULL);
+    for (int i = 0; i < 5 && ok; ++i) {
+      RSA_NTT c;
+      if (i == 1) {
+        mpz_set(n, pub.n);
+      } else if (i == 2) {
+        mpz_set_ui(n, 0); // 2 ^ 4095 - 1, every limb full
+        mpz_setbit(n, bits[i]);
+        mpz_sub_ui(n, n, 1);
+      } else {
+        mpz_urandomb(n, rnd, bits[i]);
+        mpz_setbit(n, bits[i] - 1);
+        mpz_setbit(n, 0);
+      }
+      mpz_urandomb(tmp, rnd, bits[i] + 64);
+      mpz_urandomb(e, rnd, bits[i] <= 2048 ? bits[i] : 256);
+      ok = rsa_ntt_init(&c, n) == 0;
+      if (!ok) break;
+      rsa_ntt_powm(y, tmp, e, &c);
+      mpz_powm(tmp2, tmp, e, n);
+      ok = mpz_cmp(y, tmp2) == 0;
+      rsa_powm(y, tmp, e, n);
+      ok = ok && mpz_cmp(y, tmp2) == 0;
+      rsa_ntt_clear(&c);
+    }
+    mpz_clears(n, e, y, NULL);
+    printf("NTT powm    : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (16) Lazy Montgomery: the test key (full top limb, one limb more) and
+  //      2 ^ 4094 - 1 (two spare bits), powm, plan, multi-exp and inversion
+  {
+    mpz_t n, e;
+    mpz_srcptr bp[2] = {tmp, tmp2}, ep[2];
+    int ok = 1;
+    mpz_inits(n, e, NULL);
+    for (int i = 0; i < 2 && ok; ++i) {
+      RSA_MONT m;
+      RSA_EXP_PLAN pl;
+      mpz_t b[2], y;
+      mpz_ptr yp[2] = {b[0], b[1]};
+      if (i == 0) {
+        mpz_set(n, pub.n);
+      } else {
+        mpz_set_ui(n, 0);
+        mpz_setbit(n, 4094);
+        mpz_sub_ui(n, n, 1);
+      }
+      ok = rsa_mont_init_lazy(&m, n) == 0
+        && m.size == (mp_size_t)((mpz_sizeinbase(n, 2) + 2 + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS);
+      if (!ok) break;
+      mpz_inits(b[0], b[1], y, NULL);
+      do {
+        mpz_urandomb(tmp, rnd, mpz_sizeinbase(n, 2) + 64); // not reduced
+        mpz_gcd(y, tmp, n);
+      } while (mpz_cmp_ui(y, 1) != 0); // 2 ^ 4094 - 1 has small factors
+      mpz_sub_ui(tmp2, n, 1);
+      mpz_urandomb(e, rnd, mpz_sizeinbase(n, 2));
+      rsa_mont_powm(y, tmp, e, &m);
+      mpz_powm(b[0], tmp, e, n);
+      ok = mpz_cmp(y, b[0]) == 0;
+      rsa_mont_powm(y, tmp2, e, &m);
+      mpz_powm(b[0], tmp2, e, n);
+      ok = ok && mpz_cmp(y, b[0]) == 0;
+      rsa_plan_init(&pl, e);
+      rsa_mont_powm_plan(y, tmp, &pl, &m);
+      mpz_powm(b[0], tmp, e, n);
+      ok = ok && mpz_cmp(y, b[0]) == 0;
+      rsa_plan_clear(&pl);
+      ep[0] = e;
+      ep[1] = pub.e;
+      mpz_powm(b[1], tmp2, pub.e, n);
+      mpz_mul(b[0], b[0], b[1]);
+      mpz_mod(b[0], b[0], n);
+      ok = ok && rsa_mont_multi_powm(y, bp, ep, 2, &m) == 0 && mpz_cmp(y, b[0]) == 0;
+      ok = ok && rsa_inv_batch(yp, bp, 2, &m, NULL) == 0;
+      mpz_invert(y, tmp, n);
+      ok = ok && mpz_cmp(b[0], y) == 0;
+      mpz_invert(y, tmp2, n);
+      ok = ok && mpz_cmp(b[1], y) == 0;
+      mpz_clears(b[0], b[1], y, NULL);
+      rsa_mont_clear(&m);
+    }
+    mpz_clears(n, e, NULL);
+    printf("Lazy mont   : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (17) Perf phases: nested phases by hand (outer is charged for its own
+  //      time only, a stray end is ignored), and with WITH_RSA_PERF every
+  //      keygen and pri_exp phase of the 2048-bit key above; a thread's
+  //      block outlives it
+  {
+    static RSA_PERF st;
+    pthread_t tid;
+    int ok = 1;
+    rsa_perf_begin(RSA_PHASE_EXP, 3072);
+    mpz_powm(tmp, pub.n, pub.n, pri.p);
+    rsa_perf_begin(RSA_PHASE_REDUCE, 3072);
+    mpz_mod(tmp, pub.n, pri.q);
+    rsa_perf_end();
+    rsa_perf_end();
+    rsa_perf_end();
+    rsa_perf_snapshot(&st);
+    ok = st.calls[RSA_PHASE_EXP][3] == 1 && st.calls[RSA_PHASE_REDUCE][3] == 1
+      && st.ns[RSA_PHASE_EXP][3] > st.ns[RSA_PHASE_REDUCE][3];
+    for (int i = 0; i < RSA_EV_MAX; ++i) {
+      ok = ok && (st.ev[RSA_PHASE_EXP][3][i] >= 0) == (st.ev[RSA_PHASE_REDUCE][3][i] >= 0);
+    }
+#ifdef WITH_RSA_PERF
+    for (int p = 0; p < RSA_PHASE_MAX; ++p) ok = ok && st.calls[p][2] > 0;
+#endif
+    printf("Perf phases : %s\n", ok ? "OK" : "FAIL");
+#ifdef WITH_RSA_PERF
+    rsa_perf_print(stdout, &st);
+#endif
+    pthread_create(&tid, NULL, perf_thread, NULL);
+    pthread_join(tid, NULL);
+    rsa_perf_snapshot(&st);
+    ok = st.calls[RSA_PHASE_EXP][3] == 2;
+    printf("Perf exit   : %s\n", ok ? "OK" : "FAIL");
+  }
+
+  // (18) Lean keygen: no d until rsa_key_derive, then d = e ^ -1 mod
+  //      lcm(p - 1, q - 1); private operations and the hot key work
+  //      without it, a lean key over a full one clears d and has the same
+  //      CRT fields, which match mpz_invert's
+  {
+    RSA_PUBKEY lpub;
+    RSA_PRIKEY lpri;
+    RSA_HOTKEY hk;
+    mpz_t lam, u, crt[3];
+    int ok;
+    rsa_key_init(&lpub, &lpri);
+    mpz_inits(lam, u, crt[0], crt[1], crt[2], NULL);
+    ok = rsa_key_gen_lean(&lpub, &lpri, 2048, rnd) == 0;
+#ifndef NO_RSA_CRT
+    ok = ok && lpri.missing == RSA_KEY_D && mpz_sgn(lpri.d) == 0;
+#else
+    ok = ok && lpri.missing == 0;
+#endif
+    mpz_urandomm(tmp, rnd, lpub.n);
+    rsa_pub_exp(tmp2, tmp, &lpub);
+    rsa_pri_exp(tmp2, tmp2, &lpri);
+    ok = ok && mpz_cmp(tmp, tmp2) == 0 && rsa_hotkey_init(&hk, &lpri) == 0;
+    if (ok) {
+      rsa_pub_exp(tmp2, tmp, &lpub);
+      rsa_pri_exp_hot(tmp2, tmp2, &hk);
+      ok = mpz_cmp(tmp, tmp2) == 0;
+      rsa_hotkey_clear(&hk);
+    }
+    ok = ok && rsa_key_derive(&lpri, RSA_KEY_D) == 0 && lpri.missing == 0;
+    mpz_sub_ui(lam, lpri.p, 1);
+    mpz_sub_ui(u, lpri.q, 1);
+    mpz_lcm(lam, lam, u);
+    mpz_mul(u, lpri.d, lpri.e);
+    mpz_mod(u, u, lam);
+    ok = ok && mpz_cmp_ui(u, 1) == 0;
+#ifndef NO_RSA_CRT
+    ok = ok && mpz_cmp(lpri.d, lam) < 0;
+    mpz_set(crt[0], lpri.dp);
+    mpz_set(crt[1], lpri.dq);
+    mpz_set(crt[2], lpri.qi);
+    mpz_set(lam, lpri.p);
+    mpz_set(u, lpri.q);
+    ok = ok && rsa_key_from_primes(&lpub, &lpri, lam, u) == 0 && mpz_sgn(lpri.d) != 0
+      && rsa_key_from_primes_lean(&lpub, &lpri, lam, u) == 0 && mpz_sgn(lpri.d) == 0
+      && lpri.missing == RSA_KEY_D && mpz_cmp(lpri.dp, crt[0]) == 0
+      && mpz_cmp(lpri.dq, crt[1]) == 0 && mpz_cmp(lpri.qi, crt[2]) == 0;
+    mpz_sub_ui(u, pri.p, 1);
+    ok = ok && mpz_invert(u, pri.e, u) && mpz_cmp(u, pri.dp) == 0;
+#endif
+    mpz_sub_ui(u, pri.p, 1);
+    mpz_sub_ui(lam, pri.q, 1);
+    mpz_mul(lam, lam, u);
+    ok = ok && mpz_invert(u, pri.e, lam) && mpz_cmp(u, pri.d) == 0;
+    mpz_clears(lam, u, crt[0], crt[1], crt[2], NULL);
+    rsa_key_clear(&lpub, &lpri);
+    printf("Lean keygen : %s\n", ok ? "OK" : "FAIL");
+  }
+
+#ifdef WITH_RSA_STATS
+  // (19) Counters and latency histograms, a thread's block outlives it;
+  //      percentiles are nearest rank (p99 of 3 samples is the largest)
+  {
+    const int s = pub.RSA_SIZE / 1024;
+    RSA_STATS st;
+    RSA_HIST *h = calloc(1, sizeof(*h));
+    uint64_t before;
+    pthread_t tid;
+    rsa_stats_snapshot(&st);
+    before = st.latency[RSA_STAT_PUB_EXP][s] ? st.latency[RSA_STAT_PUB_EXP][s]->count : 0;
+    rsa_stats_clear(&st);
+    pthread_create(&tid, NULL, stats_thread, NULL);
+    pthread_join(tid, NULL);
+    rsa_stats_snapshot(&st);
+    ok = st.latency[RSA_STAT_PUB_EXP][s] && st.latency[RSA_STAT_PUB_EXP][s]->count == before + 1;
+    printf("Stats exit  : %s\n", ok ? "OK" : "FAIL");
+    // Values below 32 ns have a bucket each
+    h->bucket[1] = h->bucket[2] = h->bucket[30] = 1;
+    h->count = 3;
+    h->max = 30;
+    ok = rsa_hist_percentile(h, 99) == 30 && rsa_hist_percentile(h, 50) == 2
+      && rsa_hist_percentile(h, 0) == 1;
+    printf("Percentiles : %s\n", ok ? "OK" : "FAIL");
+    free(h);
+    rsa_stats_print(stdout, &st);
+    rsa_stats_clear(&st);
+  }
+#endif
+
   rsa_key_clear(&pub, &pri);
+  rsa_drbg_clear(&pad_rnd);
   gmp_randclear(rnd);
   return 0;
 }